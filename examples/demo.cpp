@@ -1,8 +1,16 @@
 #include "merge_tree.h"
 #include <iostream>
+#include <algorithm>
 #include <chrono>
 #include <random>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <map>
 
 using namespace clickhouse;
 
@@ -97,6 +105,1189 @@ void test_merge_operations() {
     std::cout << "Merge operations test completed successfully!" << std::endl << std::endl;
 }
 
+void test_time_range_queries() {
+    std::cout << "=== Testing Time Range Queries ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 50;
+    config.enable_background_merge = false;
+
+    MergeTree engine("./data/test_time_range", config);
+
+    std::cout << "Inserting 4 hours of data..." << std::endl;
+    for (int hour = 0; hour < 4; ++hour) {
+        for (int i = 0; i < 50; ++i) {
+            std::string key = "sensor" + std::to_string(i % 10);
+            std::string value = "reading_" + std::to_string(hour) + "_" + std::to_string(i);
+            engine.insert(key, value, hour * 3600 + i);
+        }
+    }
+    engine.flush_memtable();
+
+    auto all_results = engine.query("sensor0", "sensor9");
+    auto last_hour = engine.query("sensor0", "sensor9", 3 * 3600, 4 * 3600 - 1);
+    std::cout << "Rows in key range: " << all_results.size() << std::endl;
+    std::cout << "Rows in key range during the last hour: " << last_hour.size() << std::endl;
+
+    engine.shutdown();
+    std::cout << "Time range query test completed successfully!" << std::endl << std::endl;
+}
+
+void test_partitioning() {
+    std::cout << "=== Testing Partitioning ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 1000;
+    config.max_parts = 1;
+    config.enable_background_merge = false;
+    config.partition_granularity = PartitionGranularity::Day;
+
+    MergeTree engine("./data/test_partitioning", config);
+
+    const uint64_t day = 86400;
+    const uint64_t start = 1700000000;
+
+    std::cout << "Inserting 3 days of data in 2 batches..." << std::endl;
+    for (int batch = 0; batch < 2; ++batch) {
+        for (int d = 0; d < 3; ++d) {
+            for (int i = 0; i < 20; ++i) {
+                std::string key = "metric" + std::to_string(i);
+                engine.insert(key, "v" + std::to_string(batch), start + d * day + batch * 60 + i);
+            }
+        }
+        engine.flush_memtable();
+    }
+
+    std::cout << "Partitions:";
+    for (const auto& id : engine.partition_ids()) {
+        std::cout << " " << id;
+    }
+    std::cout << std::endl;
+    std::cout << "Parts before optimize: " << engine.part_count() << std::endl;
+
+    engine.optimize();
+    std::cout << "Parts after optimize (merges stay within a partition): " << engine.part_count() << std::endl;
+
+    auto first_day = engine.query("metric0", "metric9", start, start + day - 1);
+    std::cout << "Rows on the first day: " << first_day.size() << std::endl;
+
+    engine.drop_partition(engine.partition_ids().front());
+    std::cout << "Total rows after dropping the oldest partition: " << engine.total_rows() << std::endl;
+
+    engine.shutdown();
+    std::cout << "Partitioning test completed successfully!" << std::endl << std::endl;
+}
+
+void test_ttl() {
+    std::cout << "=== Testing TTL ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 1000;
+    config.enable_background_merge = false;
+    config.ttl_seconds = 30 * 86400;
+
+    MergeTree engine("./data/test_ttl", config);
+
+    uint64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    uint64_t expired = now - 40 * 86400;
+
+    std::cout << "Inserting one fully expired part and one mostly expired part..." << std::endl;
+    for (int i = 0; i < 100; ++i) {
+        engine.insert("old_key" + std::to_string(i), "stale", expired + i);
+    }
+    engine.flush_memtable();
+
+    for (int i = 0; i < 100; ++i) {
+        uint64_t ts = i < 70 ? expired + i : now - i;
+        engine.insert("mixed_key" + std::to_string(i), "value", ts);
+    }
+    engine.flush_memtable();
+
+    std::cout << "Before TTL: " << engine.part_count() << " parts, " << engine.total_rows() << " rows" << std::endl;
+    engine.apply_ttl();
+    std::cout << "After TTL: " << engine.part_count() << " parts, " << engine.total_rows() << " rows" << std::endl;
+
+    engine.shutdown();
+    std::cout << "TTL test completed successfully!" << std::endl << std::endl;
+}
+
+void test_replacing_merge_tree() {
+    std::cout << "=== Testing ReplacingMergeTree ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 1000;
+    config.max_parts = 1;
+    config.enable_background_merge = false;
+    config.merge_mode = MergeMode::Replacing;
+
+    MergeTree engine("./data/test_replacing", config);
+
+    std::cout << "Writing 3 versions of 10 keys in separate parts..." << std::endl;
+    for (int version = 0; version < 3; ++version) {
+        for (int i = 0; i < 10; ++i) {
+            engine.insert("user" + std::to_string(i), "v" + std::to_string(version), version * 100 + i);
+        }
+        engine.flush_memtable();
+    }
+    engine.insert("user0", "v3", 1000);
+
+    QueryOptions final_options;
+    final_options.final = true;
+
+    std::cout << "Versions of user0: " << engine.query_key("user0").size() << std::endl;
+    auto latest = engine.query_key("user0", final_options);
+    std::cout << "FINAL lookup of user0: " << latest.size() << " row, value " << latest[0].value << std::endl;
+
+    engine.optimize();
+    std::cout << "Rows after merging: " << engine.total_rows() << std::endl;
+
+    engine.shutdown();
+    std::cout << "ReplacingMergeTree test completed successfully!" << std::endl << std::endl;
+}
+
+void test_aggregating_merge_tree() {
+    std::cout << "=== Testing Summing/AggregatingMergeTree ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 1000;
+    config.max_parts = 1;
+    config.enable_background_merge = false;
+    config.merge_mode = MergeMode::Summing;
+
+    {
+        MergeTree engine("./data/test_summing", config);
+
+        for (int batch = 0; batch < 5; ++batch) {
+            for (int i = 0; i < 100; ++i) {
+                engine.insert("page" + std::to_string(i % 4), std::to_string(i), batch * 100 + i);
+            }
+            engine.flush_memtable();
+        }
+
+        QueryOptions final_options;
+        final_options.final = true;
+        auto totals = engine.query("page0", "page3", final_options);
+        std::cout << "Rows stored: " << engine.total_rows() << ", folded on read:";
+        for (const auto& row : totals) {
+            std::cout << " " << row.key << "=" << row.value;
+        }
+        std::cout << std::endl;
+
+        engine.optimize();
+        std::cout << "Rows stored after merging: " << engine.total_rows() << std::endl;
+        engine.shutdown();
+    }
+
+    config.merge_mode = MergeMode::Aggregating;
+    config.aggregate_function = "uniq";
+
+    {
+        MergeTree engine("./data/test_aggregating", config);
+
+        for (int i = 0; i < 5000; ++i) {
+            engine.insert("visitors", "user" + std::to_string(i % 1200), i);
+            if (i % 1000 == 999) {
+                engine.flush_memtable();
+            }
+        }
+        engine.optimize();
+
+        QueryOptions final_options;
+        final_options.final = true;
+        auto unique_visitors = engine.query_key("visitors", final_options);
+        std::cout << "Approximate unique visitors (exact 1200): " << unique_visitors[0].value
+                  << " from " << engine.total_rows() << " stored row(s)" << std::endl;
+        engine.shutdown();
+    }
+
+    std::cout << "Summing/AggregatingMergeTree test completed successfully!" << std::endl << std::endl;
+}
+
+void test_collapsing_merge_tree() {
+    std::cout << "=== Testing CollapsingMergeTree ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 1000;
+    config.max_parts = 1;
+    config.enable_background_merge = false;
+    config.merge_mode = MergeMode::Collapsing;
+
+    MergeTree engine("./data/test_collapsing", config);
+
+    for (int i = 0; i < 10; ++i) {
+        engine.insert("session" + std::to_string(i), "active", 100);
+    }
+    engine.flush_memtable();
+
+    std::cout << "Deleting session3 and updating session7..." << std::endl;
+    engine.cancel("session3", "active", 200);
+    engine.cancel("session7", "active", 200);
+    engine.insert("session7", "closed", 200);
+    engine.flush_memtable();
+
+    QueryOptions final_options;
+    final_options.final = true;
+
+    std::cout << "Stored rows: " << engine.total_rows() << std::endl;
+    std::cout << "session3 rows with FINAL: " << engine.query_key("session3", final_options).size() << std::endl;
+    std::cout << "session7 with FINAL: " << engine.query_key("session7", final_options)[0].value << std::endl;
+
+    engine.optimize();
+    std::cout << "Stored rows after merging: " << engine.total_rows() << std::endl;
+
+    engine.shutdown();
+    std::cout << "CollapsingMergeTree test completed successfully!" << std::endl << std::endl;
+}
+
+void test_lightweight_delete() {
+    std::cout << "=== Testing Lightweight Deletes ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 10000;
+    config.max_parts = 1;
+    config.enable_background_merge = false;
+
+    MergeTree engine("./data/test_delete", config);
+
+    for (int batch = 0; batch < 2; ++batch) {
+        for (int i = 0; i < 5000; ++i) {
+            char key[32];
+            std::snprintf(key, sizeof(key), "user%05d", i);
+            engine.insert(key, "batch" + std::to_string(batch), batch * 10000 + i);
+        }
+        if (batch == 0) {
+            engine.flush_memtable();
+        }
+    }
+
+    std::cout << "Rows before delete: " << engine.total_rows() << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t deleted = engine.delete_range("user01000", "user01999");
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Deleted " << deleted << " rows in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " μs" << std::endl;
+
+    std::cout << "Rows in deleted range: " << engine.query("user01000", "user01999").size() << std::endl;
+    std::cout << "Rows after delete: " << engine.total_rows() << std::endl;
+
+    engine.optimize();
+    std::cout << "Rows after merge purges masked rows: " << engine.total_rows() << std::endl;
+
+    engine.shutdown();
+    std::cout << "Lightweight delete test completed successfully!" << std::endl << std::endl;
+}
+
+void test_mutations() {
+    std::cout << "=== Testing Mutations ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 100000;
+    config.max_parts = 10;
+    config.enable_background_merge = false;
+
+    MergeTree engine("./data/test_mutations", config);
+
+    for (int part = 0; part < 3; ++part) {
+        for (int i = 0; i < 5000; ++i) {
+            char key[32];
+            std::snprintf(key, sizeof(key), "user%05d", part * 5000 + i);
+            engine.insert(key, std::to_string(i % 100), i);
+        }
+        engine.flush_memtable();
+    }
+
+    size_t update_id = engine.mutate_update("user01000", "user01999",
+        [](const Row& row) { return std::to_string(std::stoi(row.value) * 10); });
+    size_t delete_id = engine.mutate_delete("user00000", "user14999",
+        [](const Row& row) { return row.value == "0"; });
+
+    // Inserted after the mutations were submitted, so they are left alone.
+    engine.insert("user01500", "0", 99999);
+
+    std::cout << "Pending mutations: " << engine.pending_mutations() << std::endl;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    engine.apply_mutations();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Mutations " << update_id << " and " << delete_id << " done: "
+              << (engine.is_mutation_done(delete_id) ? "yes" : "no") << " in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    std::cout << "Rows after delete mutation: " << engine.total_rows() << std::endl;
+
+    for (const auto& row : engine.query_key("user01500")) {
+        std::cout << "user01500 @" << row.timestamp << " = " << row.value << std::endl;
+    }
+
+    engine.shutdown();
+    std::cout << "Mutation test completed successfully!" << std::endl << std::endl;
+}
+
+void test_concurrent_mutations() {
+    std::cout << "=== Testing Mutations During Inserts ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 200;
+    config.max_parts = 10;
+    config.enable_background_merge = false;
+    MergeTree engine("./data/test_concurrent_mutations", config);
+
+    auto row_key = [](int i) {
+        char key[32];
+        std::snprintf(key, sizeof(key), "row%07d", i);
+        return std::string(key);
+    };
+
+    std::atomic<int> inserted{0};
+    std::atomic<bool> stop{false};
+    std::thread inserter([&] {
+        for (int i = 0; !stop; ++i) {
+            engine.insert(row_key(i), "v", i);
+            inserted = i + 1;
+        }
+    });
+
+    // Each mutation marks the last rows inserted before it was submitted
+    // and is applied at once, often while the inserter is still writing the
+    // part holding them.
+    constexpr int rounds = 40;
+    constexpr int marked_rows = 100;
+    std::vector<std::pair<std::string, std::string>> marked;
+    for (int round = 0; round < rounds; ++round) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        int inserted_before = inserted;
+        marked.emplace_back(row_key(std::max(0, inserted_before - marked_rows)), row_key(inserted_before - 1));
+        engine.mutate_update(marked.back().first, marked.back().second,
+                             [](const Row& row) { return row.value + "x"; });
+        engine.apply_mutations();
+    }
+    stop = true;
+    inserter.join();
+
+    size_t missed = 0;
+    for (const auto& [first_key, last_key] : marked) {
+        for (const auto& row : engine.query(first_key, last_key)) {
+            if (row.value.size() < 2) {
+                ++missed;
+            }
+        }
+    }
+
+    std::cout << inserted << " rows inserted during " << rounds << " mutations, rows missing a mutation: " << missed
+              << std::endl;
+    if (missed > 0) {
+        throw std::runtime_error("Mutation skipped rows flushed concurrently");
+    }
+
+    engine.shutdown();
+    std::cout << "Concurrent mutation test completed successfully!" << std::endl << std::endl;
+}
+
+void test_concurrent_deletes() {
+    std::cout << "=== Testing Deletes During Inserts ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 200;
+    config.max_parts = 1000;
+    config.enable_background_merge = false;
+    MergeTree engine("./data/test_concurrent_deletes", config);
+
+    auto row_key = [](int i) {
+        char key[32];
+        std::snprintf(key, sizeof(key), "row%07d", i);
+        return std::string(key);
+    };
+
+    std::atomic<int> inserted{0};
+    std::atomic<bool> stop{false};
+    std::thread inserter([&] {
+        for (int i = 0; !stop; ++i) {
+            engine.insert(row_key(i), "v", i);
+            inserted = i + 1;
+        }
+    });
+
+    // Each delete covers the last rows inserted before it, which a flush is
+    // often writing to a part at that moment.
+    constexpr int rounds = 40;
+    constexpr int deleted_rows = 100;
+    std::vector<std::pair<std::string, std::string>> deleted;
+    for (int round = 0; round < rounds; ++round) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        int inserted_before = inserted;
+        deleted.emplace_back(row_key(std::max(0, inserted_before - deleted_rows)), row_key(inserted_before - 1));
+        engine.delete_range(deleted.back().first, deleted.back().second);
+    }
+    stop = true;
+    inserter.join();
+
+    size_t survived = 0;
+    for (const auto& [first_key, last_key] : deleted) {
+        survived += engine.query(first_key, last_key).size();
+    }
+
+    std::cout << inserted << " rows inserted during " << rounds << " deletes, deleted rows still visible: "
+              << survived << std::endl;
+    if (survived > 0) {
+        throw std::runtime_error("Delete missed rows flushed concurrently");
+    }
+
+    engine.shutdown();
+    std::cout << "Concurrent delete test completed successfully!" << std::endl << std::endl;
+}
+
+void test_concurrent_reads() {
+    std::cout << "=== Testing Reads During Flushes ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 200;
+    config.max_parts = 1000;
+    config.enable_background_merge = false;
+    config.merge_mode = MergeMode::Summing;
+    MergeTree engine("./data/test_concurrent_reads", config);
+
+    std::atomic<int> inserted{0};
+    std::atomic<bool> stop{false};
+    std::thread inserter([&] {
+        for (int i = 0; !stop; ++i) {
+            engine.insert("page" + std::to_string(i % 4), "1", i);
+            inserted = i + 1;
+        }
+    });
+
+    // Each total, folded by FINAL or counted by group_by in turn, must count
+    // every row inserted before the read exactly once, whether a flush moves
+    // it to a part meanwhile or not.
+    QueryOptions final_options;
+    final_options.final = true;
+    GroupBySpec spec;
+    spec.key_prefix_length = 4;
+    constexpr int rounds = 40;
+    int inconsistent = 0;
+    for (int round = 0; round < rounds; ++round) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        int inserted_before = inserted;
+        double total = 0;
+        if (round % 2 == 0) {
+            for (const auto& row : engine.query("page0", "page3", final_options)) {
+                total += std::stod(row.value);
+            }
+        } else {
+            for (const auto& group : engine.group_by("page0", "page3", spec)) {
+                total += static_cast<double>(group.count);
+            }
+        }
+        // The row being inserted may already be visible.
+        int inserted_after = inserted + 1;
+        if (total < inserted_before || total > inserted_after) {
+            ++inconsistent;
+        }
+    }
+    stop = true;
+    inserter.join();
+
+    std::cout << inserted << " rows inserted during " << rounds << " reads, inconsistent totals: "
+              << inconsistent << std::endl;
+    if (inconsistent > 0) {
+        throw std::runtime_error("Read saw rows flushed concurrently twice or not at all");
+    }
+
+    engine.shutdown();
+    std::cout << "Concurrent read test completed successfully!" << std::endl << std::endl;
+}
+
+void test_concurrent_merges() {
+    std::cout << "=== Testing Concurrent Merges ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 500;
+    config.max_parts = 20;
+    config.merge_threads = 4;
+
+    MergeTree engine("./data/test_concurrent_merges", config);
+
+    std::vector<std::thread> writers;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int writer = 0; writer < 4; ++writer) {
+        writers.emplace_back([&engine, writer] {
+            for (int i = 0; i < 25000; ++i) {
+                char key[32];
+                std::snprintf(key, sizeof(key), "w%d_%06d", writer, i);
+                engine.insert(key, "value", i);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Inserted 100000 rows from 4 threads in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms, parts: "
+              << engine.part_count() << " after ~200 flushes" << std::endl;
+
+    engine.optimize();
+    std::cout << "Parts after optimize: " << engine.part_count() << ", rows: " << engine.total_rows() << std::endl;
+
+    engine.shutdown();
+    std::cout << "Concurrent merge test completed successfully!" << std::endl << std::endl;
+}
+
+void test_insert_backpressure() {
+    std::cout << "=== Testing Insert Backpressure ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 100;
+    config.max_parts = 1000;
+    config.enable_background_merge = false;
+    config.parts_to_delay_insert = 10;
+    config.parts_to_throw_insert = 20;
+    config.max_delay_to_insert_ms = 5;
+
+    MergeTree engine("./data/test_backpressure", config);
+
+    size_t inserted = 0;
+    try {
+        for (int i = 0; i < 10000; ++i) {
+            engine.insert("key" + std::to_string(i), "value", i);
+            ++inserted;
+        }
+    } catch (const std::exception& e) {
+        std::cout << "Insert " << inserted << " rejected: " << e.what() << std::endl;
+    }
+
+    auto metrics = engine.metrics();
+    std::cout << "Parts: " << metrics.max_parts_in_partition << ", delayed flushes: " << metrics.delayed_inserts
+              << " (" << metrics.delayed_time_us / 1000 << " ms), rejected inserts: " << metrics.rejected_inserts
+              << std::endl;
+    engine.shutdown();
+
+    config.block_insert_on_too_many_parts = true;
+    MergeTree blocking_engine("./data/test_backpressure_blocking", config);
+    for (int i = 0; i < 10000; ++i) {
+        blocking_engine.insert("key" + std::to_string(i), "value", i);
+    }
+
+    metrics = blocking_engine.metrics();
+    std::cout << "Blocking mode: " << blocking_engine.total_rows() << " rows, " << metrics.max_parts_in_partition
+              << " parts, blocked inserts: " << metrics.blocked_inserts << " ("
+              << metrics.blocked_time_us / 1000 << " ms)" << std::endl;
+
+    blocking_engine.shutdown();
+    std::cout << "Insert backpressure test completed successfully!" << std::endl << std::endl;
+}
+
+void test_vertical_merge() {
+    std::cout << "=== Testing Vertical Merge ===" << std::endl;
+
+    for (bool vertical : {false, true}) {
+        MergeTreeConfig config;
+        config.memtable_flush_threshold = 100000;
+        config.max_parts = 1;
+        config.enable_background_merge = false;
+        config.vertical_merge_min_rows = vertical ? 1 : 0;
+
+        MergeTree engine(vertical ? "./data/test_vertical_merge" : "./data/test_horizontal_merge", config);
+
+        std::string wide_value(2048, 'v');
+        for (int part = 0; part < 2; ++part) {
+            for (int i = 0; i < 10000; ++i) {
+                char key[32];
+                std::snprintf(key, sizeof(key), "user%06d", i * 2 + part);
+                engine.insert(key, wide_value, i);
+            }
+            engine.flush_memtable();
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        engine.optimize();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::cout << (vertical ? "Vertical" : "Horizontal") << " merge of 20000 rows with 2 KB values: "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms, "
+                  << engine.part_count() << " part, memory after merge: "
+                  << engine.memory_usage() / 1024 << " KB" << std::endl;
+
+        engine.shutdown();
+    }
+
+    std::cout << "Vertical merge test completed successfully!" << std::endl << std::endl;
+}
+
+void test_parallel_merge() {
+    std::cout << "=== Testing Parallel Range-Partitioned Merge ===" << std::endl;
+
+    for (size_t threads : {1, 4}) {
+        MergeTreeConfig config;
+        config.memtable_flush_threshold = 1000000;
+        config.max_parts = 1;
+        config.enable_background_merge = false;
+        config.parallel_merge_min_rows = 1;
+        config.merge_slice_threads = threads;
+
+        MergeTree engine("./data/test_parallel_merge_" + std::to_string(threads), config);
+
+        std::mt19937 rng(42);
+        for (int part = 0; part < 4; ++part) {
+            for (int i = 0; i < 50000; ++i) {
+                engine.insert("key" + std::to_string(rng() % 100000), "value" + std::to_string(i), i);
+            }
+            engine.flush_memtable();
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        engine.optimize();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::cout << "Merged 200000 rows with " << threads << " slice thread(s) in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms, rows: "
+                  << engine.total_rows() << std::endl;
+
+        engine.shutdown();
+    }
+
+    std::cout << "Parallel merge test completed successfully!" << std::endl << std::endl;
+}
+
+void test_merge_throttling() {
+    std::cout << "=== Testing Merge I/O Throttling ===" << std::endl;
+
+    for (uint64_t limit : {0, 2 * 1024 * 1024}) {
+        MergeTreeConfig config;
+        config.memtable_flush_threshold = 1000000;
+        config.max_parts = 1;
+        config.enable_background_merge = false;
+        config.merge_max_write_bytes_per_second = limit;
+
+        MergeTree engine("./data/test_merge_throttling_" + std::to_string(limit), config);
+
+        for (int part = 0; part < 4; ++part) {
+            for (int i = 0; i < 10000; ++i) {
+                engine.insert("key" + std::to_string(part * 10000 + i), std::string(100, 'v'), i);
+            }
+            engine.flush_memtable();
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        engine.optimize();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        auto metrics = engine.metrics();
+        std::cout << (limit == 0 ? "Unthrottled" : "Write limit 2 MB/s") << ": merged in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms, read "
+                  << metrics.merge_bytes_read << " B, wrote " << metrics.merge_bytes_written << " B, throttled "
+                  << metrics.merge_write_throttled_us / 1000 << " ms" << std::endl;
+
+        engine.shutdown();
+    }
+
+    std::cout << "Merge throttling test completed successfully!" << std::endl << std::endl;
+}
+
+void test_atomic_part_commit() {
+    std::cout << "=== Testing Atomic Part Commit ===" << std::endl;
+
+    const std::string path = "./data/test_atomic_commit";
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 1000000;
+    config.enable_background_merge = false;
+
+    {
+        MergeTree engine(path, config);
+        for (int i = 0; i < 5000; ++i) {
+            engine.insert("key" + std::to_string(i), "value" + std::to_string(i), i);
+        }
+        engine.flush_memtable();
+        engine.shutdown();
+    }
+
+    // A write interrupted before its rename leaves only a temporary directory.
+    std::filesystem::create_directories(path + "/tmp_part_99");
+    std::ofstream(path + "/tmp_part_99/metadata.bin") << "partial";
+
+    {
+        MergeTree engine(path, config);
+        std::cout << "Reopened with " << engine.part_count() << " part(s), " << engine.total_rows()
+                  << " rows; leftover removed: " << (!std::filesystem::exists(path + "/tmp_part_99") ? "yes" : "no")
+                  << std::endl;
+        engine.shutdown();
+    }
+
+    // Flip one byte of a value column; the part still opens, the granule
+    // fails its checksum when first read.
+    std::string column = path + "/part_1/granule_0_values.bin";
+    {
+        std::fstream file(column, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(20);
+        file.put('#');
+    }
+
+    {
+        MergeTree engine(path, config);
+        std::cout << "Opened after corruption: " << engine.part_count() << " part(s)" << std::endl;
+        try {
+            engine.query("key0", "key0");
+            std::cout << "Corruption not detected" << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << "Query failed as expected: " << e.what() << std::endl;
+        }
+        engine.shutdown();
+    }
+
+    std::cout << "Atomic part commit test completed successfully!" << std::endl << std::endl;
+}
+
+void test_prefix_compressed_index() {
+    std::cout << "=== Testing Prefix-Compressed Sparse Index ===" << std::endl;
+
+    std::filesystem::remove_all("./data/test_prefix_index");
+    std::filesystem::create_directories("./data/test_prefix_index");
+
+    RowVector rows;
+    for (int tenant = 0; tenant < 20; ++tenant) {
+        for (int series = 0; series < 25000; ++series) {
+            char key[96];
+            std::snprintf(key, sizeof(key), "tenant_%03d/datacenter_eu_west/service_checkout/metric_latency/%06d",
+                          tenant, series);
+            rows.emplace_back(key, "v", series);
+        }
+    }
+
+    Part part(1, "./data/test_prefix_index");
+    part.write_from_memtable_rows(rows);
+
+    const SparseIndex& index = part.index();
+    size_t full_keys = 0;
+    for (const auto& entry : index.entries()) {
+        full_keys += sizeof(IndexEntry) + entry.min_key.size() + entry.max_key.size();
+    }
+
+    std::cout << index.size() << " granules: index memory " << index.memory_usage() << " B, with full keys ~"
+              << full_keys << " B" << std::endl;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t found = 0;
+    for (int i = 0; i < 10000; ++i) {
+        found += part.query_key(rows[(i * 7919) % rows.size()].key).size();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "10000 point lookups found " << found << " rows in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+
+    std::cout << "Prefix-compressed index test completed successfully!" << std::endl << std::endl;
+}
+
+void test_part_key_index() {
+    std::cout << "=== Testing Part Key Index ===" << std::endl;
+
+    std::vector<size_t> found_by_mode;
+    for (bool enabled : {false, true}) {
+        MergeTreeConfig config;
+        config.memtable_flush_threshold = 1000000;
+        config.max_parts = 1000;
+        config.enable_background_merge = false;
+        config.enable_part_key_index = enabled;
+
+        MergeTree engine(std::string("./data/test_part_key_index_") + (enabled ? "on" : "off"), config);
+
+        // 100 parts all spanning the same key range.
+        std::mt19937 rng(42);
+        for (int part = 0; part < 100; ++part) {
+            for (int i = 0; i < 2000; ++i) {
+                engine.insert("key" + std::to_string(100000 + rng() % 900000), "value", part);
+            }
+            engine.flush_memtable();
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t found = 0;
+        for (int i = 0; i < 2000; ++i) {
+            found += engine.query_key("key" + std::to_string(100000 + rng() % 900000)).size();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::cout << (enabled ? "With" : "Without") << " key index: 2000 point lookups over "
+                  << engine.part_count() << " parts found " << found << " rows in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+
+        // The index follows parts added by flushes and replaced by mutations.
+        for (int i = 0; i < 1000; ++i) {
+            engine.insert("key" + std::to_string(100000 + rng() % 900000), "value", 100);
+        }
+        engine.flush_memtable();
+        engine.mutate_delete("key500000", "key599999", [](const Row&) { return true; });
+        engine.apply_mutations();
+        size_t found_after_mutation = 0;
+        for (int i = 0; i < 2000; ++i) {
+            found_after_mutation += engine.query_key("key" + std::to_string(100000 + rng() % 900000)).size();
+        }
+        found_after_mutation += engine.query("key200000", "key299999").size();
+        std::cout << "After a delete mutation over " << engine.part_count() << " parts found " << found_after_mutation
+                  << " rows" << std::endl;
+        found_by_mode.push_back(found);
+        found_by_mode.push_back(found_after_mutation);
+
+        engine.shutdown();
+    }
+
+    if (found_by_mode[0] != found_by_mode[2] || found_by_mode[1] != found_by_mode[3]) {
+        throw std::runtime_error("Part key index changed query results");
+    }
+
+    std::cout << "Part key index test completed successfully!" << std::endl << std::endl;
+}
+
+void test_skip_indexes() {
+    std::cout << "=== Testing Skip Indexes ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 1000000;
+    config.enable_background_merge = false;
+    config.skip_indexes = {SkipIndexDescription("latency", SkipIndexType::MinMax),
+                           SkipIndexDescription("tokens", SkipIndexType::TokenBloom)};
+
+    MergeTree engine("./data/test_skip_indexes", config);
+
+    // Latencies that grow over time, then log lines mentioning "checkout" once.
+    for (int i = 0; i < 50000; ++i) {
+        engine.insert("metric_" + std::to_string(100000 + i), std::to_string(i / 50), i);
+    }
+    for (int i = 0; i < 50000; ++i) {
+        std::string message = i == 31337 ? "user 7 started checkout" : "user " + std::to_string(i % 97) + " viewed page";
+        engine.insert("log_" + std::to_string(100000 + i), message, i);
+    }
+    engine.flush_memtable();
+
+    std::vector<std::pair<std::string, ValueCondition>> conditions = {
+        {"between(500, 510)", ValueCondition::between(500, 510)},
+        {"hasToken('checkout')", ValueCondition::has_token("checkout")},
+        {"contains('page')", ValueCondition::contains("page")}};
+
+    auto run_conditions = [&] {
+        RowVector all_rows = engine.query("", "~");
+        for (const auto& [label, condition] : conditions) {
+            QueryOptions options;
+            options.value_filter = condition;
+
+            auto before = engine.metrics();
+            auto result = engine.query("", "~", options);
+            auto after = engine.metrics();
+
+            size_t expected = std::count_if(all_rows.begin(), all_rows.end(),
+                                            [&](const Row& row) { return condition.matches(row.value); });
+            if (result.size() != expected) {
+                throw std::runtime_error("Skip index query " + label + " returned wrong rows");
+            }
+            if (label == "hasToken('checkout')" &&
+                after.skip_index_granules_skipped == before.skip_index_granules_skipped) {
+                throw std::runtime_error("Skip index query " + label + " skipped no granules");
+            }
+
+            std::cout << label << ": " << result.size() << " rows, skipped "
+                      << (after.skip_index_granules_skipped - before.skip_index_granules_skipped) << " of "
+                      << (after.skip_index_granules_checked - before.skip_index_granules_checked) << " granules"
+                      << std::endl;
+        }
+    };
+    run_conditions();
+
+    // The mutated part indexes rewritten and hard-linked granules alike.
+    engine.mutate_update("log_110000", "log_110099", [](const Row& row) { return row.value + " checkout"; });
+    engine.apply_mutations();
+    std::cout << "After updating 100 log lines:" << std::endl;
+    run_conditions();
+
+    // Bytes of UTF-8 characters belong to tokens; only ASCII separators split them.
+    engine.insert("log_200000", "user 7 paid 5\xe2\x82\xac at caf\xc3\xa9", 50000);
+    engine.flush_memtable();
+    std::vector<std::pair<std::string, size_t>> tokens = {
+        {"caf\xc3\xa9", 1}, {"caf", 0}, {"5\xe2\x82\xac", 1}, {"\xe2\x82\xac", 0}};
+    for (const auto& [token, expected] : tokens) {
+        QueryOptions options;
+        options.value_filter = ValueCondition::has_token(token);
+        if (engine.query("", "~", options).size() != expected) {
+            throw std::runtime_error("hasToken('" + token + "') returned wrong rows");
+        }
+    }
+    std::cout << "hasToken over UTF-8 values: whole words match, parts of them do not" << std::endl;
+
+    engine.shutdown();
+    std::cout << "Skip index test completed successfully!" << std::endl << std::endl;
+}
+
+void test_prewhere() {
+    std::cout << "=== Testing PREWHERE Predicates ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 20000;
+    config.enable_background_merge = false;
+
+    {
+        MergeTree engine("./data/test_prewhere", config);
+        const char* levels[] = {"INFO", "INFO", "WARN", "ERROR"};
+        for (int i = 0; i < 60000; ++i) {
+            engine.insert("req_" + std::to_string(100000 + i),
+                          std::string(levels[i % 4]) + " handler=" + std::to_string(i % 37) + " " +
+                              std::string(100, 'x'),
+                          i);
+        }
+        engine.shutdown();
+    }
+
+    // Reopened, so granules are filtered straight from their column files.
+    MergeTree engine("./data/test_prewhere", config);
+
+    // (value LIKE 'ERROR%' AND timestamp < 30000) OR key IN ('req_100001', 'req_100002')
+    Predicate predicate = Predicate::any_of(
+        {Predicate::all_of({Predicate::like(PredicateColumn::Value, "ERROR%"),
+                            Predicate::compare(CompareOp::Less, 30000)}),
+         Predicate::in(PredicateColumn::Key, {"req_100001", "req_100002"})});
+
+    QueryOptions options;
+    options.prewhere = predicate;
+    auto start = std::chrono::high_resolution_clock::now();
+    auto result = engine.query("", "~", options);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "PREWHERE returned " << result.size() << " rows in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms, granules in memory: "
+              << engine.memory_usage() / 1024 << " KB" << std::endl;
+
+    RowVector all_rows = engine.query("", "~");
+    size_t expected = std::count_if(all_rows.begin(), all_rows.end(),
+                                    [&](const Row& row) { return predicate.matches(row); });
+    if (result.size() != expected || expected != 7502) {
+        throw std::runtime_error("PREWHERE returned wrong rows");
+    }
+    std::cout << "Post-filtering all " << all_rows.size() << " rows agrees" << std::endl;
+
+    engine.shutdown();
+    std::cout << "PREWHERE test completed successfully!" << std::endl << std::endl;
+}
+
+void test_key_compare() {
+    std::cout << "=== Testing Key Comparison Kernels ===" << std::endl;
+    std::cout << "Kernels in use: " << key_compare_implementation() << std::endl;
+
+    // Keys sharing a long head, so order is decided past the first 32 bytes.
+    std::mt19937 rng(47);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 2000; ++i) {
+        keys.push_back("tenant_0042/region_eu_west/user_" + std::to_string(rng() % 100000) +
+                       (i % 3 == 0 ? "/events" : ""));
+    }
+    for (size_t i = 0; i + 1 < keys.size(); ++i) {
+        int expected = keys[i].compare(keys[i + 1]);
+        int order = compare_keys(keys[i], keys[i + 1]);
+        if ((order < 0) != (expected < 0) || (order > 0) != (expected > 0)) {
+            throw std::runtime_error("compare_keys disagrees with std::string");
+        }
+    }
+    std::cout << "compare_keys agrees with std::string on " << keys.size() - 1 << " pairs" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 5000;
+    config.enable_background_merge = false;
+    MergeTree engine("./data/test_key_compare", config);
+    for (size_t i = 0; i < 20000; ++i) {
+        engine.insert(keys[i % keys.size()] + "/" + std::to_string(i), "v", i);
+    }
+    engine.optimize();
+
+    std::string start_key = "tenant_0042/region_eu_west/user_2";
+    std::string end_key = "tenant_0042/region_eu_west/user_4~";
+    auto result = engine.query(start_key, end_key);
+    size_t expected = 0;
+    for (size_t i = 0; i < 20000; ++i) {
+        std::string key = keys[i % keys.size()] + "/" + std::to_string(i);
+        expected += key >= start_key && key <= end_key;
+    }
+    std::cout << "Range query over merged parts returned " << result.size() << " rows" << std::endl;
+    if (result.size() != expected || !std::is_sorted(result.begin(), result.end())) {
+        throw std::runtime_error("Key range query returned wrong rows");
+    }
+
+    engine.shutdown();
+    std::cout << "Key comparison test completed successfully!" << std::endl << std::endl;
+}
+
+void test_group_by() {
+    std::cout << "=== Testing GROUP BY Key Prefix ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 10000;
+    config.max_parts = 1;
+    config.enable_background_merge = false;
+    MergeTree engine("./data/test_group_by", config);
+
+    // Request latencies keyed "<region>/<host>"; the last rows stay in the memtable.
+    const char* regions[] = {"eu-west", "us-east", "ap-south"};
+    for (int i = 0; i < 45000; ++i) {
+        engine.insert(std::string(regions[i % 3]) + "/host_" + std::to_string(i % 50), std::to_string(i % 100), i);
+    }
+
+    GroupBySpec spec;
+    spec.key_delimiter = "/";
+    QueryOptions window;
+    window.ts_from = 10000;
+    window.ts_to = 39999;
+    auto groups = engine.group_by("", "~", spec, window);
+
+    std::cout << "Parts: " << engine.part_count() << ", groups:" << std::endl;
+    for (const auto& group : groups) {
+        std::cout << "  " << group.key_prefix << ": count=" << group.count << " sum=" << group.sum
+                  << " avg=" << group.avg() << " min=" << group.min << " max=" << group.max << std::endl;
+    }
+
+    std::map<std::string, std::pair<int64_t, double>> expected;
+    for (const auto& row : engine.query("", "~", window)) {
+        auto& group = expected[row.key.substr(0, row.key.find('/'))];
+        group.first += 1;
+        group.second += std::stod(row.value);
+    }
+    bool agrees = groups.size() == expected.size();
+    for (const auto& group : groups) {
+        auto it = expected.find(group.key_prefix);
+        agrees = agrees && it != expected.end() && it->second.first == group.count && it->second.second == group.sum;
+    }
+    if (!agrees || groups.size() != 3 || groups[0].count != 10000) {
+        throw std::runtime_error("GROUP BY returned wrong aggregates");
+    }
+    std::cout << "Aggregating query() rows by hand agrees" << std::endl;
+
+    // Parts are aggregated from a snapshot, so a merge replacing them
+    // meanwhile changes neither the result nor the files being read.
+    std::atomic<bool> merged{false};
+    std::atomic<size_t> calls{0};
+    std::atomic<size_t> wrong_calls{0};
+    std::thread reader([&] {
+        while (!merged) {
+            if (engine.group_by("", "~", spec, window).at(0).count != 10000) {
+                ++wrong_calls;
+            }
+            ++calls;
+        }
+    });
+    engine.optimize();
+    merged = true;
+    reader.join();
+    std::cout << calls << " calls during a merge into " << engine.part_count() << " part(s), " << wrong_calls
+              << " wrong" << std::endl;
+    if (wrong_calls != 0 || engine.part_count() != 1) {
+        throw std::runtime_error("GROUP BY during a merge returned wrong aggregates");
+    }
+
+    engine.shutdown();
+    std::cout << "GROUP BY test completed successfully!" << std::endl << std::endl;
+}
+
+void test_sample() {
+    std::cout << "=== Testing SAMPLE ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 200000;
+    config.max_parts = 1;
+    config.enable_background_merge = false;
+    MergeTree engine("./data/test_sample", config);
+
+    // 1000 readings per sensor, so most granules hold only a few sensors.
+    for (int sensor = 0; sensor < 200; ++sensor) {
+        for (int reading = 0; reading < 1000; ++reading) {
+            engine.insert("sensor_" + std::to_string(sensor), std::to_string(reading % 100), reading);
+        }
+    }
+    engine.optimize();
+
+    QueryOptions options;
+    options.sample = 0.05;
+    Predicate sample = Predicate::key_sample(0.05);
+    RowVector all_rows;
+    auto run_sample = [&] {
+        auto before = engine.metrics();
+        auto sampled = engine.query("", "~", options);
+        auto after = engine.metrics();
+
+        all_rows = engine.query("", "~");
+        size_t expected = std::count_if(all_rows.begin(), all_rows.end(),
+                                        [&](const Row& row) { return sample.matches(row); });
+        std::cout << "SAMPLE 0.05 returned " << sampled.size() << " of " << all_rows.size() << " rows, reading "
+                  << (after.skip_index_granules_checked - before.skip_index_granules_checked) -
+                         (after.skip_index_granules_skipped - before.skip_index_granules_skipped)
+                  << " of " << after.skip_index_granules_checked - before.skip_index_granules_checked << " granules"
+                  << std::endl;
+        if (sampled.size() != expected || after.skip_index_granules_skipped == before.skip_index_granules_skipped) {
+            throw std::runtime_error("SAMPLE returned wrong rows");
+        }
+    };
+    run_sample();
+
+    // The mutated part keeps per-granule sample hashes, so SAMPLE still prunes.
+    engine.mutate_delete("sensor_10", "sensor_19", [](const Row& row) { return row.value == "0"; });
+    engine.apply_mutations();
+    run_sample();
+
+    GroupBySpec spec;
+    spec.key_delimiter = "_";
+    auto estimate = engine.group_by("", "~", spec, options).at(0);
+    std::cout << "Estimated count " << estimate.count << " (exact " << all_rows.size() << "), avg " << estimate.avg()
+              << std::endl;
+
+    engine.shutdown();
+    std::cout << "SAMPLE test completed successfully!" << std::endl << std::endl;
+}
+
+void test_sketches() {
+    std::cout << "=== Testing Sketches ===" << std::endl;
+
+    MergeTreeConfig config;
+    config.memtable_flush_threshold = 20000;
+    config.enable_background_merge = false;
+    MergeTree engine("./data/test_sketches", config);
+
+    // 5000 users with 20 events each; values 0..999.
+    for (int event = 0; event < 20; ++event) {
+        for (int user = 0; user < 5000; ++user) {
+            engine.insert("user_" + std::to_string(10000 + user), std::to_string((event * 5000 + user) % 1000),
+                          event);
+        }
+    }
+    engine.flush_memtable();
+    engine.optimize();
+
+    uint64_t distinct = engine.approx_distinct_keys("", "~");
+    auto quantiles = engine.approx_value_quantiles("", "~", {0.5, 0.99});
+    std::cout << "Approx distinct users: " << distinct << " (exact 5000), p50 " << quantiles[0] << ", p99 "
+              << quantiles[1] << std::endl;
+    if (distinct < 4750 || distinct > 5250 || std::abs(quantiles[0] - 500) > 50 || std::abs(quantiles[1] - 990) > 50) {
+        throw std::runtime_error("Sketch estimates out of bounds");
+    }
+
+    uint64_t range_distinct = engine.approx_distinct_keys("user_11000", "user_11999");
+    std::cout << "Approx distinct users in [user_11000, user_11999]: " << range_distinct << " (exact 1000)"
+              << std::endl;
+    if (range_distinct < 950 || range_distinct > 1050) {
+        throw std::runtime_error("Sketch range estimate out of bounds");
+    }
+
+    // The mutated part carries sketches too, so estimates need no granule reads.
+    engine.mutate_update("user_12000", "user_12999", [](const Row& row) { return row.value; });
+    engine.apply_mutations();
+    for (const auto& entry : std::filesystem::directory_iterator("./data/test_sketches")) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("part_", 0) == 0 && !std::filesystem::exists(entry.path() / "sketches.bin")) {
+            throw std::runtime_error("Mutated part " + name + " has no sketches");
+        }
+    }
+    distinct = engine.approx_distinct_keys("", "~");
+    std::cout << "Approx distinct users after a mutation: " << distinct << " (exact 5000)" << std::endl;
+    if (distinct < 4750 || distinct > 5250) {
+        throw std::runtime_error("Sketch estimate after mutation out of bounds");
+    }
+
+    engine.shutdown();
+    std::cout << "Sketches test completed successfully!" << std::endl << std::endl;
+}
+
 void test_performance() {
     std::cout << "=== Performance Test ===" << std::endl;
 
@@ -197,6 +1388,31 @@ int main() {
         test_basic_operations();
         test_memtable_flush();
         test_merge_operations();
+        test_time_range_queries();
+        test_partitioning();
+        test_ttl();
+        test_replacing_merge_tree();
+        test_aggregating_merge_tree();
+        test_collapsing_merge_tree();
+        test_lightweight_delete();
+        test_mutations();
+        test_concurrent_mutations();
+        test_concurrent_deletes();
+        test_concurrent_reads();
+        test_concurrent_merges();
+        test_insert_backpressure();
+        test_vertical_merge();
+        test_parallel_merge();
+        test_merge_throttling();
+        test_atomic_part_commit();
+        test_prefix_compressed_index();
+        test_part_key_index();
+        test_skip_indexes();
+        test_prewhere();
+        test_key_compare();
+        test_group_by();
+        test_sample();
+        test_sketches();
         test_performance();
         test_persistence();
 
@@ -0,0 +1,101 @@
+#include "merge_tree.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+using namespace clickhouse;
+
+namespace {
+
+constexpr size_t DEFAULT_ROWS = 2000000;
+constexpr size_t TENANTS = 1000;
+constexpr uint64_t TIME_RANGE = 1000000;
+constexpr size_t QUERY_REPEATS = 3;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Request latencies keyed "tenant_<t>/user_<u>", one part per flush.
+void fill(const std::string& path, const MergeTreeConfig& config, size_t rows) {
+    std::filesystem::remove_all(path);
+    MergeTree engine(path, config);
+
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < rows; ++i) {
+        std::string key = "tenant_" + std::to_string(rng() % TENANTS) + "/user_" + std::to_string(rng() % 100000);
+        engine.insert(key, std::to_string(rng() % 5000), rng() % TIME_RANGE);
+    }
+    engine.flush_memtable();
+    engine.shutdown();
+}
+
+// Times `query` on a freshly opened table, so granules come from disk.
+template <typename Query>
+void measure(const std::string& path, const MergeTreeConfig& config, const std::string& label, Query query) {
+    double ms = 0;
+    size_t groups = 0;
+    for (size_t i = 0; i < QUERY_REPEATS; ++i) {
+        MergeTree engine(path, config);
+        auto start = std::chrono::steady_clock::now();
+        groups = query(engine);
+        ms += elapsed_ms(start) / QUERY_REPEATS;
+        engine.shutdown();
+    }
+    std::cout << std::setw(44) << label << std::setw(10) << groups << std::setw(12) << std::fixed
+              << std::setprecision(1) << ms << std::endl;
+}
+
+}  // namespace
+
+// Usage: group_by_benchmark [rows] (default 2000000).
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? std::stoull(argv[1]) : DEFAULT_ROWS;
+    std::string path = "./data/group_by_benchmark";
+
+    MergeTreeConfig config;
+    config.enable_background_merge = false;
+    config.memtable_flush_threshold = 100000;
+    fill(path, config, rows);
+
+    GroupBySpec spec;
+    spec.key_delimiter = "/";
+    QueryOptions window;
+    window.ts_from = 0;
+    window.ts_to = TIME_RANGE / 2;
+
+    std::cout << "count/sum per tenant over half the time range, " << rows << " rows" << std::endl;
+    std::cout << std::setw(44) << "method" << std::setw(10) << "groups" << std::setw(12) << "ms" << std::endl;
+
+    measure(path, config, "query() + std::unordered_map", [&](MergeTree& engine) {
+        std::unordered_map<std::string, std::pair<int64_t, double>> groups;
+        for (const auto& row : engine.query("", "~", window)) {
+            auto& group = groups[std::string(spec.group_of(row.key))];
+            group.first += row.sign;
+            group.second += row.sign * std::stod(row.value);
+        }
+        return groups.size();
+    });
+
+    for (size_t threads : {size_t(1), size_t(0)}) {
+        GroupBySpec threaded = spec;
+        threaded.threads = threads;
+        std::string label = threads == 0 ? "group_by, one thread per core" : "group_by, 1 thread";
+        measure(path, config, label, [&](MergeTree& engine) {
+            return engine.group_by("", "~", threaded, window).size();
+        });
+    }
+
+    GroupBySpec presized = spec;
+    presized.expected_groups = TENANTS;
+    measure(path, config, "group_by, pre-sized for 1000 groups", [&](MergeTree& engine) {
+        return engine.group_by("", "~", presized, window).size();
+    });
+
+    std::filesystem::remove_all(path);
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "sparse_index.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace clickhouse;
+
+namespace {
+
+// Sorted keys sharing long tenant/region prefixes, two per granule.
+std::vector<std::string> make_keys(size_t count) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        char key[64];
+        std::snprintf(key, sizeof(key), "tenant_%03zu/region_%02zu/metric_%08zu", i / 100000, (i / 1000) % 100, i);
+        keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+// Granule lookup over full-key structs, as the index did before front coding.
+size_t struct_search(const std::vector<IndexEntry>& entries, const std::string& key) {
+    auto it = std::partition_point(entries.begin(), entries.end(),
+                                   [&](const IndexEntry& entry) { return entry.max_key < key; });
+    size_t found = 0;
+    for (; it != entries.end() && !(it->min_key > key); ++it) {
+        ++found;
+    }
+    return found;
+}
+
+template <typename Lookup>
+double measure_ns(const std::vector<std::string>& queries, Lookup&& lookup, size_t& found) {
+    found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& query : queries) {
+        found += lookup(query);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / queries.size();
+}
+
+}  // namespace
+
+// Usage: index_search_benchmark [granule counts...] (default 1000 10000 100000 1000000).
+int main(int argc, char** argv) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; ++i) {
+        counts.push_back(std::stoull(argv[i]));
+    }
+    if (counts.empty()) {
+        counts = {1000, 10000, 100000, 1000000};
+    }
+
+    const size_t query_count = 1000000;
+
+    // "search" is locating the restart block (binary search over restart
+    // keys vs the Eytzinger tree); "lookup" is the whole find_granules call.
+    std::cout << std::setw(10) << "granules" << std::setw(14) << "struct ns" << std::setw(14) << "binary ns"
+              << std::setw(14) << "eytzinger ns" << std::setw(14) << "lookup ns" << std::setw(14) << "struct bytes"
+              << std::setw(14) << "coded bytes" << std::endl;
+
+    for (size_t granules : counts) {
+        auto keys = make_keys(granules * 2);
+
+        std::vector<IndexEntry> entries;
+        SparseIndex index;
+        size_t struct_bytes = 0;
+        for (size_t i = 0; i < granules; ++i) {
+            entries.emplace_back(keys[2 * i], keys[2 * i + 1], i, 8192);
+            index.add_entry(entries.back());
+            struct_bytes += sizeof(IndexEntry) + keys[2 * i].capacity() + keys[2 * i + 1].capacity();
+        }
+
+        std::mt19937 rng(42);
+        std::vector<std::string> queries;
+        queries.reserve(query_count);
+        for (size_t i = 0; i < query_count; ++i) {
+            queries.push_back(keys[rng() % keys.size()]);
+        }
+
+        size_t found_struct = 0;
+        size_t found_coded = 0;
+        size_t binary_start = 0;
+        size_t tree_start = 0;
+
+        double struct_ns = measure_ns(queries, [&](const std::string& key) { return struct_search(entries, key); },
+                                      found_struct);
+        double binary_ns = measure_ns(queries, [&](const std::string& key) { return index.lookup_start(key); },
+                                      binary_start);
+        index.build_search_tree();
+        double tree_ns = measure_ns(queries, [&](const std::string& key) { return index.lookup_start(key); },
+                                    tree_start);
+        double lookup_ns = measure_ns(queries,
+                                      [&](const std::string& key) { return index.find_granules(key, key).size(); },
+                                      found_coded);
+
+        if (found_struct != found_coded || binary_start != tree_start) {
+            std::cerr << "Lookup results differ" << std::endl;
+            return 1;
+        }
+
+        std::cout << std::setw(10) << granules << std::fixed << std::setprecision(1) << std::setw(14) << struct_ns
+                  << std::setw(14) << binary_ns << std::setw(14) << tree_ns << std::setw(14) << lookup_ns
+                  << std::setw(14) << struct_bytes << std::setw(14) << index.memory_usage() << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include "merge_tree.h"
+#include "key_compare.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace clickhouse;
+
+namespace {
+
+constexpr size_t MERGE_SOURCES = 8;
+constexpr size_t ROWS_PER_SOURCE = 250000;
+constexpr size_t SCAN_GRANULES = 64;
+constexpr size_t SCAN_LOOKUPS = 200000;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Short keys ("k12345678") or long ones sharing a tenant prefix, as
+// composite keys tend to.
+std::string make_key(std::mt19937_64& rng, bool long_keys) {
+    std::string id = std::to_string(10000000 + rng() % 90000000);
+    if (!long_keys) {
+        return "k" + id;
+    }
+    return "tenant_0042/region_eu_west/user_" + id + "/events";
+}
+
+RowVector make_rows(std::mt19937_64& rng, size_t count, bool long_keys) {
+    RowVector rows;
+    rows.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        rows.emplace_back(make_key(rng, long_keys), "value", rng() % 1000);
+    }
+    return rows;
+}
+
+void print(const std::string& label, size_t items, double ms) {
+    std::cout << std::setw(44) << label << std::setw(12) << std::fixed << std::setprecision(1) << ms
+              << std::setw(14) << std::setprecision(2) << items / ms / 1000.0 << std::endl;
+}
+
+void bench_sort(bool long_keys) {
+    std::mt19937_64 rng(1);
+    RowVector rows = make_rows(rng, MERGE_SOURCES * ROWS_PER_SOURCE, long_keys);
+    auto start = std::chrono::steady_clock::now();
+    std::sort(rows.begin(), rows.end());
+    print(std::string("sort rows, ") + (long_keys ? "long" : "short") + " keys", rows.size(), elapsed_ms(start));
+}
+
+void bench_merge(bool long_keys) {
+    std::mt19937_64 rng(2);
+    std::vector<RowVector> sources;
+    for (size_t i = 0; i < MERGE_SOURCES; ++i) {
+        sources.push_back(make_rows(rng, ROWS_PER_SOURCE, long_keys));
+        std::sort(sources.back().begin(), sources.back().end());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MergeIterator iterator(std::move(sources));
+    size_t merged = 0;
+    while (iterator.has_next()) {
+        merged += iterator.next().timestamp > 0;
+    }
+    print(std::string("k-way merge, ") + (long_keys ? "long" : "short") + " keys",
+          MERGE_SOURCES * ROWS_PER_SOURCE, elapsed_ms(start));
+}
+
+void bench_scan(bool long_keys) {
+    std::mt19937_64 rng(3);
+    std::vector<Granule> granules(SCAN_GRANULES);
+    for (auto& granule : granules) {
+        for (const auto& row : make_rows(rng, GRANULE_SIZE, long_keys)) {
+            granule.add_row(row);
+        }
+        granule.sort();
+    }
+
+    std::vector<std::string> bounds;
+    for (size_t i = 0; i < 1024; ++i) {
+        bounds.push_back(make_key(rng, long_keys));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (size_t i = 0; i < SCAN_LOOKUPS; ++i) {
+        const std::string& from = bounds[i % bounds.size()];
+        auto [first, last] = granules[i % SCAN_GRANULES].find_key_range(from, from + "~");
+        found += last - first;
+    }
+    print(std::string("granule key range lookups, ") + (long_keys ? "long" : "short") + " keys", SCAN_LOOKUPS,
+          elapsed_ms(start));
+
+    // A range predicate on the key column of in-memory granules.
+    Predicate predicate = Predicate::compare(PredicateColumn::Key, CompareOp::Less, bounds[0]);
+    MergeTreeConfig config;
+    config.enable_background_merge = false;
+    config.memtable_flush_threshold = SCAN_GRANULES * GRANULE_SIZE;
+    MergeTree engine("./data/key_compare_benchmark", config);
+    for (const auto& granule : granules) {
+        for (const auto& row : granule.rows()) {
+            engine.insert(row);
+        }
+    }
+    engine.flush_memtable();
+
+    QueryOptions options;
+    options.prewhere = predicate;
+    start = std::chrono::steady_clock::now();
+    size_t selected = 0;
+    for (int i = 0; i < 5; ++i) {
+        selected += engine.query("", "\xff", options).size();
+    }
+    print(std::string("key predicate scan, ") + (long_keys ? "long" : "short") + " keys",
+          5 * SCAN_GRANULES * GRANULE_SIZE, elapsed_ms(start));
+    engine.shutdown();
+    std::filesystem::remove_all("./data/key_compare_benchmark");
+}
+
+void bench_kernels() {
+    std::mt19937_64 rng(4);
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 4096; ++i) {
+        keys.push_back(make_key(rng, true));
+    }
+
+    size_t compares = 20000000;
+    auto start = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for (size_t i = 0; i < compares; ++i) {
+        sum += keys[i % 4096].compare(keys[(i * 7 + 1) % 4096]) < 0;
+    }
+    print("std::string::compare, long keys", compares, elapsed_ms(start));
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < compares; ++i) {
+        sum += compare_keys(keys[i % 4096], keys[(i * 7 + 1) % 4096]) < 0;
+    }
+    print(std::string("compare_keys (") + key_compare_implementation() + "), long keys", compares,
+          elapsed_ms(start));
+
+    std::vector<uint64_t> prefixes(GRANULE_SIZE);
+    for (auto& prefix : prefixes) {
+        prefix = rng();
+    }
+    std::vector<int8_t> result(GRANULE_SIZE);
+    size_t rounds = 20000;
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        uint64_t bound = prefixes[r % GRANULE_SIZE];
+        for (size_t i = 0; i < GRANULE_SIZE; ++i) {
+            result[i] = static_cast<int8_t>((prefixes[i] > bound) - (prefixes[i] < bound));
+        }
+        sum += result[r % GRANULE_SIZE];
+    }
+    print("prefix range check, plain loop", rounds * GRANULE_SIZE, elapsed_ms(start));
+
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        compare_prefixes(prefixes.data(), prefixes.size(), prefixes[r % GRANULE_SIZE], result.data());
+        sum += result[r % GRANULE_SIZE];
+    }
+    print(std::string("compare_prefixes (") + key_compare_implementation() + ")", rounds * GRANULE_SIZE,
+          elapsed_ms(start));
+
+    if (sum == 42) {
+        std::cout << std::endl;
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::cout << std::setw(44) << "benchmark" << std::setw(12) << "ms" << std::setw(14) << "M items/s"
+              << std::endl;
+    for (bool long_keys : {false, true}) {
+        bench_sort(long_keys);
+        bench_merge(long_keys);
+        bench_scan(long_keys);
+    }
+    bench_kernels();
+    return 0;
+}
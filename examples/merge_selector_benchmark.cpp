@@ -0,0 +1,115 @@
+#include "merge_selector.h"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <string>
+
+using namespace clickhouse;
+
+namespace {
+
+struct SimulatedPart {
+    size_t size;
+    uint64_t created_at;
+};
+
+struct SimulationResult {
+    double write_amplification;
+    double average_parts;
+    size_t max_parts;
+    size_t final_parts;
+    size_t merges;
+};
+
+// Inserts one part per simulated second and lets the selector run a few
+// merges after each insert, as the background worker would. Merges finish
+// instantly, so the part counts are a lower bound.
+SimulationResult simulate(const MergeSelectorSettings& settings, size_t inserts, size_t insert_size,
+                          size_t merges_per_tick) {
+    SimpleMergeSelector selector(settings);
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> jitter(0.5, 1.5);
+
+    std::vector<SimulatedPart> parts;
+    double inserted_bytes = 0;
+    double written_bytes = 0;
+    double part_count_sum = 0;
+    SimulationResult result{};
+
+    for (uint64_t now = 0; now < inserts; ++now) {
+        size_t size = static_cast<size_t>(insert_size * jitter(rng));
+        parts.push_back({size, now});
+        inserted_bytes += size;
+        written_bytes += size;
+
+        for (size_t m = 0; m < merges_per_tick; ++m) {
+            SimpleMergeSelector::PartsRange range;
+            for (size_t i = 0; i < parts.size(); ++i) {
+                range.push_back({parts[i].size, now - parts[i].created_at, i});
+            }
+
+            auto selected = selector.select({range});
+            if (selected.empty()) {
+                break;
+            }
+
+            size_t merged_size = 0;
+            for (const auto& part : selected) {
+                merged_size += part.size;
+            }
+
+            size_t first = selected.front().index;
+            parts.erase(parts.begin() + first, parts.begin() + first + selected.size());
+            parts.insert(parts.begin() + first, {merged_size, now});
+            written_bytes += merged_size;
+            ++result.merges;
+        }
+
+        part_count_sum += parts.size();
+        result.max_parts = std::max(result.max_parts, parts.size());
+    }
+
+    result.write_amplification = written_bytes / inserted_bytes;
+    result.average_parts = part_count_sum / inserts;
+    result.final_parts = parts.size();
+    return result;
+}
+
+void report(const std::string& label, const SimulationResult& result) {
+    std::cout << std::left << std::setw(28) << label << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << result.write_amplification
+              << std::setw(10) << result.average_parts
+              << std::setw(10) << result.max_parts
+              << std::setw(10) << result.final_parts
+              << std::setw(10) << result.merges << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    const size_t inserts = 20000;
+    const size_t insert_size = 1024 * 1024;
+    const size_t merges_per_tick = 2;
+
+    std::cout << "Simulating " << inserts << " inserts of ~" << insert_size / 1024 << " KB" << std::endl;
+    std::cout << std::left << std::setw(28) << "settings" << std::right
+              << std::setw(10) << "write amp" << std::setw(10) << "avg parts" << std::setw(10) << "max parts"
+              << std::setw(10) << "final" << std::setw(10) << "merges" << std::endl;
+
+    for (double base : {2.0, 3.0, 5.0, 8.0}) {
+        MergeSelectorSettings settings;
+        settings.base = base;
+        report("base=" + std::to_string(static_cast<int>(base)), simulate(settings, inserts, insert_size, merges_per_tick));
+    }
+
+    MergeSelectorSettings capped;
+    capped.max_bytes_to_merge = 1024ull * 1024 * 1024;
+    report("base=5 max_bytes=1GB", simulate(capped, inserts, insert_size, merges_per_tick));
+
+    MergeSelectorSettings no_fixed_cost;
+    no_fixed_cost.size_fixed_cost_to_add = 0;
+    report("base=5 fixed_cost=0", simulate(no_fixed_cost, inserts, insert_size, merges_per_tick));
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "merge_tree.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+
+using namespace clickhouse;
+
+namespace {
+
+constexpr size_t DEFAULT_ROWS = 1000000;
+constexpr size_t PAYLOAD_SIZE = 200;
+constexpr size_t QUERY_REPEATS = 3;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Events with random keys, a status word and a large payload.
+void fill(const std::string& path, const MergeTreeConfig& config, size_t rows) {
+    std::filesystem::remove_all(path);
+    MergeTree engine(path, config);
+
+    std::mt19937_64 rng(42);
+    const char* statuses[] = {"ok", "ok", "ok", "retry", "failed"};
+    for (size_t i = 0; i < rows; ++i) {
+        std::string value = std::string(statuses[rng() % 5]) + " " + std::string(PAYLOAD_SIZE, 'a' + rng() % 26);
+        engine.insert("user" + std::to_string(rng() % 100000), value, rng() % 1000000);
+    }
+    engine.flush_memtable();
+    engine.shutdown();
+}
+
+// Times `query` on a freshly opened table, so granules come from disk.
+template <typename Query>
+void measure(const std::string& path, const MergeTreeConfig& config, const std::string& label, Query query) {
+    double ms = 0;
+    size_t rows = 0;
+    for (size_t i = 0; i < QUERY_REPEATS; ++i) {
+        MergeTree engine(path, config);
+        auto start = std::chrono::steady_clock::now();
+        rows = query(engine);
+        ms += elapsed_ms(start) / QUERY_REPEATS;
+        engine.shutdown();
+    }
+    std::cout << std::setw(44) << label << std::setw(10) << rows << std::setw(12) << std::fixed
+              << std::setprecision(1) << ms << std::endl;
+}
+
+}  // namespace
+
+// Usage: prewhere_benchmark [rows] (default 1000000).
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? std::stoull(argv[1]) : DEFAULT_ROWS;
+    std::string path = "./data/prewhere_benchmark";
+
+    MergeTreeConfig config;
+    config.enable_background_merge = false;
+    config.memtable_flush_threshold = 100000;
+    fill(path, config, rows);
+
+    std::vector<std::pair<std::string, Predicate>> predicates = {
+        {"timestamp in [0, 1000)", Predicate::compare(CompareOp::Less, 1000)},
+        {"value LIKE 'failed%' AND ts < 100000",
+         Predicate::all_of({Predicate::like(PredicateColumn::Value, "failed%"),
+                            Predicate::compare(CompareOp::Less, 100000)})},
+        {"value LIKE 'failed%'", Predicate::like(PredicateColumn::Value, "failed%")}};
+
+    std::cout << std::setw(44) << "filter" << std::setw(10) << "rows" << std::setw(12) << "ms" << std::endl;
+    for (const auto& [label, predicate] : predicates) {
+        measure(path, config, "post-filter: " + label, [&](MergeTree& engine) {
+            size_t matches = 0;
+            for (const auto& row : engine.query("", "~")) {
+                matches += predicate.matches(row) ? 1 : 0;
+            }
+            return matches;
+        });
+
+        measure(path, config, "prewhere:    " + label, [&](MergeTree& engine) {
+            QueryOptions options;
+            options.prewhere = predicate;
+            return engine.query("", "~", options).size();
+        });
+    }
+
+    std::filesystem::remove_all(path);
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "merge_tree.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+
+using namespace clickhouse;
+
+namespace {
+
+constexpr size_t DEFAULT_SENSORS = 5000;
+constexpr size_t READINGS_PER_SENSOR = 400;
+constexpr size_t QUERY_REPEATS = 3;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Readings keyed by sensor, so a granule holds about 20 sensors.
+void fill(const std::string& path, const MergeTreeConfig& config, size_t sensors) {
+    std::filesystem::remove_all(path);
+    MergeTree engine(path, config);
+
+    std::mt19937_64 rng(42);
+    for (size_t reading = 0; reading < READINGS_PER_SENSOR; ++reading) {
+        for (size_t sensor = 0; sensor < sensors; ++sensor) {
+            engine.insert("sensor_" + std::to_string(sensor), std::to_string(rng() % 1000),
+                          reading * sensors + sensor);
+        }
+    }
+    engine.flush_memtable();
+    engine.optimize();
+    engine.shutdown();
+}
+
+}  // namespace
+
+// Usage: sample_benchmark [sensors] (default 5000, 400 readings each).
+int main(int argc, char** argv) {
+    size_t sensors = argc > 1 ? std::stoull(argv[1]) : DEFAULT_SENSORS;
+    std::string path = "./data/sample_benchmark";
+
+    MergeTreeConfig config;
+    config.enable_background_merge = false;
+    config.memtable_flush_threshold = 200000;
+    config.max_parts = 1;
+    fill(path, config, sensors);
+
+    GroupBySpec spec;
+    spec.key_delimiter = "_";
+
+    std::cout << "count/avg over " << sensors * READINGS_PER_SENSOR << " readings" << std::endl;
+    std::cout << std::setw(10) << "sample" << std::setw(12) << "count" << std::setw(10) << "avg" << std::setw(16)
+              << "granules read" << std::setw(12) << "ms" << std::endl;
+    for (double sample : {1.0, 0.1, 0.01}) {
+        double ms = 0;
+        AggregateGroup result;
+        uint64_t skipped = 0;
+        uint64_t checked = 0;
+        for (size_t i = 0; i < QUERY_REPEATS; ++i) {
+            // Reopened, so granules come from disk.
+            MergeTree engine(path, config);
+            QueryOptions options;
+            options.sample = sample;
+            auto start = std::chrono::steady_clock::now();
+            result = engine.group_by("", "~", spec, options).at(0);
+            ms += elapsed_ms(start) / QUERY_REPEATS;
+            skipped = engine.metrics().skip_index_granules_skipped;
+            checked = engine.metrics().skip_index_granules_checked;
+            engine.shutdown();
+        }
+        std::string granules = sample < 1 ? std::to_string(checked - skipped) + "/" + std::to_string(checked) : "all";
+        std::cout << std::setw(10) << sample << std::setw(12) << result.count << std::setw(10) << std::fixed
+                  << std::setprecision(1) << result.avg() << std::setw(16) << granules << std::setw(12) << ms
+                  << std::defaultfloat << std::endl;
+    }
+
+    std::filesystem::remove_all(path);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "merge_tree.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+
+using namespace clickhouse;
+
+namespace {
+
+constexpr size_t DEFAULT_USERS = 200000;
+constexpr size_t EVENTS_PER_USER = 10;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string user_key(size_t user) {
+    std::string number = std::to_string(user);
+    return "user_" + std::string(8 - number.size(), '0') + number;
+}
+
+// Events keyed by user, with latencies drawn from a log-normal distribution.
+void fill(const std::string& path, const MergeTreeConfig& config, size_t users) {
+    std::filesystem::remove_all(path);
+    MergeTree engine(path, config);
+
+    std::mt19937_64 rng(42);
+    std::lognormal_distribution<double> latency(3.0, 1.0);
+    for (size_t event = 0; event < EVENTS_PER_USER; ++event) {
+        for (size_t user = 0; user < users; ++user) {
+            engine.insert(user_key(user), std::to_string(static_cast<int>(latency(rng))), event * users + user);
+        }
+    }
+    engine.flush_memtable();
+    engine.optimize();
+    engine.shutdown();
+}
+
+struct Estimate {
+    uint64_t distinct = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double ms = 0;
+};
+
+Estimate exact(MergeTree& engine, const std::string& start_key, const std::string& end_key) {
+    auto start = std::chrono::steady_clock::now();
+    auto rows = engine.query(start_key, end_key);
+    std::unordered_set<std::string> keys;
+    std::vector<double> values;
+    for (const auto& row : rows) {
+        keys.insert(row.key);
+        values.push_back(std::stod(row.value));
+    }
+    std::sort(values.begin(), values.end());
+    Estimate result;
+    result.distinct = keys.size();
+    if (!values.empty()) {
+        result.p50 = values[static_cast<size_t>(std::ceil(0.5 * values.size())) - 1];
+        result.p99 = values[static_cast<size_t>(std::ceil(0.99 * values.size())) - 1];
+    }
+    result.ms = elapsed_ms(start);
+    return result;
+}
+
+Estimate approximate(MergeTree& engine, const std::string& start_key, const std::string& end_key) {
+    auto start = std::chrono::steady_clock::now();
+    auto sketches = engine.sketches(start_key, end_key);
+    Estimate result;
+    result.distinct = sketches.keys.estimate();
+    result.p50 = sketches.values.quantile(0.5);
+    result.p99 = sketches.values.quantile(0.99);
+    result.ms = elapsed_ms(start);
+    return result;
+}
+
+void print(const std::string& method, const Estimate& estimate) {
+    std::cout << std::setw(10) << method << std::setw(12) << estimate.distinct << std::setw(8) << estimate.p50
+              << std::setw(8) << estimate.p99 << std::setw(12) << std::fixed << std::setprecision(2)
+              << estimate.ms << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+}  // namespace
+
+// Usage: sketch_benchmark [users] (default 200000, 10 events each).
+int main(int argc, char** argv) {
+    size_t users = argc > 1 ? std::stoull(argv[1]) : DEFAULT_USERS;
+    std::string path = "./data/sketch_benchmark";
+
+    MergeTreeConfig config;
+    config.enable_background_merge = false;
+    config.memtable_flush_threshold = 200000;
+    fill(path, config, users);
+
+    {
+        MergeTree engine(path, config);
+        std::cout << users * EVENTS_PER_USER << " events in " << engine.part_count() << " parts" << std::endl;
+        engine.shutdown();
+    }
+
+    std::vector<std::pair<std::string, std::string>> ranges = {
+        {"", "~"},
+        {user_key(users / 4), user_key(users / 2)},
+    };
+    for (const auto& [start_key, end_key] : ranges) {
+        std::cout << "distinct users, p50 and p99 latency over [" << start_key << ", " << end_key << "]"
+                  << std::endl;
+        std::cout << std::setw(10) << "method" << std::setw(12) << "distinct" << std::setw(8) << "p50"
+                  << std::setw(8) << "p99" << std::setw(12) << "ms" << std::endl;
+        // Reopened, so granules and sketches come from disk.
+        {
+            MergeTree engine(path, config);
+            print("exact", exact(engine, start_key, end_key));
+            engine.shutdown();
+        }
+        {
+            MergeTree engine(path, config);
+            print("sketch", approximate(engine, start_key, end_key));
+            engine.shutdown();
+        }
+    }
+
+    std::filesystem::remove_all(path);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "merge_tree.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace clickhouse;
+
+namespace {
+
+constexpr size_t DEFAULT_ROWS = 1000000;
+constexpr size_t QUERY_REPEATS = 5;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string hex_id(uint64_t value) {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+// Log lines keyed by sequence number (time order). Every row has its own
+// trace id; a short burst in the middle reports a full disk. Returns the
+// trace id of a row three quarters in.
+std::string fill(MergeTree& engine, size_t rows) {
+    std::mt19937_64 rng(42);
+    const char* services[] = {"api", "auth", "billing", "search", "storage"};
+    const char* messages[] = {"request served", "cache hit", "cache miss", "token refreshed",
+                              "slow query logged"};
+    std::string sample_trace;
+
+    for (size_t i = 0; i < rows; ++i) {
+        char key[24];
+        std::snprintf(key, sizeof(key), "log%012zu", i);
+
+        bool burst = i >= rows / 2 && i < rows / 2 + 200;
+        std::string service = services[rng() % 5];
+        std::string trace = hex_id(rng());
+        if (i == rows * 3 / 4) {
+            sample_trace = trace;
+        }
+        std::string line = std::string(burst ? "level=ERROR" : "level=INFO") + " service=" + service +
+                           " trace=" + trace + " msg=" + (burst ? "write failed: disk full" : messages[rng() % 5]);
+        engine.insert(key, line, i);
+    }
+    engine.flush_memtable();
+    engine.optimize();
+    return sample_trace;
+}
+
+// Runs each query on a freshly opened table so granules are read from
+// disk rather than served from a previous run's cache.
+void measure(const std::string& path, const MergeTreeConfig& config, const std::string& label,
+             const ValueCondition& condition) {
+    QueryOptions options;
+    options.value_filter = condition;
+
+    size_t matches = 0;
+    uint64_t checked = 0;
+    uint64_t skipped = 0;
+    double ms = 0;
+    for (size_t i = 0; i < QUERY_REPEATS; ++i) {
+        MergeTree engine(path, config);
+        auto start = std::chrono::steady_clock::now();
+        matches = engine.query("", "\xff", options).size();
+        ms += elapsed_ms(start) / QUERY_REPEATS;
+        checked = engine.metrics().skip_index_granules_checked;
+        skipped = engine.metrics().skip_index_granules_skipped;
+        engine.shutdown();
+    }
+
+    std::cout << std::setw(30) << label << std::setw(10) << matches << std::setw(10) << checked
+              << std::setw(10) << skipped << std::setw(12) << std::fixed << std::setprecision(1) << ms
+              << std::endl;
+}
+
+void run(const std::string& path, size_t rows, bool indexed) {
+    std::filesystem::remove_all(path);
+
+    MergeTreeConfig config;
+    config.enable_background_merge = false;
+    config.memtable_flush_threshold = 100000;
+    if (indexed) {
+        config.skip_indexes = {SkipIndexDescription("tokens", SkipIndexType::TokenBloom),
+                               SkipIndexDescription("ngrams", SkipIndexType::NgramBloom, 4)};
+    }
+
+    std::string trace;
+    {
+        MergeTree engine(path, config);
+        auto start = std::chrono::steady_clock::now();
+        trace = fill(engine, rows);
+        std::cout << (indexed ? "With" : "Without") << " skip indexes: loaded " << rows << " rows into "
+                  << engine.part_count() << " parts in " << std::fixed << std::setprecision(0)
+                  << elapsed_ms(start) << " ms" << std::endl;
+        engine.shutdown();
+    }
+
+    std::cout << std::setw(30) << "condition" << std::setw(10) << "rows" << std::setw(10) << "checked"
+              << std::setw(10) << "skipped" << std::setw(12) << "ms/query" << std::endl;
+    measure(path, config, "hasToken(trace id)", ValueCondition::has_token(trace));
+    measure(path, config, "contains('disk full')", ValueCondition::contains("disk full"));
+    measure(path, config, "hasToken('ERROR')", ValueCondition::has_token("ERROR"));
+    measure(path, config, "contains('cache')", ValueCondition::contains("cache"));
+    std::cout << std::endl;
+
+    std::filesystem::remove_all(path);
+}
+
+}  // namespace
+
+// Usage: skip_index_benchmark [rows] (default 1000000).
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? std::stoull(argv[1]) : DEFAULT_ROWS;
+
+    run("./data/skip_index_benchmark_plain", rows, false);
+    run("./data/skip_index_benchmark_indexed", rows, true);
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "merge_tree.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace clickhouse;
+
+namespace {
+
+constexpr size_t ROWS_PER_PART = 16;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Writes `count` small parts directly (no engine, no merges), each covering
+// its own key range like a table fed by many small inserts.
+void create_parts(const std::string& path, size_t count) {
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+
+    for (size_t id = 1; id <= count; ++id) {
+        RowVector rows;
+        for (size_t i = 0; i < ROWS_PER_PART; ++i) {
+            rows.emplace_back("key" + std::to_string(id * ROWS_PER_PART + i), "value", id);
+        }
+        Part part(id, path);
+        part.write_from_memtable_rows(rows);
+    }
+}
+
+void measure(const std::string& path, size_t parts, size_t threads) {
+    MergeTreeConfig config;
+    config.enable_background_merge = false;
+    config.max_parts = parts + 1;
+    config.parts_to_delay_insert = 0;
+    config.parts_to_throw_insert = 0;
+    config.startup_threads = threads;
+
+    auto start = std::chrono::steady_clock::now();
+    MergeTree engine(path, config);
+    double open_ms = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t rows = engine.total_rows();
+    auto result = engine.query("key" + std::to_string(parts * ROWS_PER_PART / 2),
+                               "key" + std::to_string(parts * ROWS_PER_PART / 2 + 100));
+    double query_ms = elapsed_ms(start);
+
+    std::cout << std::setw(10) << parts << std::setw(10) << (threads == 0 ? "auto" : std::to_string(threads))
+              << std::setw(14) << std::fixed << std::setprecision(1) << open_ms << std::setw(16) << query_ms
+              << std::setw(12) << engine.part_count() << std::setw(12) << rows << std::endl;
+
+    engine.shutdown();
+}
+
+}  // namespace
+
+// Usage: startup_benchmark [part counts...] (default 1000 10000 100000).
+int main(int argc, char** argv) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; ++i) {
+        counts.push_back(std::stoull(argv[i]));
+    }
+    if (counts.empty()) {
+        counts = {1000, 10000, 100000};
+    }
+
+    std::cout << std::setw(10) << "parts" << std::setw(10) << "threads" << std::setw(14) << "open ms"
+              << std::setw(16) << "first query ms" << std::setw(12) << "loaded" << std::setw(12) << "rows"
+              << std::endl;
+
+    for (size_t count : counts) {
+        std::string path = "./data/startup_benchmark_" + std::to_string(count);
+
+        auto start = std::chrono::steady_clock::now();
+        create_parts(path, count);
+        std::cout << "Created " << count << " parts in " << std::fixed << std::setprecision(0)
+                  << elapsed_ms(start) << " ms" << std::endl;
+
+        measure(path, count, 1);
+        measure(path, count, 0);
+
+        std::filesystem::remove_all(path);
+    }
+
+    return 0;
+}
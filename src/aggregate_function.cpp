@@ -0,0 +1,141 @@
+#include "aggregate_function.h"
+#include "hyperloglog.h"
+#include "number.h"
+#include <cstdio>
+#include <stdexcept>
+
+namespace clickhouse {
+
+namespace {
+
+// Integers stay exact; anything else (or an overflowing sum) falls back to double.
+struct Number {
+    bool is_integer;
+    long long integer;
+    double real;
+
+    double as_double() const { return is_integer ? static_cast<double>(integer) : real; }
+};
+
+Number to_number(const std::string& value) {
+    if (value.empty()) {
+        throw std::invalid_argument("Empty value is not a number");
+    }
+
+    Number number{true, 0, 0.0};
+    if (parse_integer(value, number.integer)) {
+        return number;
+    }
+    number.is_integer = false;
+    if (parse_number(value, number.real)) {
+        return number;
+    }
+
+    throw std::invalid_argument("Value is not a number: " + value);
+}
+
+std::string format_number(const Number& number) {
+    if (number.is_integer) {
+        return std::to_string(number.integer);
+    }
+
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", number.real);
+    return buffer;
+}
+
+bool less_than(const Number& lhs, const Number& rhs) {
+    if (lhs.is_integer && rhs.is_integer) {
+        return lhs.integer < rhs.integer;
+    }
+    return lhs.as_double() < rhs.as_double();
+}
+
+class NumericFunction : public AggregateFunction {
+public:
+    std::string make_state(const std::string& value) const override {
+        return format_number(to_number(value));
+    }
+};
+
+class SumFunction : public NumericFunction {
+public:
+    std::string name() const override { return "sum"; }
+
+    std::string merge(const std::string& lhs, const std::string& rhs) const override {
+        Number a = to_number(lhs);
+        Number b = to_number(rhs);
+
+        Number result{false, 0, 0.0};
+        if (a.is_integer && b.is_integer && !__builtin_add_overflow(a.integer, b.integer, &result.integer)) {
+            result.is_integer = true;
+        } else {
+            result.real = a.as_double() + b.as_double();
+        }
+        return format_number(result);
+    }
+};
+
+class MinFunction : public NumericFunction {
+public:
+    std::string name() const override { return "min"; }
+
+    std::string merge(const std::string& lhs, const std::string& rhs) const override {
+        return less_than(to_number(rhs), to_number(lhs)) ? rhs : lhs;
+    }
+};
+
+class MaxFunction : public NumericFunction {
+public:
+    std::string name() const override { return "max"; }
+
+    std::string merge(const std::string& lhs, const std::string& rhs) const override {
+        return less_than(to_number(lhs), to_number(rhs)) ? rhs : lhs;
+    }
+};
+
+class CountFunction : public AggregateFunction {
+public:
+    std::string name() const override { return "count"; }
+
+    std::string make_state(const std::string&) const override { return "1"; }
+
+    std::string merge(const std::string& lhs, const std::string& rhs) const override {
+        return std::to_string(std::stoull(lhs) + std::stoull(rhs));
+    }
+};
+
+class UniqFunction : public AggregateFunction {
+public:
+    std::string name() const override { return "uniq"; }
+
+    std::string make_state(const std::string& value) const override {
+        HyperLogLog hll;
+        hll.add(value);
+        return hll.serialize();
+    }
+
+    std::string merge(const std::string& lhs, const std::string& rhs) const override {
+        HyperLogLog hll = HyperLogLog::deserialize(lhs);
+        hll.merge(HyperLogLog::deserialize(rhs));
+        return hll.serialize();
+    }
+
+    std::string finalize(const std::string& state) const override {
+        return std::to_string(HyperLogLog::deserialize(state).estimate());
+    }
+};
+
+}  // namespace
+
+std::shared_ptr<const AggregateFunction> create_aggregate_function(const std::string& name) {
+    if (name == "sum") return std::make_shared<SumFunction>();
+    if (name == "min") return std::make_shared<MinFunction>();
+    if (name == "max") return std::make_shared<MaxFunction>();
+    if (name == "count") return std::make_shared<CountFunction>();
+    if (name == "uniq") return std::make_shared<UniqFunction>();
+
+    throw std::invalid_argument("Unknown aggregate function: " + name);
+}
+
+}  // namespace clickhouse
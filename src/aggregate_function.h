@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+namespace clickhouse {
+
+// Folds values of rows sharing a key in Summing/Aggregating merge modes.
+// Values are stored as partial states: inserts go through make_state(),
+// merges and FINAL queries combine states with merge(), and finalize()
+// turns a state into the value returned to the user.
+class AggregateFunction {
+public:
+    virtual ~AggregateFunction() = default;
+
+    virtual std::string name() const = 0;
+
+    virtual std::string make_state(const std::string& value) const = 0;
+
+    virtual std::string merge(const std::string& lhs, const std::string& rhs) const = 0;
+
+    virtual std::string finalize(const std::string& state) const { return state; }
+};
+
+// Supported names: sum, min, max (numeric values), count, uniq (HyperLogLog).
+// Throws std::invalid_argument for anything else.
+std::shared_ptr<const AggregateFunction> create_aggregate_function(const std::string& name);
+
+}  // namespace clickhouse
@@ -0,0 +1,92 @@
+#include "bloom_filter.h"
+#include "hash.h"
+#include "serialization.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace clickhouse {
+
+BloomFilter::BloomFilter() : bit_count_(0), hash_count_(0) {}
+
+BloomFilter::BloomFilter(size_t expected_keys, size_t bits_per_key) {
+    // At least one word so tiny parts still get a useful filter.
+    bit_count_ = std::max<uint64_t>(64, static_cast<uint64_t>(expected_keys) * bits_per_key);
+    bit_count_ = (bit_count_ + 63) / 64 * 64;
+    words_.assign(bit_count_ / 64, 0);
+    hash_count_ = static_cast<uint32_t>(std::clamp<double>(std::round(bits_per_key * 0.69), 1, 30));
+}
+
+void BloomFilter::add(const std::string& key) {
+    if (empty()) {
+        throw std::logic_error("Cannot add to an empty bloom filter");
+    }
+
+    uint64_t hash = hash64(key);
+    uint64_t delta = (hash >> 33) | (hash << 31);
+    for (uint32_t i = 0; i < hash_count_; ++i) {
+        uint64_t bit = hash % bit_count_;
+        words_[bit / 64] |= uint64_t(1) << (bit % 64);
+        hash += delta;
+    }
+}
+
+bool BloomFilter::may_contain(const std::string& key) const {
+    if (empty()) {
+        return true;
+    }
+
+    uint64_t hash = hash64(key);
+    uint64_t delta = (hash >> 33) | (hash << 31);
+    for (uint32_t i = 0; i < hash_count_; ++i) {
+        uint64_t bit = hash % bit_count_;
+        if (!(words_[bit / 64] & (uint64_t(1) << (bit % 64)))) {
+            return false;
+        }
+        hash += delta;
+    }
+    return true;
+}
+
+void BloomFilter::serialize(std::ofstream& ofs) const {
+    Serialization::write_uint64(ofs, bit_count_);
+    Serialization::write_uint64(ofs, hash_count_);
+    ofs.write(reinterpret_cast<const char*>(words_.data()), words_.size() * sizeof(uint64_t));
+}
+
+void BloomFilter::deserialize(std::ifstream& ifs) {
+    bit_count_ = Serialization::read_uint64(ifs);
+    hash_count_ = static_cast<uint32_t>(Serialization::read_uint64(ifs));
+    if (!ifs || bit_count_ % 64 != 0) {
+        throw std::runtime_error("Corrupted bloom filter");
+    }
+    words_.assign(bit_count_ / 64, 0);
+    ifs.read(reinterpret_cast<char*>(words_.data()), words_.size() * sizeof(uint64_t));
+}
+
+void BloomFilter::save_to_file(const std::string& file_path) const {
+    std::ofstream ofs(file_path, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Cannot open file for writing: " + file_path);
+    }
+    serialize(ofs);
+}
+
+void BloomFilter::load_from_file(const std::string& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file for reading: " + file_path);
+    }
+
+    deserialize(ifs);
+    if (!ifs) {
+        throw std::runtime_error("Corrupted bloom filter: " + file_path);
+    }
+}
+
+size_t BloomFilter::memory_usage() const {
+    return sizeof(BloomFilter) + words_.capacity() * sizeof(uint64_t);
+}
+
+}  // namespace clickhouse
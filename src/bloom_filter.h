@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+
+namespace clickhouse {
+
+// Bloom filter over strings using double hashing of hash64: probe i tests
+// bit (h1 + i * h2) mod bits. About 1% false positives at 10 bits per key.
+class BloomFilter {
+private:
+    std::vector<uint64_t> words_;
+    uint64_t bit_count_;
+    uint32_t hash_count_;
+
+public:
+    BloomFilter();
+
+    BloomFilter(size_t expected_keys, size_t bits_per_key);
+
+    void add(const std::string& key);
+
+    // False only if the key was never added; an empty filter matches all.
+    bool may_contain(const std::string& key) const;
+
+    bool empty() const { return bit_count_ == 0; }
+
+    void serialize(std::ofstream& ofs) const;
+
+    void deserialize(std::ifstream& ifs);
+
+    void save_to_file(const std::string& file_path) const;
+
+    void load_from_file(const std::string& file_path);
+
+    size_t memory_usage() const;
+};
+
+}  // namespace clickhouse
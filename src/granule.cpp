@@ -4,7 +4,7 @@
 
 namespace clickhouse {
 
-Granule::Granule() : sorted_(false) {
+Granule::Granule() : min_timestamp_(UINT64_MAX), max_timestamp_(0), sorted_(false) {
     rows_.reserve(GRANULE_SIZE);
 }
 
@@ -15,7 +15,8 @@ void Granule::add_row(const Row& row) {
 
     rows_.push_back(row);
     sorted_ = false;
-    update_key_range();
+    key_prefixes_.clear();
+    update_bounds(row);
 }
 
 bool Granule::is_full() const {
@@ -31,17 +32,54 @@ size_t Granule::size() const {
 }
 
 void Granule::sort() {
-    if (!sorted_) {
-        std::sort(rows_.begin(), rows_.end());
-        sorted_ = true;
-        update_key_range();
+    if (sorted_) {
+        return;
+    }
+
+    // Sorts (prefix, position) pairs, comparing rows only on equal
+    // prefixes, then moves the rows into place once. Prefixes start past
+    // the head every key shares, where they still tell keys apart.
+    key_prefix_offset_ = rows_.empty() ? 0 : rows_.front().key.size();
+    for (const auto& row : rows_) {
+        key_prefix_offset_ = common_prefix_length(std::string_view(rows_.front().key).substr(0, key_prefix_offset_), row.key);
     }
+
+    struct SortEntry {
+        uint64_t prefix;
+        uint32_t position;
+    };
+    std::vector<SortEntry> order(rows_.size());
+    for (size_t i = 0; i < rows_.size(); ++i) {
+        order[i] = {normalized_key_prefix(rows_[i].key, key_prefix_offset_), static_cast<uint32_t>(i)};
+    }
+    std::sort(order.begin(), order.end(), [this](const SortEntry& a, const SortEntry& b) {
+        if (a.prefix != b.prefix) {
+            return a.prefix < b.prefix;
+        }
+        return rows_[a.position] < rows_[b.position];
+    });
+
+    RowVector sorted_rows;
+    sorted_rows.reserve(std::max(rows_.capacity(), rows_.size()));
+    key_prefixes_.resize(rows_.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        sorted_rows.push_back(std::move(rows_[order[i].position]));
+        key_prefixes_[i] = order[i].prefix;
+    }
+    rows_.swap(sorted_rows);
+
+    sorted_ = true;
+    update_key_range();
 }
 
 void Granule::clear() {
     rows_.clear();
+    key_prefixes_.clear();
+    key_prefix_offset_ = 0;
     min_key_.clear();
     max_key_.clear();
+    min_timestamp_ = UINT64_MAX;
+    max_timestamp_ = 0;
     sorted_ = false;
 }
 
@@ -64,8 +102,78 @@ RowVector Granule::query_range(const std::string& start_key, const std::string&
     return result;
 }
 
+RowVector Granule::query_range(const std::string& start_key, const std::string& end_key,
+                               uint64_t ts_from, uint64_t ts_to) const {
+    if (!sorted_) {
+        throw std::runtime_error("Granule must be sorted before querying");
+    }
+
+    RowVector result;
+
+    if (max_timestamp_ < ts_from || min_timestamp_ > ts_to) {
+        return result;
+    }
+
+    for (const auto& row : rows_) {
+        if (row.key > end_key) {
+            break;
+        }
+        if (row.key >= start_key && row.timestamp >= ts_from && row.timestamp <= ts_to) {
+            result.push_back(row);
+        }
+    }
+
+    return result;
+}
+
+std::pair<size_t, size_t> Granule::find_key_range(const std::string& start_key,
+                                                  const std::string& end_key) const {
+    if (!sorted_) {
+        throw std::runtime_error("Granule must be sorted before querying");
+    }
+
+    if (rows_.empty()) {
+        return {0, 0};
+    }
+
+    // A bound that differs from the shared head is below or above every
+    // row. Otherwise prefixes narrow it to the rows sharing its prefix, and
+    // only those are compared as whole keys.
+    std::string_view head(rows_.front().key.data(), key_prefix_offset_);
+    auto head_order = [&head](const std::string& key) {
+        return compare_keys(std::string_view(key).substr(0, head.size()), head);
+    };
+    auto prefix_run = [this](const std::string& key, size_t from) {
+        uint64_t prefix = normalized_key_prefix(key, key_prefix_offset_);
+        auto low = std::lower_bound(key_prefixes_.begin() + from, key_prefixes_.end(), prefix);
+        auto high = std::upper_bound(low, key_prefixes_.end(), prefix);
+        return std::make_pair(rows_.begin() + (low - key_prefixes_.begin()),
+                              rows_.begin() + (high - key_prefixes_.begin()));
+    };
+
+    size_t first_index = 0;
+    if (int order = head_order(start_key); order != 0) {
+        first_index = order < 0 ? 0 : rows_.size();
+    } else {
+        auto [low, high] = prefix_run(start_key, 0);
+        first_index = std::lower_bound(low, high, start_key,
+            [](const Row& row, const std::string& key) { return compare_keys(row.key, key) < 0; }) - rows_.begin();
+    }
+
+    size_t last_index = 0;
+    if (int order = head_order(end_key); order != 0) {
+        last_index = order < 0 ? 0 : rows_.size();
+    } else {
+        auto [low, high] = prefix_run(end_key, first_index);
+        last_index = std::upper_bound(low, high, end_key,
+            [](const std::string& key, const Row& row) { return compare_keys(key, row.key) < 0; }) - rows_.begin();
+    }
+
+    return {first_index, std::max(first_index, last_index)};
+}
+
 size_t Granule::memory_usage() const {
-    size_t total = sizeof(Granule);
+    size_t total = sizeof(Granule) + key_prefixes_.capacity() * sizeof(uint64_t);
     for (const auto& row : rows_) {
         total += row.size();
     }
@@ -93,4 +201,18 @@ void Granule::update_key_range() {
     }
 }
 
+void Granule::update_bounds(const Row& row) {
+    if (rows_.size() == 1) {
+        min_key_ = row.key;
+        max_key_ = row.key;
+    } else if (row.key < min_key_) {
+        min_key_ = row.key;
+    } else if (row.key > max_key_) {
+        max_key_ = row.key;
+    }
+
+    min_timestamp_ = std::min(min_timestamp_, row.timestamp);
+    max_timestamp_ = std::max(max_timestamp_, row.timestamp);
+}
+
 }  // namespace clickhouse
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <utility>
 
 namespace clickhouse {
 
@@ -12,8 +13,15 @@ constexpr size_t GRANULE_SIZE = 8192;  // ClickHouse default granule size
 class Granule {
 private:
     RowVector rows_;
+    // normalized_key_prefix of each row's key past the head all keys share
+    // (key_prefix_offset_ bytes), kept while sorted so key searches compare
+    // integers before falling back to whole keys.
+    std::vector<uint64_t> key_prefixes_;
+    size_t key_prefix_offset_ = 0;
     std::string min_key_;
     std::string max_key_;
+    uint64_t min_timestamp_;
+    uint64_t max_timestamp_;
     bool sorted_;
 
 public:
@@ -27,18 +35,33 @@ public:
 
     const std::string& min_key() const { return min_key_; }
     const std::string& max_key() const { return max_key_; }
+    uint64_t min_timestamp() const { return min_timestamp_; }
+    uint64_t max_timestamp() const { return max_timestamp_; }
 
     const RowVector& rows() const { return rows_; }
     RowVector& rows() { return rows_; }
 
+    // Empty unless the granule is sorted. Taken key_prefix_offset() bytes
+    // into each key.
+    const std::vector<uint64_t>& key_prefixes() const { return key_prefixes_; }
+    size_t key_prefix_offset() const { return key_prefix_offset_; }
+
     void clear();
 
     RowVector query_range(const std::string& start_key, const std::string& end_key) const;
 
+    RowVector query_range(const std::string& start_key, const std::string& end_key,
+                          uint64_t ts_from, uint64_t ts_to) const;
+
+    // Positions [first, last) of the rows whose key lies in [start_key, end_key].
+    std::pair<size_t, size_t> find_key_range(const std::string& start_key, const std::string& end_key) const;
+
     size_t memory_usage() const;
 
 private:
     void update_key_range();
+
+    void update_bounds(const Row& row);
 };
 
 }  // namespace clickhouse
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "group_by.h"
+#include "hash.h"
+#include "number.h"
+#include <algorithm>
+
+namespace clickhouse {
+
+namespace {
+
+constexpr size_t MIN_SLOTS = 64;
+
+size_t slot_count_for(size_t groups) {
+    size_t slots = MIN_SLOTS;
+    while (slots < groups * 2) {
+        slots *= 2;
+    }
+    return slots;
+}
+
+}  // namespace
+
+std::string_view GroupBySpec::group_of(std::string_view key) const {
+    if (!key_delimiter.empty()) {
+        size_t pos = key.find(key_delimiter);
+        if (pos != std::string_view::npos) {
+            key = key.substr(0, pos);
+        }
+    }
+    if (key_prefix_length > 0 && key.size() > key_prefix_length) {
+        key = key.substr(0, key_prefix_length);
+    }
+    return key;
+}
+
+GroupByTable::GroupByTable(size_t expected_groups)
+    : slots_(slot_count_for(expected_groups), Slot{0, EMPTY_SLOT}), last_group_(EMPTY_SLOT) {
+    groups_.reserve(expected_groups);
+}
+
+AggregateGroup& GroupByTable::find_or_insert(std::string_view key_prefix) {
+    if (last_group_ != EMPTY_SLOT && groups_[last_group_].key_prefix == key_prefix) {
+        return groups_[last_group_];
+    }
+
+    uint64_t hash = hash64(key_prefix.data(), key_prefix.size());
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots_[i];
+        if (slot.group == EMPTY_SLOT) {
+            slot = {hash, static_cast<uint32_t>(groups_.size())};
+            groups_.emplace_back();
+            groups_.back().key_prefix = std::string(key_prefix);
+            last_group_ = groups_.size() - 1;
+            if (groups_.size() * 2 > slots_.size()) {
+                grow();
+            }
+            return groups_[last_group_];
+        }
+        if (slot.hash == hash && groups_[slot.group].key_prefix == key_prefix) {
+            last_group_ = slot.group;
+            return groups_[last_group_];
+        }
+    }
+}
+
+void GroupByTable::grow() {
+    std::vector<Slot> slots(slots_.size() * 2, Slot{0, EMPTY_SLOT});
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : slots_) {
+        if (slot.group == EMPTY_SLOT) {
+            continue;
+        }
+        size_t i = slot.hash & mask;
+        while (slots[i].group != EMPTY_SLOT) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+    slots_.swap(slots);
+}
+
+void GroupByTable::add(std::string_view key_prefix, std::string_view value, int8_t sign) {
+    AggregateGroup& group = find_or_insert(key_prefix);
+    group.count += sign;
+
+    double number;
+    if (parse_number(value, number)) {
+        group.numeric_count += sign;
+        group.sum += sign * number;
+        if (sign > 0) {
+            group.min = std::min(group.min, number);
+            group.max = std::max(group.max, number);
+        }
+    }
+}
+
+void GroupByTable::merge(const GroupByTable& other) {
+    for (const auto& source : other.groups_) {
+        AggregateGroup& group = find_or_insert(source.key_prefix);
+        group.count += source.count;
+        group.numeric_count += source.numeric_count;
+        group.sum += source.sum;
+        group.min = std::min(group.min, source.min);
+        group.max = std::max(group.max, source.max);
+    }
+}
+
+std::vector<AggregateGroup> GroupByTable::result() const {
+    std::vector<AggregateGroup> result;
+    result.reserve(groups_.size());
+    for (const auto& group : groups_) {
+        if (group.count != 0) {
+            result.push_back(group);
+        }
+    }
+    std::sort(result.begin(), result.end(),
+              [](const AggregateGroup& a, const AggregateGroup& b) { return a.key_prefix < b.key_prefix; });
+    return result;
+}
+
+}  // namespace clickhouse
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+namespace clickhouse {
+
+// GROUP BY a key prefix: a row's group is its key up to the first
+// key_delimiter (the whole key without one), cut to at most
+// key_prefix_length bytes (0: no limit).
+struct GroupBySpec {
+    std::string key_delimiter;
+    size_t key_prefix_length = 0;
+    // Groups the result is expected to have; sizes the hash tables up front
+    // (0: start small and grow).
+    size_t expected_groups = 0;
+    // Threads aggregating parts in parallel (0: up to
+    // MergeTreeConfig::max_query_threads).
+    size_t threads = 0;
+
+    std::string_view group_of(std::string_view key) const;
+};
+
+// Aggregates of one group. Values that parse as numbers feed sum, min and
+// max. A cancel row (sign -1) subtracts from count, numeric_count and sum,
+// so cancelled pairs net out; min and max only see state rows.
+struct AggregateGroup {
+    std::string key_prefix;
+    int64_t count = 0;
+    int64_t numeric_count = 0;
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    double avg() const { return numeric_count > 0 ? sum / static_cast<double>(numeric_count) : 0; }
+};
+
+// Partial GROUP BY state: an open-addressing hash table (linear probing,
+// power-of-two capacity, at most half full) from group to its aggregates.
+// Rows arrive in key order, so consecutive rows of a group reuse the last
+// slot without hashing.
+class GroupByTable {
+private:
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    struct Slot {
+        uint64_t hash;
+        uint32_t group;
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<AggregateGroup> groups_;
+    size_t last_group_;
+
+    AggregateGroup& find_or_insert(std::string_view key_prefix);
+
+    void grow();
+
+public:
+    explicit GroupByTable(size_t expected_groups = 0);
+
+    void add(std::string_view key_prefix, std::string_view value, int8_t sign);
+
+    // Folds another partial state into this one.
+    void merge(const GroupByTable& other);
+
+    size_t size() const { return groups_.size(); }
+
+    // Groups sorted by key prefix, leaving out those whose rows all cancelled.
+    std::vector<AggregateGroup> result() const;
+};
+
+}  // namespace clickhouse
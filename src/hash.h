@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace clickhouse {
+
+// Stable 64-bit string hash (FNV-1a followed by a splitmix64 finalizer).
+// Values are persisted in sketches and skip indexes, so this must not change.
+inline uint64_t hash64(const char* data, size_t size, uint64_t seed = 0) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+inline uint64_t hash64(const std::string& str, uint64_t seed = 0) {
+    return hash64(str.data(), str.size(), seed);
+}
+
+// Hash placing a key in SAMPLE clauses, seeded apart from the hashes of
+// key bloom filters. Persisted per granule as well.
+inline uint64_t key_sample_hash(const char* data, size_t size) {
+    return hash64(data, size, 0x5a4d504c45ULL);
+}
+
+}  // namespace clickhouse
@@ -0,0 +1,113 @@
+#include "hyperloglog.h"
+#include "hash.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace clickhouse {
+
+namespace {
+
+constexpr char SPARSE_TAG = 'S';
+constexpr char DENSE_TAG = 'D';
+
+}  // namespace
+
+HyperLogLog::HyperLogLog() : registers_(REGISTER_COUNT, 0) {}
+
+void HyperLogLog::add(const std::string& value) {
+    add_hash(hash64(value));
+}
+
+void HyperLogLog::add_hash(uint64_t hash) {
+    uint32_t index = static_cast<uint32_t>(hash >> (64 - PRECISION));
+    uint64_t remaining = hash << PRECISION;
+    uint8_t rank = remaining == 0 ? static_cast<uint8_t>(64 - PRECISION + 1)
+                                  : static_cast<uint8_t>(__builtin_clzll(remaining) + 1);
+    registers_[index] = std::max(registers_[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    for (uint32_t i = 0; i < REGISTER_COUNT; ++i) {
+        registers_[i] = std::max(registers_[i], other.registers_[i]);
+    }
+}
+
+uint64_t HyperLogLog::estimate() const {
+    double sum = 0.0;
+    uint32_t zero_registers = 0;
+
+    for (uint8_t reg : registers_) {
+        sum += std::ldexp(1.0, -reg);
+        if (reg == 0) {
+            zero_registers++;
+        }
+    }
+
+    const double m = REGISTER_COUNT;
+    const double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+
+    if (estimate <= 2.5 * m && zero_registers > 0) {
+        estimate = m * std::log(m / zero_registers);
+    }
+
+    return static_cast<uint64_t>(std::llround(estimate));
+}
+
+bool HyperLogLog::empty() const {
+    return std::all_of(registers_.begin(), registers_.end(), [](uint8_t reg) { return reg == 0; });
+}
+
+std::string HyperLogLog::serialize() const {
+    size_t set_registers = std::count_if(registers_.begin(), registers_.end(),
+                                         [](uint8_t reg) { return reg != 0; });
+
+    // A sparse entry takes 3 bytes (index + rank) against 1 byte per register.
+    if (set_registers * 3 < REGISTER_COUNT) {
+        std::string data(1, SPARSE_TAG);
+        data.reserve(1 + set_registers * 3);
+        for (uint32_t i = 0; i < REGISTER_COUNT; ++i) {
+            if (registers_[i] != 0) {
+                data.push_back(static_cast<char>(i & 0xff));
+                data.push_back(static_cast<char>(i >> 8));
+                data.push_back(static_cast<char>(registers_[i]));
+            }
+        }
+        return data;
+    }
+
+    std::string data(1, DENSE_TAG);
+    data.append(reinterpret_cast<const char*>(registers_.data()), registers_.size());
+    return data;
+}
+
+HyperLogLog HyperLogLog::deserialize(const std::string& data) {
+    HyperLogLog hll;
+
+    if (data.empty()) {
+        return hll;
+    }
+
+    if (data[0] == DENSE_TAG && data.size() == 1 + REGISTER_COUNT) {
+        std::memcpy(hll.registers_.data(), data.data() + 1, REGISTER_COUNT);
+        return hll;
+    }
+
+    if (data[0] == SPARSE_TAG && (data.size() - 1) % 3 == 0) {
+        for (size_t pos = 1; pos < data.size(); pos += 3) {
+            uint32_t index = static_cast<uint8_t>(data[pos]) |
+                             (static_cast<uint32_t>(static_cast<uint8_t>(data[pos + 1])) << 8);
+            if (index >= REGISTER_COUNT) {
+                throw std::runtime_error("Corrupted HyperLogLog state");
+            }
+            hll.registers_[index] = static_cast<uint8_t>(data[pos + 2]);
+        }
+        return hll;
+    }
+
+    throw std::runtime_error("Corrupted HyperLogLog state");
+}
+
+}  // namespace clickhouse
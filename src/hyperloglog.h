@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace clickhouse {
+
+// HyperLogLog distinct counter with 2^12 registers (~1.6% standard error).
+// Serialized states are sparse while few registers are set, so per-row
+// states stay small.
+class HyperLogLog {
+private:
+    static constexpr uint32_t PRECISION = 12;
+    static constexpr uint32_t REGISTER_COUNT = 1u << PRECISION;
+
+    std::vector<uint8_t> registers_;
+
+public:
+    HyperLogLog();
+
+    void add(const std::string& value);
+
+    void add_hash(uint64_t hash);
+
+    void merge(const HyperLogLog& other);
+
+    uint64_t estimate() const;
+
+    bool empty() const;
+
+    size_t memory_usage() const { return sizeof(HyperLogLog) + registers_.capacity(); }
+
+    std::string serialize() const;
+
+    static HyperLogLog deserialize(const std::string& data);
+};
+
+}  // namespace clickhouse
@@ -0,0 +1,149 @@
+#include "key_compare.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CLICKHOUSE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace clickhouse {
+
+namespace {
+
+void compare_prefixes_scalar(const uint64_t* prefixes, size_t count, uint64_t bound, int8_t* result) {
+    for (size_t i = 0; i < count; ++i) {
+        result[i] = static_cast<int8_t>((prefixes[i] > bound) - (prefixes[i] < bound));
+    }
+}
+
+#ifdef CLICKHOUSE_X86_KERNELS
+
+int first_difference(const char* a, const char* b, size_t i) {
+    return static_cast<uint8_t>(a[i]) < static_cast<uint8_t>(b[i]) ? -1 : 1;
+}
+
+int compare_lengths(size_t a_size, size_t b_size) {
+    return a_size < b_size ? -1 : (a_size > b_size ? 1 : 0);
+}
+
+// Both kernels expect at least one vector of common bytes; the last block
+// is loaded overlapping the previous one instead of a scalar tail.
+__attribute__((target("avx2")))
+int compare_keys_avx2(const char* a, size_t a_size, const char* b, size_t b_size) {
+    size_t common = a_size < b_size ? a_size : b_size;
+    if (common < 32) {
+        return detail::compare_keys_scalar(a, a_size, b, b_size);
+    }
+
+    for (size_t i = 0;; i += 32) {
+        i = i + 32 <= common ? i : common - 32;
+        __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        uint32_t differ = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(left, right)));
+        if (differ != 0) {
+            return first_difference(a, b, i + __builtin_ctz(differ));
+        }
+        if (i + 32 == common) {
+            return compare_lengths(a_size, b_size);
+        }
+    }
+}
+
+__attribute__((target("sse4.2")))
+int compare_keys_sse42(const char* a, size_t a_size, const char* b, size_t b_size) {
+    constexpr int MODE = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT;
+    size_t common = a_size < b_size ? a_size : b_size;
+    if (common < 16) {
+        return detail::compare_keys_scalar(a, a_size, b, b_size);
+    }
+
+    for (size_t i = 0;; i += 16) {
+        i = i + 16 <= common ? i : common - 16;
+        __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        int index = _mm_cmpestri(left, 16, right, 16, MODE);
+        if (index < 16) {
+            return first_difference(a, b, i + index);
+        }
+        if (i + 16 == common) {
+            return compare_lengths(a_size, b_size);
+        }
+    }
+}
+
+// Unsigned 64-bit order via signed compares after flipping the sign bit.
+__attribute__((target("avx2")))
+void compare_prefixes_avx2(const uint64_t* prefixes, size_t count, uint64_t bound, int8_t* result) {
+    const __m256i flip = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i target = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(bound)), flip);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i values =
+            _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(prefixes + i)), flip);
+        int above = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(values, target)));
+        int below = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(target, values)));
+        for (int lane = 0; lane < 4; ++lane) {
+            result[i + lane] = static_cast<int8_t>(((above >> lane) & 1) - ((below >> lane) & 1));
+        }
+    }
+    compare_prefixes_scalar(prefixes + i, count - i, bound, result + i);
+}
+
+__attribute__((target("sse4.2")))
+void compare_prefixes_sse42(const uint64_t* prefixes, size_t count, uint64_t bound, int8_t* result) {
+    const __m128i flip = _mm_set1_epi64x(INT64_MIN);
+    const __m128i target = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(bound)), flip);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i values = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prefixes + i)), flip);
+        int above = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(values, target)));
+        int below = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(target, values)));
+        result[i] = static_cast<int8_t>((above & 1) - (below & 1));
+        result[i + 1] = static_cast<int8_t>(((above >> 1) & 1) - ((below >> 1) & 1));
+    }
+    compare_prefixes_scalar(prefixes + i, count - i, bound, result + i);
+}
+
+#endif
+
+struct KeyCompareKernels {
+    int (*compare_keys)(const char*, size_t, const char*, size_t);
+    void (*compare_prefixes)(const uint64_t*, size_t, uint64_t, int8_t*);
+    const char* name;
+};
+
+KeyCompareKernels select_kernels() {
+#ifdef CLICKHOUSE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {compare_keys_avx2, compare_prefixes_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return {compare_keys_sse42, compare_prefixes_sse42, "sse4.2"};
+    }
+#endif
+    return {detail::compare_keys_scalar, compare_prefixes_scalar, "scalar"};
+}
+
+const KeyCompareKernels& kernels() {
+    static const KeyCompareKernels selected = select_kernels();
+    return selected;
+}
+
+int resolve_compare_keys(const char* a, size_t a_size, const char* b, size_t b_size) {
+    detail::compare_keys_kernel.store(kernels().compare_keys, std::memory_order_relaxed);
+    return kernels().compare_keys(a, a_size, b, b_size);
+}
+
+}  // namespace
+
+std::atomic<detail::CompareKeysKernel> detail::compare_keys_kernel{resolve_compare_keys};
+
+void compare_prefixes(const uint64_t* prefixes, size_t count, uint64_t bound, int8_t* result) {
+    kernels().compare_prefixes(prefixes, count, bound, result);
+}
+
+const char* key_compare_implementation() {
+    return kernels().name;
+}
+
+}  // namespace clickhouse
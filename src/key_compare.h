@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string_view>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+namespace clickhouse {
+
+// First 8 bytes of a key as a big-endian integer, zero-padded: comparing
+// prefixes orders keys like comparing the keys themselves, except that
+// equal prefixes need a full comparison to break the tie.
+inline uint64_t normalized_key_prefix(std::string_view key) {
+    if (key.size() >= sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, key.data(), sizeof(word));
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap64(word);
+#endif
+    }
+
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+        prefix = (prefix << 8) | (i < key.size() ? static_cast<uint8_t>(key[i]) : 0);
+    }
+    return prefix;
+}
+
+// normalized_key_prefix of the key past its first `offset` bytes, for keys
+// sharing an `offset`-byte head.
+inline uint64_t normalized_key_prefix(std::string_view key, size_t offset) {
+    return normalized_key_prefix(key.substr(offset < key.size() ? offset : key.size()));
+}
+
+inline size_t common_prefix_length(std::string_view a, std::string_view b) {
+    size_t length = 0;
+    size_t limit = a.size() < b.size() ? a.size() : b.size();
+    while (length < limit && a[length] == b[length]) {
+        ++length;
+    }
+    return length;
+}
+
+namespace detail {
+
+// Below this common length the inline word-at-a-time loop beats a call
+// into the vector kernels.
+constexpr size_t SIMD_COMPARE_MIN_LENGTH = 32;
+
+using CompareKeysKernel = int (*)(const char*, size_t, const char*, size_t);
+
+// Starts as a resolver that installs the kernel for this CPU on first use.
+extern std::atomic<CompareKeysKernel> compare_keys_kernel;
+
+inline int compare_keys_scalar(const char* a, size_t a_size, const char* b, size_t b_size) {
+    size_t common = a_size < b_size ? a_size : b_size;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= common; i += sizeof(uint64_t)) {
+        uint64_t left = normalized_key_prefix(std::string_view(a + i, sizeof(uint64_t)));
+        uint64_t right = normalized_key_prefix(std::string_view(b + i, sizeof(uint64_t)));
+        if (left != right) {
+            return left < right ? -1 : 1;
+        }
+    }
+    for (; i < common; ++i) {
+        if (a[i] != b[i]) {
+            return static_cast<uint8_t>(a[i]) < static_cast<uint8_t>(b[i]) ? -1 : 1;
+        }
+    }
+    return a_size < b_size ? -1 : (a_size > b_size ? 1 : 0);
+}
+
+}  // namespace detail
+
+// Three-way bytewise comparison (the order of std::string). Long keys go
+// through AVX2 or SSE4.2 kernels picked once from the CPU's features.
+inline int compare_keys(std::string_view a, std::string_view b) {
+    if (a.size() < detail::SIMD_COMPARE_MIN_LENGTH || b.size() < detail::SIMD_COMPARE_MIN_LENGTH) {
+        return detail::compare_keys_scalar(a.data(), a.size(), b.data(), b.size());
+    }
+    return detail::compare_keys_kernel.load(std::memory_order_relaxed)(a.data(), a.size(), b.data(), b.size());
+}
+
+// result[i] = -1, 0 or 1 as prefixes[i] is below, equal to or above `bound`.
+void compare_prefixes(const uint64_t* prefixes, size_t count, uint64_t bound, int8_t* result);
+
+// "avx2", "sse4.2" or "scalar": the kernels chosen for this CPU.
+const char* key_compare_implementation();
+
+}  // namespace clickhouse
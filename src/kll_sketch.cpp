@@ -0,0 +1,202 @@
+#include "kll_sketch.h"
+#include "serialization.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace clickhouse {
+
+namespace {
+
+constexpr double CAPACITY_DECAY = 2.0 / 3.0;
+constexpr size_t MIN_LEVEL_CAPACITY = 2;
+constexpr size_t MAX_LEVELS = 64;
+
+uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+uint64_t double_bits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+double bits_double(uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+}  // namespace
+
+KllSketch::KllSketch(uint32_t k)
+    : k_(std::max<uint32_t>(k, MIN_LEVEL_CAPACITY)), count_(0),
+      min_(std::numeric_limits<double>::infinity()), max_(-std::numeric_limits<double>::infinity()),
+      items_(0), capacity_(0) {}
+
+size_t KllSketch::level_capacity(size_t level) const {
+    size_t depth = levels_.size() - 1 - level;
+    double capacity = std::ceil(k_ * std::pow(CAPACITY_DECAY, static_cast<double>(depth)));
+    return std::max(MIN_LEVEL_CAPACITY, static_cast<size_t>(capacity));
+}
+
+void KllSketch::add_level() {
+    if (levels_.size() == MAX_LEVELS) {
+        throw std::logic_error("KLL sketch exceeded its level limit");
+    }
+    levels_.emplace_back();
+    capacity_ = 0;
+    for (size_t level = 0; level < levels_.size(); ++level) {
+        capacity_ += level_capacity(level);
+    }
+}
+
+void KllSketch::add(double value) {
+    if (levels_.empty()) {
+        add_level();
+    }
+    levels_[0].push_back(value);
+    ++items_;
+    ++count_;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    if (items_ > capacity_) {
+        compress();
+    }
+}
+
+void KllSketch::merge(const KllSketch& other) {
+    if (other.empty()) {
+        return;
+    }
+    while (levels_.size() < other.levels_.size()) {
+        add_level();
+    }
+    for (size_t level = 0; level < other.levels_.size(); ++level) {
+        levels_[level].insert(levels_[level].end(), other.levels_[level].begin(), other.levels_[level].end());
+    }
+    items_ += other.items_;
+    count_ += other.count_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    compress();
+}
+
+void KllSketch::compress() {
+    while (items_ > capacity_) {
+        size_t level = 0;
+        while (level + 1 < levels_.size() && levels_[level].size() < level_capacity(level)) {
+            ++level;
+        }
+        if (level + 1 == levels_.size()) {
+            add_level();
+        }
+
+        // Keeps every other sorted item, starting at a pseudo-random offset,
+        // at the next level; an odd item out stays where it is.
+        auto& items = levels_[level];
+        std::sort(items.begin(), items.end());
+        std::vector<double> kept;
+        if (items.size() % 2 == 1) {
+            kept.push_back(items.back());
+            items.pop_back();
+        }
+        size_t offset = mix(count_ ^ (static_cast<uint64_t>(level) << 56)) & 1;
+        auto& next = levels_[level + 1];
+        for (size_t i = offset; i < items.size(); i += 2) {
+            next.push_back(items[i]);
+        }
+        items_ -= items.size() / 2;
+        items = std::move(kept);
+    }
+}
+
+double KllSketch::quantile(double level) const {
+    if (empty()) {
+        return 0;
+    }
+    if (level <= 0) {
+        return min_;
+    }
+    if (level >= 1) {
+        return max_;
+    }
+
+    std::vector<std::pair<double, uint64_t>> weighted;
+    uint64_t total_weight = 0;
+    for (size_t h = 0; h < levels_.size(); ++h) {
+        for (double value : levels_[h]) {
+            weighted.emplace_back(value, uint64_t(1) << h);
+            total_weight += uint64_t(1) << h;
+        }
+    }
+    std::sort(weighted.begin(), weighted.end());
+
+    double target = level * static_cast<double>(total_weight);
+    uint64_t cumulative = 0;
+    for (const auto& [value, weight] : weighted) {
+        cumulative += weight;
+        if (static_cast<double>(cumulative) >= target) {
+            return value;
+        }
+    }
+    return max_;
+}
+
+size_t KllSketch::memory_usage() const {
+    size_t total = sizeof(KllSketch);
+    for (const auto& level : levels_) {
+        total += sizeof(level) + level.capacity() * sizeof(double);
+    }
+    return total;
+}
+
+void KllSketch::serialize(std::ofstream& ofs) const {
+    Serialization::write_uint64(ofs, k_);
+    Serialization::write_uint64(ofs, count_);
+    Serialization::write_uint64(ofs, double_bits(min_));
+    Serialization::write_uint64(ofs, double_bits(max_));
+    Serialization::write_uint64(ofs, levels_.size());
+    for (const auto& level : levels_) {
+        Serialization::write_uint64(ofs, level.size());
+        ofs.write(reinterpret_cast<const char*>(level.data()), level.size() * sizeof(double));
+    }
+}
+
+void KllSketch::deserialize(std::ifstream& ifs) {
+    k_ = static_cast<uint32_t>(Serialization::read_uint64(ifs));
+    count_ = Serialization::read_uint64(ifs);
+    min_ = bits_double(Serialization::read_uint64(ifs));
+    max_ = bits_double(Serialization::read_uint64(ifs));
+    uint64_t level_count = Serialization::read_uint64(ifs);
+    if (!ifs || k_ < MIN_LEVEL_CAPACITY || level_count > MAX_LEVELS) {
+        throw std::runtime_error("Corrupted KLL sketch");
+    }
+
+    levels_.clear();
+    items_ = 0;
+    for (uint64_t i = 0; i < level_count; ++i) {
+        add_level();
+    }
+    for (auto& level : levels_) {
+        uint64_t size = Serialization::read_uint64(ifs);
+        if (!ifs || size > count_) {
+            throw std::runtime_error("Corrupted KLL sketch");
+        }
+        level.resize(size);
+        ifs.read(reinterpret_cast<char*>(level.data()), size * sizeof(double));
+        items_ += size;
+    }
+    if (!ifs) {
+        throw std::runtime_error("Corrupted KLL sketch");
+    }
+}
+
+}  // namespace clickhouse
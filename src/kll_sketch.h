@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+namespace clickhouse {
+
+// KLL quantile sketch over doubles: compactors whose capacity shrinks by
+// 2/3 per level below the top one (k items), each compaction keeping every
+// other sorted item at twice the weight. Rank error is about 1.7% at
+// k = 200, and merging sketches gives the sketch of the combined input.
+// Compaction offsets come from a hash of the item count, so the same input
+// always builds the same sketch.
+class KllSketch {
+private:
+    uint32_t k_;
+    uint64_t count_;
+    double min_;
+    double max_;
+    // levels_[h] holds items of weight 2^h; items_ counts them all and
+    // capacity_ is the sum of the level capacities.
+    std::vector<std::vector<double>> levels_;
+    size_t items_;
+    size_t capacity_;
+
+    size_t level_capacity(size_t level) const;
+
+    void add_level();
+
+    void compress();
+
+public:
+    static constexpr uint32_t DEFAULT_K = 200;
+
+    explicit KllSketch(uint32_t k = DEFAULT_K);
+
+    void add(double value);
+
+    void merge(const KllSketch& other);
+
+    // Value at rank `level` in [0, 1] (0: min, 1: max); 0 for an empty sketch.
+    double quantile(double level) const;
+
+    uint64_t count() const { return count_; }
+
+    bool empty() const { return count_ == 0; }
+
+    double min() const { return min_; }
+
+    double max() const { return max_; }
+
+    size_t memory_usage() const;
+
+    void serialize(std::ofstream& ofs) const;
+
+    void deserialize(std::ifstream& ifs);
+};
+
+}  // namespace clickhouse
@@ -62,6 +62,18 @@ RowVector MemTable::query(const std::string& start_key, const std::string& end_k
     return result;
 }
 
+RowVector MemTable::query(const std::string& start_key, const std::string& end_key,
+                          uint64_t ts_from, uint64_t ts_to) const {
+    RowVector result = query(start_key, end_key);
+
+    result.erase(std::remove_if(result.begin(), result.end(),
+        [ts_from, ts_to](const Row& row) {
+            return row.timestamp < ts_from || row.timestamp > ts_to;
+        }), result.end());
+
+    return result;
+}
+
 RowVector MemTable::query_key(const std::string& key) const {
     return query(key, key);
 }
@@ -91,6 +103,42 @@ void MemTable::clear() {
     memory_usage_ = 0;
 }
 
+size_t MemTable::erase_range(const std::string& start_key, const std::string& end_key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::shared_ptr<SkipListNode>> update(MAX_LEVEL + 1);
+    auto current = header_;
+
+    for (int i = current_level_; i >= 0; --i) {
+        while (current->forward[i] && current->forward[i]->data.key < start_key) {
+            current = current->forward[i];
+        }
+        update[i] = current;
+    }
+
+    size_t removed = 0;
+    auto node = current->forward[0];
+
+    while (node && node->data.key <= end_key) {
+        for (int i = 0; i <= current_level_; ++i) {
+            if (update[i]->forward[i] == node) {
+                update[i]->forward[i] = node->forward[i];
+            }
+        }
+
+        memory_usage_ -= node->data.size() + sizeof(SkipListNode);
+        size_--;
+        removed++;
+        node = node->forward[0];
+    }
+
+    while (current_level_ > 0 && !header_->forward[current_level_]) {
+        current_level_--;
+    }
+
+    return removed;
+}
+
 std::vector<Granule> MemTable::flush_to_granules() {
     std::lock_guard<std::mutex> lock(mutex_);
 
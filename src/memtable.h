@@ -36,6 +36,9 @@ public:
 
     RowVector query(const std::string& start_key, const std::string& end_key) const;
 
+    RowVector query(const std::string& start_key, const std::string& end_key,
+                    uint64_t ts_from, uint64_t ts_to) const;
+
     RowVector query_key(const std::string& key) const;
 
     bool empty() const;
@@ -46,6 +49,9 @@ public:
 
     void clear();
 
+    // Unlinks every row with a key in [start_key, end_key]; returns how many.
+    size_t erase_range(const std::string& start_key, const std::string& end_key);
+
     std::vector<Granule> flush_to_granules();
 
     RowVector get_all_rows() const;
@@ -0,0 +1,95 @@
+#include "merge_selector.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace clickhouse {
+
+namespace {
+
+double map_piecewise_linear_to_unit(double value, double min, double max) {
+    if (value <= min) {
+        return 0.0;
+    }
+    if (value >= max) {
+        return 1.0;
+    }
+    return (value - min) / (max - min);
+}
+
+}  // namespace
+
+SimpleMergeSelector::SimpleMergeSelector(const MergeSelectorSettings& settings)
+    : settings_(settings) {}
+
+SimpleMergeSelector::PartsRange SimpleMergeSelector::select(const std::vector<PartsRange>& ranges) const {
+    PartsRange best;
+    double best_score = std::numeric_limits<double>::max();
+
+    for (const auto& range : ranges) {
+        for (size_t begin = 0; begin + 1 < range.size(); ++begin) {
+            double sum_size = 0;
+            double max_size = 0;
+            double min_age = std::numeric_limits<double>::max();
+            size_t limit = std::min(range.size(), begin + settings_.max_parts_to_merge_at_once);
+
+            for (size_t end = begin; end < limit; ++end) {
+                const auto& part = range[end];
+                if (part.size > settings_.max_bytes_to_merge) {
+                    break;
+                }
+
+                sum_size += static_cast<double>(part.size);
+                max_size = std::max(max_size, static_cast<double>(part.size));
+                min_age = std::min(min_age, static_cast<double>(part.age_seconds));
+
+                if (sum_size > static_cast<double>(settings_.max_bytes_to_merge)) {
+                    break;
+                }
+
+                size_t count = end - begin + 1;
+                if (count < 2 || !allow(sum_size, max_size, min_age, count)) {
+                    continue;
+                }
+
+                double current_score = score(count, sum_size);
+                if (current_score < best_score) {
+                    best_score = current_score;
+                    best.assign(range.begin() + begin, range.begin() + end + 1);
+                }
+            }
+        }
+    }
+
+    return best;
+}
+
+bool SimpleMergeSelector::allow(double sum_size, double max_size, double min_age, size_t count) const {
+    if (settings_.base <= 1.0) {
+        return true;
+    }
+
+    double size_normalized = map_piecewise_linear_to_unit(
+        std::log1p(sum_size),
+        std::log1p(static_cast<double>(settings_.min_size_to_lower_base)),
+        std::log1p(static_cast<double>(settings_.max_size_to_lower_base)));
+
+    double age_normalized = map_piecewise_linear_to_unit(
+        min_age,
+        static_cast<double>(settings_.lower_base_after_seconds_min),
+        static_cast<double>(settings_.lower_base_after_seconds_max));
+
+    double combined_ratio = std::min(1.0, size_normalized + age_normalized);
+    double lowered_base = settings_.base + (2.0 - settings_.base) * combined_ratio;
+
+    double fixed_cost = static_cast<double>(settings_.size_fixed_cost_to_add);
+    return (sum_size + count * fixed_cost) / (max_size + fixed_cost) >= lowered_base;
+}
+
+double SimpleMergeSelector::score(size_t count, double sum_size) const {
+    // Subtracting 1.9 rather than 2 keeps two-part merges finite but costly.
+    double fixed_cost = static_cast<double>(settings_.size_fixed_cost_to_add);
+    return (sum_size + count * fixed_cost) / (static_cast<double>(count) - 1.9);
+}
+
+}  // namespace clickhouse
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace clickhouse {
+
+struct MergeSelectorSettings {
+    // Minimum (sum of sizes / largest size) for a range of small, fresh
+    // parts, i.e. roughly how many similar parts are merged at once. It is
+    // lowered towards 2 as the merged size and the parts' age grow, so large
+    // and old parts still get merged, just less eagerly.
+    double base = 5.0;
+    size_t min_size_to_lower_base = 1024 * 1024;
+    size_t max_size_to_lower_base = 100ull * 1024 * 1024 * 1024;
+    uint64_t lower_base_after_seconds_min = 300;
+    uint64_t lower_base_after_seconds_max = 86400;
+    // Added to every part's size, making merges of many tiny parts cheap
+    // relative to their benefit.
+    size_t size_fixed_cost_to_add = 5 * 1024 * 1024;
+    size_t max_parts_to_merge_at_once = 100;
+    // Parts (and merge results) above this size are left alone, which
+    // bounds how often a row is rewritten.
+    size_t max_bytes_to_merge = 150ull * 1024 * 1024 * 1024;
+};
+
+struct MergeSelectorPart {
+    size_t size;
+    uint64_t age_seconds;
+    // Position of the part in the caller's part list.
+    size_t index;
+};
+
+// Port of ClickHouse's SimpleMergeSelector. Given ranges of parts that may
+// be merged together (one per partition, in insertion order), it picks the
+// contiguous run with the lowest (sum_size + fixed_cost * count) / (count - 1.9)
+// among runs whose size ratio passes the base check. This yields
+// size-tiered merging: similar small parts merge first and a part is
+// rewritten about log_base(final size / insert size) times.
+class SimpleMergeSelector {
+public:
+    using PartsRange = std::vector<MergeSelectorPart>;
+
+private:
+    MergeSelectorSettings settings_;
+
+public:
+    explicit SimpleMergeSelector(const MergeSelectorSettings& settings = MergeSelectorSettings());
+
+    const MergeSelectorSettings& settings() const { return settings_; }
+
+    // Returns the chosen run of at least two parts, or an empty range.
+    PartsRange select(const std::vector<PartsRange>& ranges) const;
+
+private:
+    bool allow(double sum_size, double max_size, double min_age, size_t count) const;
+
+    double score(size_t count, double sum_size) const;
+};
+
+}  // namespace clickhouse
@@ -2,18 +2,106 @@
 #include <filesystem>
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <exception>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <unordered_set>
 
 namespace clickhouse {
 
+namespace {
+
+std::shared_ptr<const AggregateFunction> aggregate_function_for(const MergeTreeConfig& config) {
+    if (config.merge_mode != MergeMode::Aggregating) {
+        return nullptr;
+    }
+    return create_aggregate_function(config.aggregate_function);
+}
+
+// The predicate parts and the memtable apply while scanning: the key
+// sample, which keeps or drops whole keys and so commutes with FINAL, and
+// the prewhere unless FINAL defers it to the collapsed rows.
+std::optional<Predicate> scan_predicate(const QueryOptions& options) {
+    std::optional<Predicate> prewhere;
+    if (options.prewhere && !options.final) {
+        prewhere = options.prewhere;
+    }
+    if (options.sample >= 1) {
+        return prewhere;
+    }
+    Predicate sample = Predicate::key_sample(options.sample);
+    if (!prewhere) {
+        return sample;
+    }
+    return Predicate::all_of({sample, *prewhere});
+}
+
+// Startup only spreads part opening over threads once each gets this many.
+constexpr size_t STARTUP_PARTS_PER_THREAD = 64;
+
+// Counts a running query for as long as it is in scope.
+class ActiveQuery {
+private:
+    std::atomic<size_t>& counter_;
+
+public:
+    explicit ActiveQuery(std::atomic<size_t>& counter) : counter_(counter) { ++counter_; }
+    ~ActiveQuery() { --counter_; }
+
+    ActiveQuery(const ActiveQuery&) = delete;
+    ActiveQuery& operator=(const ActiveQuery&) = delete;
+};
+
+}  // namespace
+
 MergeTree::MergeTree(const std::string& base_path, const MergeTreeConfig& config)
-    : config_(config), base_path_(base_path), merger_(base_path), shutdown_(false) {
+    : config_(config), base_path_(base_path),
+      partition_key_(config.partition_granularity, config.timestamp_units_per_second),
+      memtable_(std::make_shared<MemTable>()),
+      merger_(base_path, config.merge_mode, aggregate_function_for(config), config.merge_selector),
+      max_parts_in_partition_(0), delayed_inserts_(0), delayed_time_us_(0), blocked_inserts_(0),
+      blocked_time_us_(0), rejected_inserts_(0), active_queries_(0),
+      skip_index_granules_checked_(0), skip_index_granules_skipped_(0), mutation_counter_(0), mutations_waiting_(0), shutdown_(false), merge_signal_(0) {
+
+    merger_.set_vertical_merge_min_rows(config_.vertical_merge_min_rows);
+    // Rejects bad index descriptions here rather than on the first flush.
+    for (const auto& description : config_.skip_indexes) {
+        create_skip_index(description);
+    }
+    merger_.set_skip_indexes(config_.skip_indexes);
+    size_t slice_threads = config_.merge_slice_threads;
+    if (slice_threads == 0) {
+        slice_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    merger_.set_parallel_merge(config_.parallel_merge_min_rows, slice_threads);
+
+    std::shared_ptr<Throttler> read_throttler;
+    std::shared_ptr<Throttler> write_throttler;
+    if (config_.merge_max_read_bytes_per_second > 0) {
+        read_throttler = std::make_shared<Throttler>(config_.merge_max_read_bytes_per_second);
+    }
+    if (config_.merge_max_write_bytes_per_second > 0) {
+        write_throttler = std::make_shared<Throttler>(config_.merge_max_write_bytes_per_second);
+    }
+    merger_.set_io_limits(read_throttler, write_throttler);
+
+    if (config_.merge_yield_queries_threshold > 0) {
+        merger_.set_yield_condition(
+            [this] { return active_queries_ >= config_.merge_yield_queries_threshold; });
+    }
 
     create_base_directory();
     load_existing_parts();
 
     if (config_.enable_background_merge) {
-        background_thread_ = std::thread(&MergeTree::background_merge_worker, this);
+        size_t threads = std::max<size_t>(1, config_.merge_threads);
+        for (size_t i = 0; i < threads; ++i) {
+            background_threads_.emplace_back(&MergeTree::background_merge_worker, this);
+        }
     }
 }
 
@@ -26,68 +114,562 @@ void MergeTree::insert(const std::string& key, const std::string& value, uint64_
 }
 
 void MergeTree::insert(const Row& row) {
-    {
+    check_too_many_parts();
+
+    if (const AggregateFunction* function = merger_.aggregate_function()) {
+        Row state_row(row.key, function->make_state(row.value), row.timestamp);
+        std::lock_guard<std::mutex> lock(memtable_mutex_);
+        memtable_->insert(state_row);
+    } else {
         std::lock_guard<std::mutex> lock(memtable_mutex_);
-        memtable_.insert(row);
+        memtable_->insert(row);
     }
 
     trigger_flush_if_needed();
 }
 
+void MergeTree::cancel(const std::string& key, const std::string& value, uint64_t timestamp) {
+    if (merger_.mode() != MergeMode::Collapsing) {
+        throw std::logic_error("cancel() requires the Collapsing merge mode");
+    }
+    insert(Row(key, value, timestamp, -1));
+}
+
 RowVector MergeTree::query(const std::string& start_key, const std::string& end_key) {
+    return query(start_key, end_key, 0, UINT64_MAX);
+}
+
+RowVector MergeTree::query(const std::string& start_key, const std::string& end_key,
+                           uint64_t ts_from, uint64_t ts_to) {
+    QueryOptions options;
+    options.ts_from = ts_from;
+    options.ts_to = ts_to;
+    return query(start_key, end_key, options);
+}
+
+RowVector MergeTree::query(const std::string& start_key, const std::string& end_key,
+                           const QueryOptions& options) {
+    ActiveQuery active_query(active_queries_);
+    auto sources = collect_sources(start_key, end_key, options);
+
+    if (options.final) {
+        MergeIterator iterator(std::move(sources));
+        RowVector result = merger_.collapse_rows(iterator);
+        merger_.finalize_rows(result);
+        result.erase(std::remove_if(result.begin(), result.end(), [&](const Row& row) {
+            return (options.value_filter && !options.value_filter->matches(row.value)) ||
+                   (options.prewhere && !options.prewhere->matches(row));
+        }), result.end());
+        return result;
+    }
+
     RowVector result;
+    for (auto& source : sources) {
+        result.insert(result.end(), std::make_move_iterator(source.begin()),
+                      std::make_move_iterator(source.end()));
+    }
+
+    std::sort(result.begin(), result.end());
+
+    // Rows sharing (key, timestamp) are distinct contributions when values
+    // are folded, so only drop them for Ordinary and Replacing tables.
+    if (!merger_.aggregate_function()) {
+        result.erase(std::unique(result.begin(), result.end(),
+            [](const Row& a, const Row& b) {
+                return a.key == b.key && a.timestamp == b.timestamp && a.sign == b.sign;
+            }), result.end());
+    }
+
+    return result;
+}
+
+RowVector MergeTree::query_key(const std::string& key) {
+    return query(key, key);
+}
+
+RowVector MergeTree::query_key(const std::string& key, const QueryOptions& options) {
+    return query(key, key, options);
+}
+
+std::vector<AggregateGroup> MergeTree::group_by(const std::string& start_key, const std::string& end_key,
+                                                const GroupBySpec& spec, const QueryOptions& options) {
+    if (options.final) {
+        throw std::invalid_argument("group_by does not support final");
+    }
+
+    ActiveQuery active_query(active_queries_);
+    const ValueCondition* value_filter = options.value_filter ? &*options.value_filter : nullptr;
+    std::optional<Predicate> scan_filter = scan_predicate(options);
+    const Predicate* prewhere = scan_filter ? &*scan_filter : nullptr;
+    std::vector<GroupByTable> tables;
+
+    // Every row is counted once, whether a racing flush has moved it to a
+    // part or not. Parts are aggregated from the snapshot without
+    // parts_mutex_, so flushes and merges go on meanwhile.
+    ReadSnapshot snapshot = read_snapshot(start_key, end_key, options);
+    size_t thread_count = config_.max_query_threads;
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (spec.threads != 0) {
+        thread_count = std::min(thread_count, spec.threads);
+    }
+    thread_count = std::max<size_t>(1, std::min(thread_count, snapshot.parts.size()));
+
+    tables.reserve(thread_count);
+    for (size_t t = 0; t < thread_count; ++t) {
+        tables.emplace_back(spec.expected_groups);
+    }
+    std::vector<SkipIndexStats> skip_stats(thread_count);
+    std::atomic<size_t> next_part{0};
+
+    auto aggregate_parts = [&](size_t t) {
+        for (size_t i = next_part++; i < snapshot.parts.size(); i = next_part++) {
+            snapshot.parts[i]->aggregate(start_key, end_key, options.ts_from, options.ts_to, spec, tables[t],
+                                         prewhere, value_filter, &skip_stats[t]);
+        }
+    };
+
+    if (thread_count == 1) {
+        aggregate_parts(0);
+    } else {
+        std::vector<std::exception_ptr> errors(thread_count);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&, t] {
+                try {
+                    aggregate_parts(t);
+                } catch (...) {
+                    errors[t] = std::current_exception();
+                    next_part = snapshot.parts.size();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    for (const auto& stats : skip_stats) {
+        skip_index_granules_checked_ += stats.granules_checked;
+        skip_index_granules_skipped_ += stats.granules_skipped;
+    }
+
+    for (const auto& rows : snapshot.memtable_rows) {
+        for (const auto& row : rows) {
+            if ((!value_filter || value_filter->matches(row.value)) && (!prewhere || prewhere->matches(row))) {
+                tables[0].add(spec.group_of(row.key), row.value, row.sign);
+            }
+        }
+    }
+
+    for (size_t t = 1; t < tables.size(); ++t) {
+        tables[0].merge(tables[t]);
+    }
+
+    auto groups = tables[0].result();
+    if (options.sample < 1) {
+        double scale = 1 / options.sample;
+        for (auto& group : groups) {
+            group.count = std::llround(static_cast<double>(group.count) * scale);
+            group.numeric_count = std::llround(static_cast<double>(group.numeric_count) * scale);
+            group.sum *= scale;
+        }
+    }
+    return groups;
+}
+
+RowSketches MergeTree::sketches(const std::string& start_key, const std::string& end_key) {
+    ActiveQuery active_query(active_queries_);
+    RowSketches result;
+    ReadSnapshot snapshot = read_snapshot(start_key, end_key, QueryOptions());
+    for (const auto& part : snapshot.parts) {
+        part->add_sketches(start_key, end_key, result);
+    }
+    for (const auto& rows : snapshot.memtable_rows) {
+        for (const auto& row : rows) {
+            result.add(row.key, row.value);
+        }
+    }
+    return result;
+}
+
+uint64_t MergeTree::approx_distinct_keys(const std::string& start_key, const std::string& end_key) {
+    return sketches(start_key, end_key).keys.estimate();
+}
+
+std::vector<double> MergeTree::approx_value_quantiles(const std::string& start_key, const std::string& end_key,
+                                                      const std::vector<double>& levels) {
+    RowSketches result = sketches(start_key, end_key);
+    std::vector<double> quantiles;
+    quantiles.reserve(levels.size());
+    for (double level : levels) {
+        quantiles.push_back(result.values.quantile(level));
+    }
+    return quantiles;
+}
+
+std::vector<Part*> MergeTree::find_query_parts(const std::string& start_key, const std::string& end_key,
+                                               const QueryOptions& options) {
+    std::vector<Part*> candidates;
+    if (!config_.enable_part_key_index) {
+        for (auto& part : parts_) {
+            candidates.push_back(part.get());
+        }
+    } else {
+        candidates = start_key == end_key ? part_key_index_.find_key(start_key)
+                                          : part_key_index_.find_overlapping(start_key, end_key);
+    }
+
+    std::map<std::string, bool> partition_matches;
+    std::vector<Part*> result;
+    for (Part* part : candidates) {
+        auto it = partition_matches.find(part->partition_id());
+        if (it == partition_matches.end()) {
+            bool matches = partition_key_.overlaps_time_range(part->partition_id(), options.ts_from, options.ts_to);
+            it = partition_matches.emplace(part->partition_id(), matches).first;
+        }
+        if (it->second && part->overlaps_range(start_key, end_key) &&
+            part->overlaps_time_range(options.ts_from, options.ts_to)) {
+            result.push_back(part);
+        }
+    }
+    return result;
+}
+
+MergeTree::ReadSnapshot MergeTree::read_snapshot(const std::string& start_key, const std::string& end_key,
+                                                 const QueryOptions& options) {
+    ReadSnapshot snapshot;
+    snapshot.retire_lock = std::shared_lock<std::shared_mutex>(retire_mutex_);
+
+    // A flush moves its rows from flushing_memtables_ to parts_ holding both
+    // locks, so parts_mutex_ is taken before memtable_mutex_ is released.
+    std::lock_guard<std::mutex> memtable_lock(memtable_mutex_);
+    for (const auto& flushing : flushing_memtables_) {
+        snapshot.memtable_rows.push_back(flushing.memtable->query(start_key, end_key, options.ts_from, options.ts_to));
+    }
+    snapshot.memtable_rows.push_back(memtable_->query(start_key, end_key, options.ts_from, options.ts_to));
+
+    std::lock_guard<std::mutex> parts_lock(parts_mutex_);
+    for (Part* part : find_query_parts(start_key, end_key, options)) {
+        snapshot.parts.push_back(part->shared_from_this());
+    }
+    return snapshot;
+}
+
+std::vector<RowVector> MergeTree::collect_sources(const std::string& start_key, const std::string& end_key,
+                                                  const QueryOptions& options) {
+    std::vector<RowVector> sources;
+
+    // Under FINAL a row may be replaced by one that fails the filters, so
+    // they are applied only after collapsing.
+    const ValueCondition* value_filter =
+        options.value_filter && !options.final ? &*options.value_filter : nullptr;
+    std::optional<Predicate> scan_filter = scan_predicate(options);
+    const Predicate* prewhere = scan_filter ? &*scan_filter : nullptr;
+    SkipIndexStats skip_stats;
+
+    // Every row is seen exactly once, which Summing, Aggregating and
+    // Collapsing tables rely on; the parts are read from the snapshot
+    // without parts_mutex_.
+    ReadSnapshot snapshot = read_snapshot(start_key, end_key, options);
+    for (const auto& part : snapshot.parts) {
+        RowVector part_results;
+        if (prewhere) {
+            part_results = part->query(start_key, end_key, options.ts_from, options.ts_to, *prewhere,
+                                       value_filter, &skip_stats);
+        } else if (value_filter) {
+            part_results = part->query(start_key, end_key, options.ts_from, options.ts_to, *value_filter,
+                                       &skip_stats);
+        } else {
+            part_results = part->query(start_key, end_key, options.ts_from, options.ts_to);
+        }
+        if (!part_results.empty()) {
+            sources.push_back(std::move(part_results));
+        }
+    }
+
+    skip_index_granules_checked_ += skip_stats.granules_checked;
+    skip_index_granules_skipped_ += skip_stats.granules_skipped;
+
+    for (auto& memtable_results : snapshot.memtable_rows) {
+        if (value_filter || prewhere) {
+            memtable_results.erase(std::remove_if(memtable_results.begin(), memtable_results.end(),
+                [&](const Row& row) {
+                    return (value_filter && !value_filter->matches(row.value)) ||
+                           (prewhere && !prewhere->matches(row));
+                }), memtable_results.end());
+        }
+        if (!memtable_results.empty()) {
+            sources.push_back(std::move(memtable_results));
+        }
+    }
+
+    return sources;
+}
+
+size_t MergeTree::delete_range(const std::string& start_key, const std::string& end_key) {
+    size_t deleted = 0;
 
     {
         std::lock_guard<std::mutex> lock(memtable_mutex_);
-        auto memtable_results = memtable_.query(start_key, end_key);
-        result.insert(result.end(), memtable_results.begin(), memtable_results.end());
+        deleted += memtable_->erase_range(start_key, end_key);
+
+        // A flush under way may have read its rows already, so the range is
+        // also replayed on its parts before they are published.
+        for (auto& flushing : flushing_memtables_) {
+            deleted += flushing.memtable->erase_range(start_key, end_key);
+            flushing.deleted_ranges.emplace_back(start_key, end_key);
+        }
     }
 
     {
         std::lock_guard<std::mutex> lock(parts_mutex_);
         for (auto& part : parts_) {
             if (part->overlaps_range(start_key, end_key)) {
-                auto part_results = part->query(start_key, end_key);
-                result.insert(result.end(), part_results.begin(), part_results.end());
+                deleted += part->delete_range(start_key, end_key);
             }
         }
+
+        // A merge in flight may have read its inputs before the mask was
+        // written, so the range is applied to its output as well.
+        for (ActiveMerge* merge : active_merges_) {
+            merge->deleted_ranges.emplace_back(start_key, end_key);
+        }
     }
 
-    std::sort(result.begin(), result.end());
-    result.erase(std::unique(result.begin(), result.end(),
-        [](const Row& a, const Row& b) {
-            return a.key == b.key && a.timestamp == b.timestamp;
-        }), result.end());
+    return deleted;
+}
 
-    return result;
+size_t MergeTree::mutate_update(const std::string& start_key, const std::string& end_key,
+                                std::function<std::string(const Row&)> update,
+                                std::function<bool(const Row&)> predicate) {
+    if (!update) {
+        throw std::invalid_argument("UPDATE mutation requires an update function");
+    }
+
+    Mutation mutation;
+    mutation.type = MutationType::Update;
+    mutation.start_key = start_key;
+    mutation.end_key = end_key;
+    mutation.predicate = std::move(predicate);
+    mutation.update = std::move(update);
+    return submit_mutation(std::move(mutation));
 }
 
-RowVector MergeTree::query_key(const std::string& key) {
-    return query(key, key);
+size_t MergeTree::mutate_delete(const std::string& start_key, const std::string& end_key,
+                                std::function<bool(const Row&)> predicate) {
+    Mutation mutation;
+    mutation.type = MutationType::Delete;
+    mutation.start_key = start_key;
+    mutation.end_key = end_key;
+    mutation.predicate = std::move(predicate);
+    return submit_mutation(std::move(mutation));
+}
+
+size_t MergeTree::pending_mutations() const {
+    std::lock_guard<std::mutex> lock(mutations_mutex_);
+    return mutations_.size();
+}
+
+bool MergeTree::is_mutation_done(size_t mutation_id) const {
+    std::lock_guard<std::mutex> lock(mutations_mutex_);
+    return mutations_.empty() || mutations_.front().id > mutation_id;
+}
+
+void MergeTree::apply_mutations() {
+    while (process_mutation()) {
+    }
+}
+
+size_t MergeTree::submit_mutation(Mutation mutation) {
+    // Rows already inserted must be in parts older than the mutation.
+    flush_memtable();
+
+    size_t mutation_id;
+    {
+        // New flushes wait for this one; those already under way publish
+        // their parts first.
+        std::unique_lock<std::mutex> memtable_lock(memtable_mutex_);
+        ++mutations_waiting_;
+        flushes_cv_.wait(memtable_lock, [this] { return flushing_memtables_.empty(); });
+        --mutations_waiting_;
+
+        std::lock_guard<std::mutex> lock(mutations_mutex_);
+        mutation_id = ++mutation_counter_;
+        mutation.id = mutation_id;
+        mutations_.push_back(std::move(mutation));
+    }
+    flushes_cv_.notify_all();
+
+    wake_merge_workers();
+
+    return mutation_id;
+}
+
+bool MergeTree::process_mutation() {
+    std::lock_guard<std::mutex> execution_lock(mutation_execution_mutex_);
+
+    Mutation mutation;
+    {
+        std::lock_guard<std::mutex> lock(mutations_mutex_);
+        if (mutations_.empty()) {
+            return false;
+        }
+        mutation = mutations_.front();
+    }
+
+    while (true) {
+        // Each outdated part is rewritten as a single-part merge, so merges
+        // leave it alone and deletes arriving meanwhile are replayed.
+        std::vector<ActiveMerge> rewrites;
+        {
+            std::unique_lock<std::mutex> lock(parts_mutex_);
+            bool outdated_reserved = false;
+
+            for (const auto& part : parts_) {
+                if (part->metadata().mutation_version >= mutation.id) {
+                    continue;
+                }
+                if (reserved_parts_.count(part.get())) {
+                    outdated_reserved = true;
+                } else {
+                    rewrites.emplace_back();
+                    rewrites.back().parts.push_back(part);
+                }
+            }
+
+            if (rewrites.empty()) {
+                if (!outdated_reserved) {
+                    break;
+                }
+                // Outdated parts are being merged; their output is picked up
+                // on the next pass.
+                reservations_cv_.wait(lock);
+                continue;
+            }
+
+            for (auto& rewrite : rewrites) {
+                begin_merge(rewrite);
+            }
+        }
+
+        size_t next = 0;
+        try {
+            for (; next < rewrites.size(); ++next) {
+                auto& rewrite = rewrites[next];
+                const auto& part = rewrite.parts[0];
+
+                if (!part->overlaps_range(mutation.start_key, mutation.end_key)) {
+                    {
+                        std::lock_guard<std::mutex> lock(parts_mutex_);
+                        part->set_mutation_version(mutation.id);
+                    }
+                    part->save_metadata();
+                    cancel_merge(rewrite);
+                    continue;
+                }
+
+                auto mutated_part = std::make_shared<Part>(get_next_part_id(), base_path_, part->partition_id());
+                mutated_part->set_skip_indexes(config_.skip_indexes);
+                try {
+                    mutated_part->write_mutation(*part, mutation);
+                } catch (...) {
+                    std::error_code ec;
+                    std::filesystem::remove_all(mutated_part->part_directory(), ec);
+                    throw;
+                }
+
+                if (mutated_part->metadata().row_count == 0) {
+                    mutated_part.reset();
+                }
+                commit_merge(rewrite, std::move(mutated_part));
+            }
+        } catch (...) {
+            for (; next < rewrites.size(); ++next) {
+                cancel_merge(rewrites[next]);
+            }
+            throw;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutations_mutex_);
+        mutations_.pop_front();
+    }
+
+    return true;
 }
 
 void MergeTree::flush_memtable() {
-    RowVector rows;
+    std::list<FlushingMemTable>::iterator flushing;
+    size_t mutation_version;
     {
-        std::lock_guard<std::mutex> lock(memtable_mutex_);
-        if (memtable_.empty()) {
+        std::unique_lock<std::mutex> lock(memtable_mutex_);
+        flushes_cv_.wait(lock, [this] { return mutations_waiting_ == 0; });
+        if (memtable_->empty()) {
             return;
         }
-        rows = memtable_.get_all_rows();
-        memtable_.clear();
-    }
+        flushing = flushing_memtables_.insert(flushing_memtables_.end(), FlushingMemTable{memtable_, {}});
+        memtable_ = std::make_shared<MemTable>();
 
-    if (rows.empty()) {
-        return;
+        std::lock_guard<std::mutex> mutations_lock(mutations_mutex_);
+        mutation_version = mutation_counter_;
     }
 
-    auto new_part = std::make_unique<Part>(get_next_part_id(), base_path_);
-    new_part->write_from_memtable_rows(rows);
+    std::vector<std::shared_ptr<Part>> new_parts;
+    try {
+        std::map<std::string, RowVector> rows_by_partition;
+        for (auto& row : flushing->memtable->get_all_rows()) {
+            rows_by_partition[partition_key_.partition_id(row.timestamp)].push_back(std::move(row));
+        }
 
+        for (const auto& [partition_id, partition_rows] : rows_by_partition) {
+            auto new_part = std::make_shared<Part>(get_next_part_id(), base_path_, partition_id);
+            new_part->set_mutation_version(mutation_version);
+            new_part->set_skip_indexes(config_.skip_indexes);
+            new_part->write_from_memtable_rows(partition_rows);
+            new_parts.push_back(std::move(new_part));
+        }
+    } catch (...) {
+        for (auto& part : new_parts) {
+            part->delete_from_disk();
+        }
+        {
+            std::lock_guard<std::mutex> lock(memtable_mutex_);
+            flushing_memtables_.erase(flushing);
+        }
+        flushes_cv_.notify_all();
+        throw;
+    }
+
+    // The parts join parts_ as the rows leave flushing_memtables_, so no
+    // reader holding both locks sees them twice or misses them.
     {
-        std::lock_guard<std::mutex> lock(parts_mutex_);
-        parts_.push_back(std::move(new_part));
+        std::lock_guard<std::mutex> lock(memtable_mutex_);
+        {
+            std::lock_guard<std::mutex> parts_lock(parts_mutex_);
+            for (auto& part : new_parts) {
+                for (const auto& [start_key, end_key] : flushing->deleted_ranges) {
+                    part->delete_range(start_key, end_key);
+                }
+                if (config_.enable_part_key_index) {
+                    part_key_index_.add(part.get());
+                }
+                parts_.push_back(std::move(part));
+            }
+            on_parts_changed();
+        }
+        flushing_memtables_.erase(flushing);
     }
+    flushes_cv_.notify_all();
+
+    wake_merge_workers();
 }
 
 void MergeTree::merge_parts_sync() {
@@ -103,8 +685,10 @@ void MergeTree::shutdown() {
         }
         background_cv_.notify_all();
 
-        if (background_thread_.joinable()) {
-            background_thread_.join();
+        for (auto& thread : background_threads_) {
+            if (thread.joinable()) {
+                thread.join();
+            }
         }
 
         flush_memtable();
@@ -116,19 +700,36 @@ size_t MergeTree::part_count() const {
     return parts_.size();
 }
 
+MergeTreeMetrics MergeTree::metrics() const {
+    MergeTreeMetrics result;
+    result.max_parts_in_partition = max_parts_in_partition_;
+    result.delayed_inserts = delayed_inserts_;
+    result.delayed_time_us = delayed_time_us_;
+    result.blocked_inserts = blocked_inserts_;
+    result.blocked_time_us = blocked_time_us_;
+    result.rejected_inserts = rejected_inserts_;
+    result.merge_bytes_read = merger_.bytes_read();
+    result.merge_bytes_written = merger_.bytes_written();
+    result.merge_read_throttled_us = merger_.read_throttled_microseconds();
+    result.merge_write_throttled_us = merger_.write_throttled_microseconds();
+    result.merge_yield_us = merger_.yield_microseconds();
+    result.skip_index_granules_checked = skip_index_granules_checked_;
+    result.skip_index_granules_skipped = skip_index_granules_skipped_;
+    return result;
+}
+
 size_t MergeTree::total_rows() const {
     size_t total = 0;
 
-    {
-        std::lock_guard<std::mutex> lock(memtable_mutex_);
-        total += memtable_.size();
+    std::lock_guard<std::mutex> memtable_lock(memtable_mutex_);
+    total += memtable_->size();
+    for (const auto& flushing : flushing_memtables_) {
+        total += flushing.memtable->size();
     }
 
-    {
-        std::lock_guard<std::mutex> lock(parts_mutex_);
-        for (const auto& part : parts_) {
-            total += part->metadata().row_count;
-        }
+    std::lock_guard<std::mutex> parts_lock(parts_mutex_);
+    for (const auto& part : parts_) {
+        total += part->live_row_count();
     }
 
     return total;
@@ -139,7 +740,10 @@ size_t MergeTree::memory_usage() const {
 
     {
         std::lock_guard<std::mutex> lock(memtable_mutex_);
-        total += memtable_.memory_usage();
+        total += memtable_->memory_usage();
+        for (const auto& flushing : flushing_memtables_) {
+            total += flushing.memtable->memory_usage();
+        }
     }
 
     {
@@ -166,58 +770,194 @@ void MergeTree::load_existing_parts() {
         return;
     }
 
-    std::vector<size_t> part_ids;
+    struct PartLocation {
+        size_t part_id;
+        std::string partition_id;
+    };
+
+    std::vector<PartLocation> locations;
+
+    auto collect_parts = [&locations](const std::string& directory, const std::string& partition_id) {
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (entry.is_directory()) {
+                std::string dirname = entry.path().filename().string();
+                // Left behind by a write interrupted before its commit rename.
+                if (Part::is_temporary_directory(dirname)) {
+                    std::filesystem::remove_all(entry.path());
+                    continue;
+                }
+                if (dirname.substr(0, 5) == "part_") {
+                    std::string id_str = dirname.substr(5);
+                    try {
+                        size_t part_id = std::stoull(id_str);
+                        locations.push_back({part_id, partition_id});
+                    } catch (...) {
+                    }
+                }
+            }
+        }
+    };
+
+    collect_parts(base_path_, "");
 
     for (const auto& entry : std::filesystem::directory_iterator(base_path_)) {
         if (entry.is_directory()) {
             std::string dirname = entry.path().filename().string();
-            if (dirname.substr(0, 5) == "part_") {
-                std::string id_str = dirname.substr(5);
+            if (dirname.substr(0, 10) == "partition_") {
+                collect_parts(entry.path().string(), dirname.substr(10));
+            }
+        }
+    }
+
+    std::sort(locations.begin(), locations.end(),
+        [](const PartLocation& a, const PartLocation& b) { return a.part_id < b.part_id; });
+
+    // Opening a part reads a few small files, so with many parts startup is
+    // bound by file latency; workers claim parts from a shared counter.
+    std::vector<std::shared_ptr<Part>> opened(locations.size());
+    std::atomic<size_t> next_location(0);
+
+    auto open_parts = [&] {
+        for (size_t i = next_location++; i < locations.size(); i = next_location++) {
+            auto part = std::make_shared<Part>(locations[i].part_id, base_path_, locations[i].partition_id);
+            if (part->exists_on_disk()) {
+                part->open();
+                opened[i] = std::move(part);
+            }
+        }
+    };
+
+    size_t thread_count = config_.startup_threads;
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    thread_count = std::min(thread_count, locations.size() / STARTUP_PARTS_PER_THREAD + 1);
+
+    if (thread_count <= 1) {
+        open_parts();
+    } else {
+        std::vector<std::exception_ptr> errors(thread_count);
+        std::vector<std::thread> threads;
+
+        for (size_t t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&, t] {
                 try {
-                    size_t part_id = std::stoull(id_str);
-                    part_ids.push_back(part_id);
+                    open_parts();
                 } catch (...) {
+                    errors[t] = std::current_exception();
+                    next_location = locations.size();
                 }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
             }
         }
     }
 
-    std::sort(part_ids.begin(), part_ids.end());
-
-    for (size_t part_id : part_ids) {
-        auto part = std::make_unique<Part>(part_id, base_path_);
-        if (part->exists_on_disk()) {
+    for (auto& part : opened) {
+        if (part) {
+            mutation_counter_ = std::max(mutation_counter_, part->metadata().mutation_version);
+            if (config_.enable_part_key_index) {
+                part_key_index_.add(part.get());
+            }
             parts_.push_back(std::move(part));
         }
     }
+    on_parts_changed();
 
-    if (!part_ids.empty()) {
-        merger_.set_next_part_id(part_ids.back() + 1);
+    if (!locations.empty()) {
+        merger_.set_next_part_id(locations.back().part_id + 1);
     }
 }
 
 void MergeTree::optimize() {
     flush_memtable();
+    apply_mutations();
+    apply_ttl();
 
+    // Background merges may hold the parts needed to get under max_parts,
+    // so wait for them before giving up.
     while (should_trigger_merge()) {
-        perform_merge();
+        if (!perform_merge() && !wait_for_active_merges()) {
+            break;
+        }
     }
 }
 
+std::vector<std::string> MergeTree::partition_ids() const {
+    std::set<std::string> ids;
+    {
+        std::lock_guard<std::mutex> lock(parts_mutex_);
+        for (const auto& part : parts_) {
+            ids.insert(part->partition_id());
+        }
+    }
+    return std::vector<std::string>(ids.begin(), ids.end());
+}
+
+void MergeTree::drop_partition(const std::string& partition_id) {
+    if (partition_id.empty()) {
+        throw std::invalid_argument("Cannot drop the unnamed partition");
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(parts_mutex_);
+
+        while (true) {
+            bool merging = false;
+            parts_.erase(std::remove_if(parts_.begin(), parts_.end(),
+                [this, &partition_id, &merging](const std::shared_ptr<Part>& part) {
+                    if (part->partition_id() != partition_id) {
+                        return false;
+                    }
+                    if (reserved_parts_.count(part.get())) {
+                        merging = true;
+                        return false;
+                    }
+                    if (config_.enable_part_key_index) {
+                        part_key_index_.remove(part.get());
+                    }
+                    return true;
+                }), parts_.end());
+            on_parts_changed();
+
+            if (!merging) {
+                break;
+            }
+            // Running merges finish first; their output is dropped next pass.
+            reservations_cv_.wait(lock);
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> retire_lock(retire_mutex_);
+    std::filesystem::remove_all(Part::partition_directory(base_path_, partition_id));
+}
+
 void MergeTree::background_merge_worker() {
+    size_t seen_signal = 0;
+
     while (!shutdown_) {
         {
             std::unique_lock<std::mutex> lock(background_mutex_);
             background_cv_.wait_for(lock, std::chrono::seconds(config_.merge_interval_seconds),
-                [this] { return shutdown_.load(); });
+                [this, &seen_signal] { return shutdown_.load() || merge_signal_ != seen_signal; });
+            seen_signal = merge_signal_;
         }
 
         if (!shutdown_) {
             try {
                 trigger_flush_if_needed();
-                if (should_trigger_merge()) {
-                    perform_merge();
+                apply_ttl();
+                while (!shutdown_ && perform_merge()) {
                 }
+                process_mutation();
             } catch (const std::exception& e) {
                 std::cerr << "Background merge error: " << e.what() << std::endl;
             }
@@ -229,68 +969,290 @@ void MergeTree::trigger_flush_if_needed() {
     bool should_flush = false;
     {
         std::lock_guard<std::mutex> lock(memtable_mutex_);
-        should_flush = memtable_.size() >= config_.memtable_flush_threshold;
+        should_flush = memtable_->size() >= config_.memtable_flush_threshold;
     }
 
     if (should_flush) {
+        delay_insert_if_needed();
         flush_memtable();
     }
 }
 
+void MergeTree::check_too_many_parts() {
+    size_t hard_limit = config_.parts_to_throw_insert;
+    if (hard_limit == 0 || max_parts_in_partition_.load(std::memory_order_relaxed) < hard_limit) {
+        return;
+    }
+
+    if (!config_.block_insert_on_too_many_parts) {
+        ++rejected_inserts_;
+        throw std::runtime_error("Too many parts (" + std::to_string(max_parts_in_partition_.load()) +
+                                 ") in a partition; merges are processing significantly slower than inserts");
+    }
+
+    // Helps with merging rather than only waiting, so blocking also works
+    // without background workers.
+    auto start = std::chrono::steady_clock::now();
+    while (!shutdown_ && max_parts_in_partition_.load() >= hard_limit) {
+        if (!perform_merge() && !wait_for_active_merges()) {
+            break;
+        }
+    }
+
+    ++blocked_inserts_;
+    blocked_time_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void MergeTree::delay_insert_if_needed() {
+    size_t soft_limit = config_.parts_to_delay_insert;
+    size_t parts = max_parts_in_partition_.load(std::memory_order_relaxed);
+    if (soft_limit == 0 || parts <= soft_limit || config_.max_delay_to_insert_ms == 0) {
+        return;
+    }
+
+    size_t hard_limit = config_.parts_to_throw_insert;
+    double ratio = 1.0;
+    if (hard_limit > soft_limit) {
+        ratio = std::min(1.0, static_cast<double>(parts - soft_limit) / static_cast<double>(hard_limit - soft_limit));
+    }
+
+    auto delay = std::chrono::microseconds(static_cast<uint64_t>(ratio * config_.max_delay_to_insert_ms * 1000));
+    std::this_thread::sleep_for(delay);
+
+    ++delayed_inserts_;
+    delayed_time_us_ += delay.count();
+}
+
+void MergeTree::on_parts_changed() {
+    std::map<std::string, size_t> counts;
+    size_t max_count = 0;
+    for (const auto& part : parts_) {
+        max_count = std::max(max_count, ++counts[part->partition_id()]);
+    }
+    max_parts_in_partition_ = max_count;
+}
+
 bool MergeTree::should_trigger_merge() const {
     std::lock_guard<std::mutex> lock(parts_mutex_);
     return parts_.size() > config_.max_parts;
 }
 
-void MergeTree::perform_merge() {
-    std::vector<std::unique_ptr<Part>> parts_to_merge;
+bool MergeTree::perform_merge() {
+    ActiveMerge merge;
 
     {
         std::lock_guard<std::mutex> lock(parts_mutex_);
 
-        if (parts_.size() < 2) {
-            return;
+        if (parts_.size() < reserved_parts_.size() + 2) {
+            return false;
         }
 
-        auto candidates = merger_.select_merge_candidates(parts_, 1);
+        auto candidate = merger_.select_merge_candidate(parts_, parts_.size() > config_.max_parts, reserved_parts_);
 
-        if (candidates.empty()) {
-            return;
+        if (candidate.part_indices.empty()) {
+            return false;
         }
 
-        const auto& best_candidate = candidates[0];
+        for (size_t index : candidate.part_indices) {
+            merge.parts.push_back(parts_[index]);
+        }
+        begin_merge(merge);
+    }
 
-        std::vector<std::unique_ptr<Part>> remaining_parts;
+    std::shared_ptr<Part> merged_part;
+    try {
+        merged_part = merger_.merge_parts(merge.parts, ttl_cutoff());
+    } catch (...) {
+        cancel_merge(merge);
+        throw;
+    }
 
-        for (size_t i = 0; i < parts_.size(); ++i) {
-            bool is_selected = std::find(best_candidate.part_indices.begin(),
-                                       best_candidate.part_indices.end(), i) !=
-                              best_candidate.part_indices.end();
+    commit_merge(merge, std::move(merged_part));
+    return true;
+}
 
-            if (is_selected) {
-                parts_to_merge.push_back(std::move(parts_[i]));
-            } else {
-                remaining_parts.push_back(std::move(parts_[i]));
+void MergeTree::begin_merge(ActiveMerge& merge) {
+    for (const auto& part : merge.parts) {
+        reserved_parts_.insert(part.get());
+    }
+    active_merges_.push_back(&merge);
+}
+
+void MergeTree::release_merge(ActiveMerge& merge) {
+    for (const auto& part : merge.parts) {
+        reserved_parts_.erase(part.get());
+    }
+    active_merges_.erase(std::remove(active_merges_.begin(), active_merges_.end(), &merge),
+                         active_merges_.end());
+}
+
+void MergeTree::commit_merge(ActiveMerge& merge, std::shared_ptr<Part> merged_part) {
+    {
+        std::lock_guard<std::mutex> lock(parts_mutex_);
+
+        if (merged_part) {
+            for (const auto& [start_key, end_key] : merge.deleted_ranges) {
+                merged_part->delete_range(start_key, end_key);
             }
         }
 
+        // The merged part takes the place of its first input, keeping newer
+        // parts after it.
+        std::unordered_set<const Part*> inputs;
+        for (const auto& part : merge.parts) {
+            inputs.insert(part.get());
+        }
+
+        std::vector<std::shared_ptr<Part>> remaining_parts;
+        remaining_parts.reserve(parts_.size());
+        for (auto& part : parts_) {
+            if (!inputs.count(part.get())) {
+                remaining_parts.push_back(std::move(part));
+                continue;
+            }
+            if (merged_part) {
+                if (config_.enable_part_key_index) {
+                    part_key_index_.replace(part.get(), merged_part.get());
+                }
+                remaining_parts.push_back(std::move(merged_part));
+            } else if (config_.enable_part_key_index) {
+                part_key_index_.remove(part.get());
+            }
+        }
         parts_ = std::move(remaining_parts);
+        on_parts_changed();
+
+        release_merge(merge);
     }
 
-    if (!parts_to_merge.empty()) {
-        auto merged_part = merger_.merge_parts(std::move(parts_to_merge));
+    reservations_cv_.notify_all();
+    retire_parts(merge.parts);
+    wake_merge_workers();
+}
 
-        {
-            std::lock_guard<std::mutex> lock(parts_mutex_);
-            parts_.push_back(std::move(merged_part));
+void MergeTree::cancel_merge(ActiveMerge& merge) {
+    {
+        std::lock_guard<std::mutex> lock(parts_mutex_);
+        release_merge(merge);
+    }
+    reservations_cv_.notify_all();
+}
+
+bool MergeTree::wait_for_active_merges() {
+    std::unique_lock<std::mutex> lock(parts_mutex_);
+    if (active_merges_.empty()) {
+        return false;
+    }
+    reservations_cv_.wait(lock, [this] { return active_merges_.empty(); });
+    return true;
+}
+
+void MergeTree::wake_merge_workers() {
+    {
+        std::lock_guard<std::mutex> lock(background_mutex_);
+        ++merge_signal_;
+    }
+    background_cv_.notify_all();
+}
+
+uint64_t MergeTree::ttl_cutoff() const {
+    if (config_.ttl_seconds == 0) {
+        return 0;
+    }
+
+    uint64_t now_seconds = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (now_seconds <= config_.ttl_seconds) {
+        return 0;
+    }
+    return (now_seconds - config_.ttl_seconds) * config_.timestamp_units_per_second;
+}
+
+bool MergeTree::apply_ttl() {
+    uint64_t cutoff = ttl_cutoff();
+    if (cutoff == 0) {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<Part>> expired_parts;
+    ActiveMerge ttl_merge;
+
+    {
+        std::lock_guard<std::mutex> lock(parts_mutex_);
+
+        std::shared_ptr<Part> ttl_merge_part;
+        double best_expired_ratio = 0.0;
+
+        for (const auto& part : parts_) {
+            const auto& metadata = part->metadata();
+            if (reserved_parts_.count(part.get()) || metadata.max_timestamp < cutoff || metadata.row_count == 0) {
+                continue;
+            }
+
+            double expired_ratio = static_cast<double>(part->estimate_rows_older_than(cutoff)) /
+                                   static_cast<double>(metadata.row_count);
+            if (expired_ratio >= config_.ttl_merge_min_expired_ratio && expired_ratio > best_expired_ratio) {
+                best_expired_ratio = expired_ratio;
+                ttl_merge_part = part;
+            }
+        }
+
+        // Parts being merged are skipped; the merge drops their expired rows.
+        std::vector<std::shared_ptr<Part>> remaining_parts;
+        for (auto& part : parts_) {
+            if (part->metadata().max_timestamp < cutoff && !reserved_parts_.count(part.get())) {
+                if (config_.enable_part_key_index) {
+                    part_key_index_.remove(part.get());
+                }
+                expired_parts.push_back(std::move(part));
+            } else {
+                remaining_parts.push_back(std::move(part));
+            }
+        }
+        parts_ = std::move(remaining_parts);
+        on_parts_changed();
+
+        if (ttl_merge_part) {
+            ttl_merge.parts.push_back(std::move(ttl_merge_part));
+            begin_merge(ttl_merge);
+        }
+    }
+
+    retire_parts(expired_parts);
+
+    if (!ttl_merge.parts.empty()) {
+        std::shared_ptr<Part> rewritten_part;
+        try {
+            rewritten_part = merger_.merge_parts(ttl_merge.parts, cutoff);
+        } catch (...) {
+            cancel_merge(ttl_merge);
+            throw;
+        }
+
+        commit_merge(ttl_merge, std::move(rewritten_part));
+    }
+
+    return !expired_parts.empty() || !ttl_merge.parts.empty();
+}
+
+void MergeTree::retire_parts(const std::vector<std::shared_ptr<Part>>& parts) {
+    std::unique_lock<std::shared_mutex> retire_lock(retire_mutex_);
+    for (auto& part : parts) {
+        part->delete_from_disk();
+
+        if (!part->partition_id().empty()) {
+            std::string partition_dir = Part::partition_directory(base_path_, part->partition_id());
+            std::error_code ec;
+            if (std::filesystem::is_empty(partition_dir, ec)) {
+                std::filesystem::remove(partition_dir, ec);
+            }
         }
     }
 }
 
-size_t MergeTree::get_next_part_id() const {
-    size_t id = merger_.get_next_part_id();
-    const_cast<Merger&>(merger_).set_next_part_id(id + 1);
-    return id;
+size_t MergeTree::get_next_part_id() {
+    return merger_.allocate_part_id();
 }
 
 void MergeTree::create_base_directory() {
@@ -4,12 +4,22 @@
 #include "memtable.h"
 #include "part.h"
 #include "merger.h"
+#include "partition.h"
+#include "mutation.h"
+#include "part_key_index.h"
 #include <vector>
+#include <deque>
+#include <list>
 #include <memory>
+#include <functional>
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
 #include <condition_variable>
 #include <atomic>
+#include <utility>
+#include <optional>
+#include <unordered_set>
 
 namespace clickhouse {
 
@@ -18,26 +28,194 @@ struct MergeTreeConfig {
     size_t max_parts = 10;
     size_t merge_interval_seconds = 30;
     bool enable_background_merge = true;
+    // Background workers; each runs merges over parts no other merge has
+    // reserved. Workers also wake up whenever a part is flushed or merged.
+    size_t merge_threads = 2;
+    // Finds the parts a query touches through a table-wide interval tree of
+    // part key ranges (and, for point lookups, per-part key bloom filters)
+    // instead of checking every part.
+    bool enable_part_key_index = true;
+    // Threads opening existing parts (metadata, sparse index, row mask) at
+    // startup; 0 uses one per core.
+    size_t startup_threads = 0;
+    // Most threads one group_by call aggregates parts on (0: one per core);
+    // GroupBySpec::threads may ask for fewer.
+    size_t max_query_threads = 0;
+    PartitionGranularity partition_granularity = PartitionGranularity::None;
+    uint64_t timestamp_units_per_second = 1;
+    // Rows older than ttl_seconds (by Row::timestamp) are removed: expired
+    // parts are dropped whole and a part whose estimated expired fraction
+    // reaches ttl_merge_min_expired_ratio is rewritten without them. 0 disables.
+    uint64_t ttl_seconds = 0;
+    double ttl_merge_min_expired_ratio = 0.5;
+    MergeMode merge_mode = MergeMode::Ordinary;
+    // Function folding rows of a key in Aggregating mode: sum, min, max,
+    // count or uniq.
+    std::string aggregate_function = "sum";
+    // Tunables of the size-tiered merge selector. Merges run whenever it finds
+    // a range; beyond max_parts its base check is relaxed to force a merge.
+    MergeSelectorSettings merge_selector;
+    // Merges of at least this many rows use the vertical algorithm, reading
+    // values only once the surviving rows are known. 0 disables it.
+    size_t vertical_merge_min_rows = 16 * GRANULE_SIZE;
+    // Merges of at least parallel_merge_min_rows rows are split at sparse
+    // index boundaries into merge_slice_threads key ranges, each read,
+    // merged and written by its own thread (0 threads: one per core).
+    // 0 rows disables it.
+    size_t parallel_merge_min_rows = 64 * GRANULE_SIZE;
+    size_t merge_slice_threads = 0;
+    // Insert backpressure on the part count of the largest partition. Above
+    // parts_to_delay_insert every flush is delayed, linearly up to
+    // max_delay_to_insert_ms at parts_to_throw_insert; from there inserts
+    // fail, or with block_insert_on_too_many_parts wait (merging themselves)
+    // until the count drops. 0 disables a limit.
+    size_t parts_to_delay_insert = 150;
+    size_t parts_to_throw_insert = 300;
+    uint64_t max_delay_to_insert_ms = 1000;
+    bool block_insert_on_too_many_parts = false;
+    // Token-bucket limits on the bytes merges read and write, shared by all
+    // merge threads (0: unlimited). While at least merge_yield_queries_threshold
+    // queries are running, merges pause between granules (0 disables it).
+    uint64_t merge_max_read_bytes_per_second = 0;
+    uint64_t merge_max_write_bytes_per_second = 0;
+    size_t merge_yield_queries_threshold = 0;
+    // Data-skipping indexes on the value column, built for every part
+    // flushed or merged from now on (existing parts keep theirs).
+    std::vector<SkipIndexDescription> skip_indexes;
 
     MergeTreeConfig() = default;
 };
 
+struct QueryOptions {
+    uint64_t ts_from = 0;
+    uint64_t ts_to = UINT64_MAX;
+    // Applies the table's merge mode across parts not merged yet, e.g. one
+    // row per key for Replacing tables (like SELECT ... FINAL). Summing and
+    // Aggregating tables return folded, finalized values; Collapsing tables
+    // return only the surviving state rows.
+    bool final = false;
+    // Only rows whose value satisfies it; parts skip granules their skip
+    // indexes rule out. With `final` it applies to the collapsed rows, so
+    // no granule is skipped.
+    std::optional<ValueCondition> value_filter;
+    // Row filter over key, value and timestamp (like PREWHERE), evaluated a
+    // column at a time inside the granule scan; other columns are read only
+    // for granules with matching rows. Applied after collapsing with `final`.
+    std::optional<Predicate> prewhere;
+    // SAMPLE fraction in (0, 1]: only rows of the keys Predicate::key_sample
+    // picks, the same keys on every query. Parts skip granules without a
+    // sampled key, which pays off when keys span many rows. group_by scales
+    // count and sum back up by 1 / sample; query() returns the sampled rows.
+    double sample = 1;
+
+    QueryOptions() = default;
+};
+
+struct MergeTreeMetrics {
+    size_t max_parts_in_partition = 0;
+    uint64_t delayed_inserts = 0;
+    uint64_t delayed_time_us = 0;
+    uint64_t blocked_inserts = 0;
+    uint64_t blocked_time_us = 0;
+    uint64_t rejected_inserts = 0;
+    uint64_t merge_bytes_read = 0;
+    uint64_t merge_bytes_written = 0;
+    uint64_t merge_read_throttled_us = 0;
+    uint64_t merge_write_throttled_us = 0;
+    uint64_t merge_yield_us = 0;
+    uint64_t skip_index_granules_checked = 0;
+    uint64_t skip_index_granules_skipped = 0;
+};
+
 class MergeTree {
 private:
     MergeTreeConfig config_;
     std::string base_path_;
+    PartitionKey partition_key_;
 
-    MemTable memtable_;
-    std::vector<std::unique_ptr<Part>> parts_;
+    std::shared_ptr<MemTable> memtable_;
+    std::vector<std::shared_ptr<Part>> parts_;
     Merger merger_;
 
+    // A flush whose rows have left memtable_ but whose parts are not in
+    // parts_ yet. Key ranges deleted meanwhile are erased from its rows and
+    // replayed on its parts before they are published.
+    struct FlushingMemTable {
+        std::shared_ptr<MemTable> memtable;
+        std::vector<std::pair<std::string, std::string>> deleted_ranges;
+    };
+
+    // What one read sees of the table: the parts overlapping it and the
+    // memtable rows, oldest first, taken together so a flush publishing its
+    // parts meanwhile shows up as one or the other, never both or neither.
+    // The shared retire lock keeps the parts' files until the read ends.
+    struct ReadSnapshot {
+        std::shared_lock<std::shared_mutex> retire_lock;
+        std::vector<std::shared_ptr<Part>> parts;
+        std::vector<RowVector> memtable_rows;
+    };
+
+    // A merge in flight. Its inputs stay in parts_ (and visible to queries)
+    // but are reserved; key ranges deleted meanwhile are replayed on the
+    // merged part before it replaces them.
+    struct ActiveMerge {
+        std::vector<std::shared_ptr<Part>> parts;
+        std::vector<std::pair<std::string, std::string>> deleted_ranges;
+    };
+
+    // Guards parts_, reserved_parts_ and active_merges_;
+    // reservations_cv_ is notified whenever reservations are released.
     mutable std::mutex parts_mutex_;
+    // Held shared by queries that read a snapshot of parts after releasing
+    // parts_mutex_ (taken before it), and exclusively while retired parts'
+    // files are deleted, so those queries never lose files mid-read.
+    std::shared_mutex retire_mutex_;
+    // Guards memtable_, flushing_memtables_ and mutations_waiting_; taken
+    // before parts_mutex_ when both are held.
     mutable std::mutex memtable_mutex_;
+    // Flushes under way, oldest first.
+    std::list<FlushingMemTable> flushing_memtables_;
+    std::unordered_set<const Part*> reserved_parts_;
+    std::vector<ActiveMerge*> active_merges_;
+    std::condition_variable reservations_cv_;
+    // Part count of the largest partition, refreshed whenever parts_ changes
+    // so inserts can check it without the lock.
+    std::atomic<size_t> max_parts_in_partition_;
+    // Key ranges of parts_, updated part by part wherever parts_ changes
+    // (see enable_part_key_index).
+    PartKeyIndex part_key_index_;
+
+    std::atomic<uint64_t> delayed_inserts_;
+    std::atomic<uint64_t> delayed_time_us_;
+    std::atomic<uint64_t> blocked_inserts_;
+    std::atomic<uint64_t> blocked_time_us_;
+    std::atomic<uint64_t> rejected_inserts_;
+    // Queries currently running; merges yield to them (see
+    // merge_yield_queries_threshold).
+    std::atomic<size_t> active_queries_;
+    std::atomic<uint64_t> skip_index_granules_checked_;
+    std::atomic<uint64_t> skip_index_granules_skipped_;
 
-    std::thread background_thread_;
+    // Held while a mutation is applied, so workers run them one at a time.
+    std::mutex mutation_execution_mutex_;
+
+    // Pending mutations, oldest first. mutation_counter_ is the id of the
+    // last submitted one; parts flushed later start at that version. A new
+    // id waits (flushes_cv_, under memtable_mutex_) until flushing_memtables_
+    // is empty, so no part older than a mutation appears after it was
+    // processed; mutations_waiting_ holds back new flushes meanwhile.
+    std::deque<Mutation> mutations_;
+    size_t mutation_counter_;
+    size_t mutations_waiting_;
+    mutable std::mutex mutations_mutex_;
+    std::condition_variable flushes_cv_;
+
+    std::vector<std::thread> background_threads_;
     std::atomic<bool> shutdown_;
     std::condition_variable background_cv_;
     std::mutex background_mutex_;
+    // Bumped under background_mutex_ to wake the merge workers.
+    size_t merge_signal_;
 
 public:
     explicit MergeTree(const std::string& base_path, const MergeTreeConfig& config = MergeTreeConfig());
@@ -48,10 +226,71 @@ public:
 
     void insert(const Row& row);
 
+    // Logically deletes a row by inserting its cancel (-1) twin. Collapsing
+    // tables drop the pair on merge and in FINAL queries.
+    void cancel(const std::string& key, const std::string& value, uint64_t timestamp);
+
     RowVector query(const std::string& start_key, const std::string& end_key);
 
+    // Key range restricted to rows with ts_from <= timestamp <= ts_to. Parts and
+    // granules whose timestamp bounds miss the window are skipped without I/O.
+    RowVector query(const std::string& start_key, const std::string& end_key,
+                    uint64_t ts_from, uint64_t ts_to);
+
+    RowVector query(const std::string& start_key, const std::string& end_key, const QueryOptions& options);
+
     RowVector query_key(const std::string& key);
 
+    RowVector query_key(const std::string& key, const QueryOptions& options);
+
+    // SELECT prefix, count(), sum(value), min(value), max(value) ... GROUP BY
+    // prefix over a key range: parts are aggregated in parallel into
+    // per-thread hash tables, reading granule columns directly, and only the
+    // merged groups are returned (sorted by prefix). Options filter rows as
+    // in query(); `final` is not supported. Rows are counted as stored, so
+    // unlike query() exact duplicates are not dropped. With a sample, count,
+    // numeric_count and sum are estimates scaled from the sampled rows.
+    std::vector<AggregateGroup> group_by(const std::string& start_key, const std::string& end_key,
+                                         const GroupBySpec& spec, const QueryOptions& options = QueryOptions());
+
+    // Sketches of the stored rows with a key in [start_key, end_key],
+    // combined from the per-part and per-granule-group sketches written
+    // with each part, so only granules at the edges of the range are read.
+    // Rows are counted as stored: superseded versions, cancel rows and
+    // duplicates in different parts are all included.
+    RowSketches sketches(const std::string& start_key, const std::string& end_key);
+
+    // HyperLogLog estimate of the distinct keys in the range (about 1.6% error).
+    uint64_t approx_distinct_keys(const std::string& start_key, const std::string& end_key);
+
+    // KLL estimates of the given quantiles (in [0, 1]) of the values in the
+    // range that parse as numbers; zeros when there are none.
+    std::vector<double> approx_value_quantiles(const std::string& start_key, const std::string& end_key,
+                                               const std::vector<double>& levels);
+
+    // Lightweight delete: removes matching memtable rows and masks matching
+    // rows in each overlapping part without rewriting it. Returns rows deleted.
+    size_t delete_range(const std::string& start_key, const std::string& end_key);
+
+    // ALTER TABLE ... UPDATE: rows with a key in [start_key, end_key] matching
+    // `predicate` get value = update(row). The memtable is flushed and the
+    // mutation queued; the background worker (or apply_mutations()) rewrites
+    // the affected parts and swaps them in. Returns the mutation id.
+    size_t mutate_update(const std::string& start_key, const std::string& end_key,
+                         std::function<std::string(const Row&)> update,
+                         std::function<bool(const Row&)> predicate = nullptr);
+
+    // ALTER TABLE ... DELETE, executed like mutate_update but dropping rows.
+    size_t mutate_delete(const std::string& start_key, const std::string& end_key,
+                         std::function<bool(const Row&)> predicate = nullptr);
+
+    size_t pending_mutations() const;
+
+    bool is_mutation_done(size_t mutation_id) const;
+
+    // Runs every pending mutation in the calling thread.
+    void apply_mutations();
+
     void flush_memtable();
 
     void merge_parts_sync();
@@ -60,6 +299,8 @@ public:
 
     size_t part_count() const;
 
+    MergeTreeMetrics metrics() const;
+
     size_t total_rows() const;
 
     size_t memory_usage() const;
@@ -70,16 +311,76 @@ public:
 
     void optimize();
 
+    // Drops fully expired parts and performs at most one TTL merge. Returns
+    // whether anything was removed.
+    bool apply_ttl();
+
+    std::vector<std::string> partition_ids() const;
+
+    // Detaches every part of the partition and removes its directory; no
+    // data is read or rewritten.
+    void drop_partition(const std::string& partition_id);
+
 private:
+    // Parts that may hold rows of the request; parts_mutex_ must be held.
+    std::vector<Part*> find_query_parts(const std::string& start_key, const std::string& end_key,
+                                        const QueryOptions& options);
+
+    ReadSnapshot read_snapshot(const std::string& start_key, const std::string& end_key,
+                               const QueryOptions& options);
+
+    // Sorted rows from every part overlapping the request followed by the
+    // memtable, so newer sources come later.
+    std::vector<RowVector> collect_sources(const std::string& start_key, const std::string& end_key,
+                                           const QueryOptions& options);
+
     void background_merge_worker();
 
     void trigger_flush_if_needed();
 
+    // Throws or blocks when the hard part limit is reached.
+    void check_too_many_parts();
+
+    // Sleeps in proportion to how far the part count exceeds the soft limit.
+    void delay_insert_if_needed();
+
+    // Recomputes max_parts_in_partition_ from parts_; parts_mutex_ must be
+    // held.
+    void on_parts_changed();
+
     bool should_trigger_merge() const;
 
-    void perform_merge();
+    // Selects and runs one merge over unreserved parts. Returns whether a
+    // merge was done.
+    bool perform_merge();
+
+    // Reserves the merge's parts and registers it; parts_mutex_ must be held.
+    void begin_merge(ActiveMerge& merge);
+
+    // Drops the merge's reservation; parts_mutex_ must be held.
+    void release_merge(ActiveMerge& merge);
+
+    // Swaps `merged_part` (may be null) in for the merge's inputs, replaying
+    // deletes recorded meanwhile, then releases the reservation.
+    void commit_merge(ActiveMerge& merge, std::shared_ptr<Part> merged_part);
+
+    void cancel_merge(ActiveMerge& merge);
+
+    // Waits until no merge is running; returns false if none was.
+    bool wait_for_active_merges();
+
+    void wake_merge_workers();
+
+    size_t submit_mutation(Mutation mutation);
+
+    // Applies the oldest pending mutation to every part older than it.
+    bool process_mutation();
+
+    uint64_t ttl_cutoff() const;
+
+    void retire_parts(const std::vector<std::shared_ptr<Part>>& parts);
 
-    size_t get_next_part_id() const;
+    size_t get_next_part_id();
 
     void create_base_directory();
 };
@@ -1,22 +1,110 @@
 #include "merger.h"
+#include "serialization.h"
 #include <algorithm>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <thread>
+#include <chrono>
 #include <stdexcept>
 
 namespace clickhouse {
 
-MergeIterator::MergeIterator(std::vector<std::unique_ptr<Part>> parts)
-    : parts_(std::move(parts)) {
+namespace {
 
-    part_rows_.resize(parts_.size());
-    current_indices_.resize(parts_.size(), 0);
+// Longest pause, in 1 ms steps, a merge takes per granule while queries
+// are waiting; a steady query load slows merges down without stopping them.
+constexpr int MAX_YIELD_STEPS = 100;
 
-    for (size_t i = 0; i < parts_.size(); ++i) {
-        part_rows_[i] = parts_[i]->get_all_rows();
+// Stand-in for a row's value during the first pass of a vertical merge. The
+// non-aggregating merge algorithms never look at values, so they carry it
+// through untouched.
+std::string encode_row_source(uint32_t source, uint32_t position) {
+    std::string encoded(sizeof(source) + sizeof(position), '\0');
+    std::memcpy(&encoded[0], &source, sizeof(source));
+    std::memcpy(&encoded[sizeof(source)], &position, sizeof(position));
+    return encoded;
+}
+
+void decode_row_source(const std::string& encoded, uint32_t& source, uint32_t& position) {
+    std::memcpy(&source, encoded.data(), sizeof(source));
+    std::memcpy(&position, encoded.data() + sizeof(source), sizeof(position));
+}
+
+// Reads the value column of one source part on demand. Positions requested
+// by a merge mostly increase, so one granule of values is cached at a time.
+class ValueGatherer {
+private:
+    std::string part_directory_;
+    std::vector<size_t> granule_offsets_;
+    size_t loaded_granule_;
+    std::vector<std::string> values_;
+    std::function<void(size_t)> on_read_;
+
+public:
+    ValueGatherer(const Part& part, std::function<void(size_t)> on_read)
+        : part_directory_(part.part_directory()), loaded_granule_(SIZE_MAX), on_read_(std::move(on_read)) {
+        std::vector<size_t> granule_rows(part.metadata().granule_count, 0);
+        for (const auto& entry : part.index().entries()) {
+            if (entry.granule_index < granule_rows.size()) {
+                granule_rows[entry.granule_index] = entry.row_count;
+            }
+        }
+
+        granule_offsets_.assign(granule_rows.size() + 1, 0);
+        for (size_t i = 0; i < granule_rows.size(); ++i) {
+            granule_offsets_[i + 1] = granule_offsets_[i] + granule_rows[i];
+        }
+    }
+
+    const std::string& value_at(uint32_t position) {
+        size_t granule = std::upper_bound(granule_offsets_.begin(), granule_offsets_.end(), position) -
+                         granule_offsets_.begin() - 1;
+
+        if (granule != loaded_granule_) {
+            values_ = Serialization::read_granule_values(part_directory_, granule);
+            loaded_granule_ = granule;
+
+            size_t bytes = 0;
+            for (const auto& value : values_) {
+                bytes += value.size() + sizeof(uint64_t);
+            }
+            on_read_(bytes);
+        }
+
+        size_t row = position - granule_offsets_[granule];
+        if (row >= values_.size()) {
+            throw std::runtime_error("Row position out of range in " + part_directory_);
+        }
+        return values_[row];
+    }
+};
+
+// Parts are merged only within a partition and at the same mutation
+// version, so a pending mutation never sees half-mutated data.
+bool can_merge_together(const Part& a, const Part& b) {
+    return a.partition_id() == b.partition_id() &&
+           a.metadata().mutation_version == b.metadata().mutation_version;
+}
+
+}  // namespace
+
+MergeIterator::MergeIterator(const std::vector<std::shared_ptr<Part>>& parts) {
+    part_rows_.resize(parts.size());
+    current_indices_.resize(parts.size(), 0);
+
+    for (size_t i = 0; i < parts.size(); ++i) {
+        part_rows_[i] = parts[i]->get_all_rows();
     }
 
     initialize_heap();
 }
 
+MergeIterator::MergeIterator(std::vector<RowVector> sources)
+    : part_rows_(std::move(sources)), current_indices_(part_rows_.size(), 0) {
+    initialize_heap();
+}
+
 bool MergeIterator::has_next() const {
     return !heap_.empty();
 }
@@ -26,173 +114,580 @@ Row MergeIterator::next() {
         throw std::runtime_error("No more rows to merge");
     }
 
-    auto current = heap_.top();
+    RowWithSource current = heap_.top();
     heap_.pop();
 
+    // Each source row is returned once, so it can be moved out.
+    Row row = std::move(part_rows_[current.part_index][current.row_index]);
     advance_part(current.part_index);
-
-    return current.row;
+    return row;
 }
 
 void MergeIterator::advance_part(size_t part_index) {
     current_indices_[part_index]++;
 
     if (current_indices_[part_index] < part_rows_[part_index].size()) {
-        RowWithSource row_with_source;
-        row_with_source.row = part_rows_[part_index][current_indices_[part_index]];
-        row_with_source.part_index = part_index;
-        row_with_source.row_index = current_indices_[part_index];
-        heap_.push(row_with_source);
+        push_row(part_index, current_indices_[part_index]);
     }
 }
 
 void MergeIterator::initialize_heap() {
-    for (size_t i = 0; i < parts_.size(); ++i) {
+    // A sorted source's keys all share the head of its first and last key.
+    const std::string* head = nullptr;
+    for (const auto& rows : part_rows_) {
+        if (rows.empty()) {
+            continue;
+        }
+        if (head == nullptr) {
+            head = &rows.front().key;
+            key_prefix_offset_ = head->size();
+        }
+        key_prefix_offset_ = std::min(key_prefix_offset_, common_prefix_length(*head, rows.front().key));
+        key_prefix_offset_ = std::min(key_prefix_offset_, common_prefix_length(rows.front().key, rows.back().key));
+    }
+
+    for (size_t i = 0; i < part_rows_.size(); ++i) {
         if (!part_rows_[i].empty()) {
-            RowWithSource row_with_source;
-            row_with_source.row = part_rows_[i][0];
-            row_with_source.part_index = i;
-            row_with_source.row_index = 0;
-            heap_.push(row_with_source);
+            push_row(i, 0);
         }
     }
 }
 
-Merger::Merger(const std::string& base_path) : base_path_(base_path), next_part_id_(1) {}
+void MergeIterator::push_row(size_t part_index, size_t row_index) {
+    const Row& row = part_rows_[part_index][row_index];
+    heap_.push(RowWithSource{normalized_key_prefix(row.key, key_prefix_offset_), &row, part_index, row_index});
+}
+
+Merger::Merger(const std::string& base_path, MergeMode mode,
+               std::shared_ptr<const AggregateFunction> aggregate_function,
+               const MergeSelectorSettings& selector_settings)
+    : base_path_(base_path), mode_(mode), selector_(selector_settings),
+      vertical_merge_min_rows_(16 * GRANULE_SIZE), parallel_merge_min_rows_(0), merge_slice_threads_(1),
+      bytes_read_(0), bytes_written_(0), yield_us_(0), next_part_id_(1) {
+    switch (mode_) {
+        case MergeMode::Summing:
+            aggregate_function_ = create_aggregate_function("sum");
+            break;
+        case MergeMode::Aggregating:
+            if (!aggregate_function) {
+                throw std::invalid_argument("Aggregating merge mode requires an aggregate function");
+            }
+            aggregate_function_ = std::move(aggregate_function);
+            break;
+        default:
+            break;
+    }
+}
 
-std::unique_ptr<Part> Merger::merge_parts(std::vector<std::unique_ptr<Part>> parts) {
+std::shared_ptr<Part> Merger::merge_parts(const std::vector<std::shared_ptr<Part>>& parts,
+                                          uint64_t ttl_cutoff) {
     if (parts.empty()) {
         throw std::runtime_error("Cannot merge empty parts");
     }
 
-    if (parts.size() == 1) {
-        return std::move(parts[0]);
+    std::string partition_id = parts[0]->partition_id();
+    for (const auto& part : parts) {
+        if (part->partition_id() != partition_id) {
+            throw std::runtime_error("Cannot merge parts from different partitions");
+        }
+    }
+
+    // Only mutations every input has seen apply to the merged data.
+    size_t mutation_version = parts[0]->metadata().mutation_version;
+    size_t input_rows = 0;
+    for (const auto& part : parts) {
+        mutation_version = std::min(mutation_version, part->metadata().mutation_version);
+        input_rows += part->live_row_count();
     }
 
-    auto merged_rows = merge_rows(std::move(parts));
+    bool vertical = !aggregate_function_ && vertical_merge_min_rows_ > 0 && input_rows >= vertical_merge_min_rows_;
+
+    if (parallel_merge_min_rows_ > 0 && merge_slice_threads_ > 1 && input_rows >= parallel_merge_min_rows_) {
+        auto boundaries = slice_boundaries(parts, merge_slice_threads_);
+        if (!boundaries.empty()) {
+            return merge_parts_sliced(parts, ttl_cutoff, mutation_version, boundaries, vertical);
+        }
+    }
+
+    if (vertical) {
+        return merge_parts_vertical(parts, ttl_cutoff, mutation_version);
+    }
+
+    auto merged_rows = merge_rows(parts, ttl_cutoff);
 
     if (merged_rows.empty()) {
-        throw std::runtime_error("Merge resulted in empty rows");
+        return nullptr;
     }
 
-    auto merged_part = std::make_unique<Part>(get_next_part_id(), base_path_);
-    merged_part->write_from_memtable_rows(merged_rows);
+    return write_merged_part(partition_id, mutation_version, merged_rows, [](const Row& row) { return row; });
+}
+
+std::shared_ptr<Part> Merger::write_merged_part(const std::string& partition_id, size_t mutation_version,
+                                                const RowVector& rows,
+                                                const std::function<Row(const Row&)>& materialize) {
+    size_t granule_count = (rows.size() + GRANULE_SIZE - 1) / GRANULE_SIZE;
+
+    auto merged_part = std::make_shared<Part>(allocate_part_id(), base_path_, partition_id);
+    merged_part->set_mutation_version(mutation_version);
+    merged_part->set_skip_indexes(skip_indexes_);
+    merged_part->write_granule_stream(granule_count, [&](size_t granule_index) {
+        Granule granule;
+        size_t bytes = 0;
+        size_t end = std::min(rows.size(), (granule_index + 1) * GRANULE_SIZE);
+        for (size_t i = granule_index * GRANULE_SIZE; i < end; ++i) {
+            Row row = materialize(rows[i]);
+            bytes += row.size();
+            granule.add_row(std::move(row));
+        }
+        account_write(bytes);
+        return granule;
+    });
 
     return merged_part;
 }
 
-std::vector<MergeCandidate> Merger::select_merge_candidates(
-    const std::vector<std::unique_ptr<Part>>& parts,
-    size_t max_candidates) const {
+void Merger::account_read(size_t bytes) {
+    bytes_read_ += bytes;
+    if (read_throttler_) {
+        read_throttler_->add(bytes);
+    }
+    yield_to_queries();
+}
+
+void Merger::account_write(size_t bytes) {
+    bytes_written_ += bytes;
+    if (write_throttler_) {
+        write_throttler_->add(bytes);
+    }
+    yield_to_queries();
+}
+
+void Merger::yield_to_queries() {
+    if (!yield_condition_ || !yield_condition_()) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < MAX_YIELD_STEPS && yield_condition_(); ++step) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    yield_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
 
-    std::vector<MergeCandidate> candidates;
+MergeCandidate Merger::select_merge_candidate(const std::vector<std::shared_ptr<Part>>& parts,
+                                              bool force,
+                                              const std::unordered_set<const Part*>& reserved) const {
+    MergeCandidate candidate;
 
     if (parts.size() < 2) {
-        return candidates;
+        return candidate;
     }
 
-    for (size_t i = 0; i < parts.size() && candidates.size() < max_candidates; ++i) {
-        for (size_t j = i + 1; j < parts.size() && candidates.size() < max_candidates; ++j) {
-            MergeCandidate candidate;
-            candidate.part_indices = {i, j};
-            candidate.total_rows = parts[i]->metadata().row_count + parts[j]->metadata().row_count;
-            candidate.total_size = parts[i]->disk_usage() + parts[j]->disk_usage();
-            candidate.score = calculate_merge_score(candidate.part_indices, parts);
+    uint64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // Runs of parts allowed to merge, keeping list order. Each open run is
+    // tracked by its first part; a reserved part closes the run of its group.
+    std::vector<SimpleMergeSelector::PartsRange> ranges;
+    std::vector<std::pair<const Part*, size_t>> open_ranges;
 
-            if (candidate.score > 0) {
-                candidates.push_back(candidate);
+    for (size_t i = 0; i < parts.size(); ++i) {
+        auto open = std::find_if(open_ranges.begin(), open_ranges.end(),
+            [&](const std::pair<const Part*, size_t>& range) { return can_merge_together(*range.first, *parts[i]); });
+
+        if (reserved.count(parts[i].get())) {
+            if (open != open_ranges.end()) {
+                open_ranges.erase(open);
             }
+            continue;
         }
-    }
 
-    for (size_t i = 0; i < parts.size() - 2 && candidates.size() < max_candidates; ++i) {
-        MergeCandidate candidate;
-        candidate.part_indices = {i, i + 1, i + 2};
-        candidate.total_rows = parts[i]->metadata().row_count +
-                              parts[i + 1]->metadata().row_count +
-                              parts[i + 2]->metadata().row_count;
-        candidate.total_size = parts[i]->disk_usage() +
-                              parts[i + 1]->disk_usage() +
-                              parts[i + 2]->disk_usage();
-        candidate.score = calculate_merge_score(candidate.part_indices, parts);
-
-        if (candidate.score > 0) {
-            candidates.push_back(candidate);
+        if (open == open_ranges.end()) {
+            ranges.emplace_back();
+            open = open_ranges.insert(open_ranges.end(), {parts[i].get(), ranges.size() - 1});
         }
+
+        const auto& metadata = parts[i]->metadata();
+        uint64_t age = now > metadata.creation_time ? now - metadata.creation_time : 0;
+        ranges[open->second].push_back({parts[i]->disk_usage(), age, i});
     }
 
-    std::sort(candidates.begin(), candidates.end(),
-        [](const MergeCandidate& a, const MergeCandidate& b) {
-            return a.score > b.score;
-        });
+    auto selected = selector_.select(ranges);
+
+    if (selected.empty() && force) {
+        MergeSelectorSettings forced_settings = selector_.settings();
+        forced_settings.base = 1.0;
+        selected = SimpleMergeSelector(forced_settings).select(ranges);
+    }
 
-    return candidates;
+    for (const auto& part : selected) {
+        candidate.part_indices.push_back(part.index);
+        candidate.total_rows += parts[part.index]->metadata().row_count;
+        candidate.total_size += part.size;
+    }
+    return candidate;
 }
 
 size_t Merger::get_next_part_id() const {
     return next_part_id_;
 }
 
+size_t Merger::allocate_part_id() {
+    return next_part_id_++;
+}
+
 void Merger::set_next_part_id(size_t id) {
     next_part_id_ = id;
 }
 
-double Merger::calculate_merge_score(const std::vector<size_t>& part_indices,
-                                    const std::vector<std::unique_ptr<Part>>& parts) const {
-    if (part_indices.empty()) {
-        return 0.0;
+RowVector Merger::collapse_rows(MergeIterator& iterator, uint64_t ttl_cutoff) const {
+    RowVector merged_rows;
+    collapse_rows(iterator, ttl_cutoff, [&](Row&& row) { merged_rows.push_back(std::move(row)); });
+    return merged_rows;
+}
+
+void Merger::collapse_rows(MergeIterator& iterator, uint64_t ttl_cutoff,
+                           const std::function<void(Row&&)>& emit) const {
+    if (mode_ == MergeMode::Collapsing) {
+        collapse_signed_rows(iterator, ttl_cutoff, emit);
+        return;
     }
 
-    size_t total_rows = 0;
-    size_t total_size = 0;
-    size_t min_size = SIZE_MAX;
-    size_t max_size = 0;
+    // The last merged row is held back until a row of another key (or
+    // timestamp, for Ordinary) shows it is complete.
+    Row merged;
+    bool has_row = false;
+
+    while (iterator.has_next()) {
+        Row current_row = iterator.next();
+
+        if (current_row.timestamp < ttl_cutoff) {
+            continue;
+        }
+
+        if (!has_row || merged.key != current_row.key) {
+            if (has_row) {
+                emit(std::move(merged));
+            }
+            merged = std::move(current_row);
+            has_row = true;
+            continue;
+        }
 
-    for (size_t idx : part_indices) {
-        if (idx >= parts.size()) {
-            return 0.0;
+        switch (mode_) {
+            case MergeMode::Ordinary:
+            case MergeMode::Collapsing:
+                if (merged.timestamp != current_row.timestamp) {
+                    emit(std::move(merged));
+                    merged = std::move(current_row);
+                }
+                break;
+            case MergeMode::Replacing:
+                merged = std::move(current_row);
+                break;
+            case MergeMode::Summing:
+            case MergeMode::Aggregating:
+                merged.value = aggregate_function_->merge(merged.value, current_row.value);
+                merged.timestamp = current_row.timestamp;
+                break;
         }
+    }
 
-        size_t part_size = parts[idx]->disk_usage();
-        total_rows += parts[idx]->metadata().row_count;
-        total_size += part_size;
-        min_size = std::min(min_size, part_size);
-        max_size = std::max(max_size, part_size);
+    if (has_row) {
+        emit(std::move(merged));
     }
+}
+
+// Mirrors ClickHouse's CollapsingSortedAlgorithm. Per key, with S state and
+// C cancel rows: S > C keeps the last state, C > S keeps the first cancel,
+// S == C keeps nothing unless the last row is a state, in which case the
+// first cancel and last state are both kept for a later merge to resolve.
+void Merger::collapse_signed_rows(MergeIterator& iterator, uint64_t ttl_cutoff,
+                                  const std::function<void(Row&&)>& emit) const {
+
+    Row first_cancel;
+    Row last_state;
+    size_t states = 0;
+    size_t cancels = 0;
+    int8_t last_sign = 0;
+
+    auto flush_key = [&]() {
+        if (states > cancels) {
+            emit(std::move(last_state));
+        } else if (cancels > states) {
+            emit(std::move(first_cancel));
+        } else if (states > 0 && last_sign > 0) {
+            if (last_state < first_cancel) {
+                std::swap(first_cancel, last_state);
+            }
+            emit(std::move(first_cancel));
+            emit(std::move(last_state));
+        }
+        states = 0;
+        cancels = 0;
+    };
+
+    bool has_key = false;
+    std::string current_key;
+
+    while (iterator.has_next()) {
+        Row current_row = iterator.next();
+
+        if (current_row.timestamp < ttl_cutoff) {
+            continue;
+        }
+
+        if (has_key && current_row.key != current_key) {
+            flush_key();
+        }
 
-    if (total_rows == 0 || total_size == 0) {
-        return 0.0;
+        has_key = true;
+        current_key = current_row.key;
+        last_sign = current_row.sign;
+
+        if (current_row.sign > 0) {
+            states++;
+            last_state = std::move(current_row);
+        } else {
+            if (cancels++ == 0) {
+                first_cancel = std::move(current_row);
+            }
+        }
     }
 
-    double size_ratio = static_cast<double>(min_size) / static_cast<double>(max_size);
+    if (has_key) {
+        flush_key();
+    }
+}
 
-    double parts_factor = 1.0 / part_indices.size();
+void Merger::finalize_rows(RowVector& rows) const {
+    if (mode_ == MergeMode::Collapsing) {
+        rows.erase(std::remove_if(rows.begin(), rows.end(),
+            [](const Row& row) { return row.sign < 0; }), rows.end());
+        return;
+    }
 
-    double size_factor = std::min(1.0, static_cast<double>(total_size) / (10 * 1024 * 1024));
+    if (!aggregate_function_) {
+        return;
+    }
 
-    return size_ratio * parts_factor * size_factor * 100.0;
+    for (auto& row : rows) {
+        row.value = aggregate_function_->finalize(row.value);
+    }
 }
 
-RowVector Merger::merge_rows(std::vector<std::unique_ptr<Part>> parts) {
-    RowVector merged_rows;
+std::shared_ptr<Part> Merger::merge_parts_vertical(const std::vector<std::shared_ptr<Part>>& parts,
+                                                   uint64_t ttl_cutoff, size_t mutation_version) {
+    std::vector<RowVector> sources;
+    sources.reserve(parts.size());
+
+    for (size_t source = 0; source < parts.size(); ++source) {
+        std::vector<uint32_t> positions;
+        RowVector rows = parts[source]->read_sort_columns(positions);
+        size_t bytes = 0;
+        for (size_t i = 0; i < rows.size(); ++i) {
+            rows[i].value = encode_row_source(static_cast<uint32_t>(source), positions[i]);
+            bytes += rows[i].key.size() + sizeof(uint64_t) + sizeof(int8_t);
+        }
+        sources.push_back(std::move(rows));
+        account_read(bytes);
+    }
+
+    MergeIterator iterator(std::move(sources));
+    RowVector merged_rows = collapse_rows(iterator, ttl_cutoff);
+
+    if (merged_rows.empty()) {
+        return nullptr;
+    }
 
+    std::vector<ValueGatherer> gatherers;
+    gatherers.reserve(parts.size());
+    for (const auto& part : parts) {
+        gatherers.emplace_back(*part, [this](size_t bytes) { account_read(bytes); });
+    }
+
+    return write_merged_part(parts[0]->partition_id(), mutation_version, merged_rows, [&](const Row& row) {
+        uint32_t source;
+        uint32_t position;
+        decode_row_source(row.value, source, position);
+        return Row(row.key, gatherers[source].value_at(position), row.timestamp, row.sign);
+    });
+}
+
+RowVector Merger::merge_rows(const std::vector<std::shared_ptr<Part>>& parts, uint64_t ttl_cutoff) {
     if (parts.empty()) {
-        return merged_rows;
+        return RowVector();
     }
 
-    MergeIterator iterator(std::move(parts));
+    std::vector<RowVector> sources;
+    sources.reserve(parts.size());
+    // Read a granule at a time, so throttling and yielding to queries act
+    // within large inputs as in the vertical and sliced merges.
+    for (const auto& part : parts) {
+        RowVector rows;
+        rows.reserve(part->live_row_count());
+        for (size_t granule_idx = 0; granule_idx < part->metadata().granule_count; ++granule_idx) {
+            RowVector granule_rows = part->read_granule_rows(granule_idx);
+            size_t bytes = 0;
+            for (auto& row : granule_rows) {
+                bytes += row.size();
+                rows.push_back(std::move(row));
+            }
+            account_read(bytes);
+        }
+        sources.push_back(std::move(rows));
+    }
 
-    while (iterator.has_next()) {
-        Row current_row = iterator.next();
+    MergeIterator iterator(std::move(sources));
+    return collapse_rows(iterator, ttl_cutoff);
+}
 
-        if (merged_rows.empty() ||
-            merged_rows.back().key != current_row.key ||
-            merged_rows.back().timestamp != current_row.timestamp) {
-            merged_rows.push_back(current_row);
+std::vector<std::string> Merger::slice_boundaries(const std::vector<std::shared_ptr<Part>>& parts,
+                                                  size_t slices) const {
+    std::vector<std::pair<std::string, size_t>> granule_starts;
+    size_t total_rows = 0;
+
+    for (const auto& part : parts) {
+        for (const auto& entry : part->index().entries()) {
+            granule_starts.emplace_back(entry.min_key, entry.row_count);
+            total_rows += entry.row_count;
         }
     }
 
-    return merged_rows;
+    std::sort(granule_starts.begin(), granule_starts.end());
+
+    std::vector<std::string> boundaries;
+    size_t rows_before = 0;
+
+    for (const auto& [key, rows] : granule_starts) {
+        size_t next_slice = boundaries.size() + 1;
+        if (next_slice >= slices) {
+            break;
+        }
+        if (rows_before >= total_rows * next_slice / slices && rows_before > 0 &&
+            (boundaries.empty() || boundaries.back() < key)) {
+            boundaries.push_back(key);
+        }
+        rows_before += rows;
+    }
+
+    return boundaries;
+}
+
+std::shared_ptr<Part> Merger::merge_parts_sliced(const std::vector<std::shared_ptr<Part>>& parts,
+                                                 uint64_t ttl_cutoff, size_t mutation_version,
+                                                 const std::vector<std::string>& boundaries, bool vertical) {
+    std::string max_key;
+    size_t input_rows = 0;
+    for (const auto& part : parts) {
+        max_key = std::max(max_key, part->metadata().max_key);
+        input_rows += part->live_row_count();
+    }
+
+    size_t slice_count = boundaries.size() + 1;
+    auto merged_part = std::make_shared<Part>(allocate_part_id(), base_path_, parts[0]->partition_id());
+    merged_part->set_mutation_version(mutation_version);
+    merged_part->set_skip_indexes(skip_indexes_);
+    merged_part->begin_slices(slice_count, input_rows);
+
+    std::atomic<size_t> merged_rows{0};
+    std::vector<std::exception_ptr> errors(slice_count);
+    std::vector<std::thread> threads;
+
+    for (size_t slice = 0; slice < slice_count; ++slice) {
+        threads.emplace_back([&, slice] {
+            try {
+                merged_rows += merge_slice(parts, slice, boundaries, max_key, ttl_cutoff, vertical, *merged_part);
+            } catch (...) {
+                errors[slice] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (const auto& error : errors) {
+        if (error) {
+            merged_part->delete_from_disk();
+            std::rethrow_exception(error);
+        }
+    }
+
+    if (merged_rows == 0) {
+        merged_part->delete_from_disk();
+        return nullptr;
+    }
+
+    merged_part->commit_slices();
+    return merged_part;
+}
+
+size_t Merger::merge_slice(const std::vector<std::shared_ptr<Part>>& parts, size_t slice_index,
+                           const std::vector<std::string>& boundaries, const std::string& max_key,
+                           uint64_t ttl_cutoff, bool vertical, Part& output) {
+    bool last_slice = slice_index == boundaries.size();
+    std::string start_key = slice_index == 0 ? std::string() : boundaries[slice_index - 1];
+    const std::string& end_key = last_slice ? max_key : boundaries[slice_index];
+
+    // Slices start on different parts, so they do not all wait on the lock
+    // of the first one.
+    std::vector<RowVector> sources(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i) {
+        size_t source = (slice_index + i) % parts.size();
+        std::vector<uint32_t> positions;
+        RowVector rows = vertical ? parts[source]->read_sort_columns(start_key, end_key, positions)
+                                  : parts[source]->query(start_key, end_key);
+
+        // The end boundary is the first key of the next slice.
+        if (!last_slice) {
+            while (!rows.empty() && rows.back().key == end_key) {
+                rows.pop_back();
+            }
+        }
+
+        size_t bytes = 0;
+        for (size_t j = 0; j < rows.size(); ++j) {
+            if (vertical) {
+                rows[j].value = encode_row_source(static_cast<uint32_t>(source), positions[j]);
+                bytes += rows[j].key.size() + sizeof(uint64_t) + sizeof(int8_t);
+            } else {
+                bytes += rows[j].size();
+            }
+        }
+        account_read(bytes);
+        sources[source] = std::move(rows);
+    }
+
+    std::vector<ValueGatherer> gatherers;
+    if (vertical) {
+        gatherers.reserve(parts.size());
+        for (const auto& part : parts) {
+            gatherers.emplace_back(*part, [this](size_t bytes) { account_read(bytes); });
+        }
+    }
+
+    MergeIterator iterator(std::move(sources));
+    size_t rows = 0;
+    size_t bytes = 0;
+    collapse_rows(iterator, ttl_cutoff, [&](Row&& row) {
+        if (vertical) {
+            uint32_t source;
+            uint32_t position;
+            decode_row_source(row.value, source, position);
+            row.value = gatherers[source].value_at(position);
+        }
+        bytes += row.size();
+        output.append_slice_row(slice_index, std::move(row));
+        if (++rows % GRANULE_SIZE == 0) {
+            account_write(bytes);
+            bytes = 0;
+        }
+    });
+    account_write(bytes);
+    return rows;
 }
 
-}  // namespace clickhouse
\ No newline at end of file
+}  // namespace clickhouse
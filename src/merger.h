@@ -1,41 +1,79 @@
 #pragma once
 
 #include "part.h"
+#include "aggregate_function.h"
+#include "merge_selector.h"
+#include "throttler.h"
 #include <vector>
 #include <memory>
 #include <queue>
+#include <atomic>
+#include <unordered_set>
+#include <functional>
 
 namespace clickhouse {
 
+enum class MergeMode {
+    // Keeps every version; only exact (key, timestamp) duplicates are dropped.
+    Ordinary,
+    // Keeps only the highest-timestamp row per key (last writer wins).
+    Replacing,
+    // Folds all rows of a key into one by summing their numeric values.
+    Summing,
+    // Folds all rows of a key with the configured AggregateFunction.
+    Aggregating,
+    // Cancels state (+1) rows against cancel (-1) rows of the same key.
+    Collapsing
+};
+
 struct MergeCandidate {
     std::vector<size_t> part_indices;
     size_t total_rows;
     size_t total_size;
-    double score;
 
-    MergeCandidate() : total_rows(0), total_size(0), score(0.0) {}
+    MergeCandidate() : total_rows(0), total_size(0) {}
 };
 
 class MergeIterator {
 private:
+    // The current row of a source. The heap compares normalized key
+    // prefixes first and reads the row only to break ties.
     struct RowWithSource {
-        Row row;
+        uint64_t key_prefix;
+        const Row* row;
         size_t part_index;
         size_t row_index;
 
+        // Orders by (key, timestamp, sign) and then by source, so for equal
+        // rows the later source (newer data) comes out last.
         bool operator>(const RowWithSource& other) const {
-            return row.key > other.row.key ||
-                   (row.key == other.row.key && row.timestamp < other.row.timestamp);
+            if (key_prefix != other.key_prefix) return key_prefix > other.key_prefix;
+            int order = compare_keys(row->key, other.row->key);
+            if (order != 0) return order > 0;
+            if (row->timestamp != other.row->timestamp) return row->timestamp > other.row->timestamp;
+            if (row->sign != other.row->sign) return row->sign > other.row->sign;
+            return part_index > other.part_index;
         }
     };
 
-    std::vector<std::unique_ptr<Part>> parts_;
     std::vector<RowVector> part_rows_;
     std::vector<size_t> current_indices_;
+    // Length of the head shared by every key of every source; heap prefixes
+    // are taken past it.
+    size_t key_prefix_offset_ = 0;
     std::priority_queue<RowWithSource, std::vector<RowWithSource>, std::greater<RowWithSource>> heap_;
 
 public:
-    explicit MergeIterator(std::vector<std::unique_ptr<Part>> parts);
+    explicit MergeIterator(const std::vector<std::shared_ptr<Part>>& parts);
+
+    // Each source must already be sorted by Row::operator<.
+    explicit MergeIterator(std::vector<RowVector> sources);
+
+    // The heap points into the sources, which moving keeps in place.
+    MergeIterator(const MergeIterator&) = delete;
+    MergeIterator& operator=(const MergeIterator&) = delete;
+    MergeIterator(MergeIterator&&) = default;
+    MergeIterator& operator=(MergeIterator&&) = default;
 
     bool has_next() const;
 
@@ -45,31 +83,156 @@ public:
 
 private:
     void initialize_heap();
+
+    void push_row(size_t part_index, size_t row_index);
 };
 
 class Merger {
 private:
     std::string base_path_;
-    size_t next_part_id_;
+    MergeMode mode_;
+    std::shared_ptr<const AggregateFunction> aggregate_function_;
+    SimpleMergeSelector selector_;
+    size_t vertical_merge_min_rows_;
+    size_t parallel_merge_min_rows_;
+    size_t merge_slice_threads_;
+    std::shared_ptr<Throttler> read_throttler_;
+    std::shared_ptr<Throttler> write_throttler_;
+    std::function<bool()> yield_condition_;
+    std::vector<SkipIndexDescription> skip_indexes_;
+    std::atomic<uint64_t> bytes_read_;
+    std::atomic<uint64_t> bytes_written_;
+    std::atomic<uint64_t> yield_us_;
+    std::atomic<size_t> next_part_id_;
 
 public:
-    explicit Merger(const std::string& base_path);
-
-    std::unique_ptr<Part> merge_parts(std::vector<std::unique_ptr<Part>> parts);
-
-    std::vector<MergeCandidate> select_merge_candidates(
-        const std::vector<std::unique_ptr<Part>>& parts,
-        size_t max_candidates = 3) const;
+    // Summing mode defaults to sum; Aggregating mode requires a function.
+    explicit Merger(const std::string& base_path, MergeMode mode = MergeMode::Ordinary,
+                    std::shared_ptr<const AggregateFunction> aggregate_function = nullptr,
+                    const MergeSelectorSettings& selector_settings = MergeSelectorSettings());
+
+    MergeMode mode() const { return mode_; }
+
+    // Null unless rows of a key are folded (Summing/Aggregating).
+    const AggregateFunction* aggregate_function() const { return aggregate_function_.get(); }
+
+    // Merges of at least this many input rows use the vertical algorithm
+    // (Summing/Aggregating merges always read whole rows). 0 disables it.
+    void set_vertical_merge_min_rows(size_t rows) { vertical_merge_min_rows_ = rows; }
+
+    // Merges of at least `min_rows` input rows are split into up to `threads`
+    // key-range slices, each read, merged and written on its own thread into
+    // the granules of one output part. 0 disables it.
+    void set_parallel_merge(size_t min_rows, size_t threads) {
+        parallel_merge_min_rows_ = min_rows;
+        merge_slice_threads_ = threads;
+    }
+
+    // Limits merge reads and writes (either may be null). Bytes are charged
+    // per part or granule read and per granule written.
+    void set_io_limits(std::shared_ptr<Throttler> read_throttler, std::shared_ptr<Throttler> write_throttler) {
+        read_throttler_ = std::move(read_throttler);
+        write_throttler_ = std::move(write_throttler);
+    }
+
+    // Skip indexes built for every merged part.
+    void set_skip_indexes(const std::vector<SkipIndexDescription>& descriptions) { skip_indexes_ = descriptions; }
+
+    // Checked between granules; while it holds, merges pause (for a bounded
+    // time per check) to leave the disk to foreground queries.
+    void set_yield_condition(std::function<bool()> condition) { yield_condition_ = std::move(condition); }
+
+    uint64_t bytes_read() const { return bytes_read_; }
+
+    uint64_t bytes_written() const { return bytes_written_; }
+
+    uint64_t yield_microseconds() const { return yield_us_; }
+
+    uint64_t read_throttled_microseconds() const {
+        return read_throttler_ ? read_throttler_->throttled_microseconds() : 0;
+    }
+
+    uint64_t write_throttled_microseconds() const {
+        return write_throttler_ ? write_throttler_->throttled_microseconds() : 0;
+    }
+
+    // Writes the merged rows of `parts` into a new part; the inputs are left
+    // untouched for the caller to retire. Rows with timestamp < ttl_cutoff
+    // are dropped, so a single part can be passed to rewrite it for TTL.
+    // Returns nullptr when no row survives.
+    std::shared_ptr<Part> merge_parts(const std::vector<std::shared_ptr<Part>>& parts,
+                                      uint64_t ttl_cutoff = 0);
+
+    // Runs the merge selector over cached part sizes. With `force` (too many
+    // parts) and nothing selected, the base check is dropped so some range is
+    // still merged. Reserved parts (already being merged) are never chosen
+    // and split the runs around them. Returns a candidate with no part
+    // indices when none fits.
+    MergeCandidate select_merge_candidate(const std::vector<std::shared_ptr<Part>>& parts,
+                                          bool force = false,
+                                          const std::unordered_set<const Part*>& reserved = {}) const;
+
+    // Drains a sorted stream applying the merge mode; shared by part merges
+    // and FINAL queries.
+    RowVector collapse_rows(MergeIterator& iterator, uint64_t ttl_cutoff = 0) const;
+
+    // As above, passing each merged row to `emit` in order instead of
+    // collecting them.
+    void collapse_rows(MergeIterator& iterator, uint64_t ttl_cutoff, const std::function<void(Row&&)>& emit) const;
+
+    // Prepares collapsed rows for presentation: aggregate states become
+    // final values and leftover cancel rows are removed.
+    void finalize_rows(RowVector& rows) const;
 
     size_t get_next_part_id() const;
 
+    // Reserves a fresh part id; shared by flushes and merges.
+    size_t allocate_part_id();
+
     void set_next_part_id(size_t id);
 
 private:
-    double calculate_merge_score(const std::vector<size_t>& part_indices,
-                                const std::vector<std::unique_ptr<Part>>& parts) const;
-
-    RowVector merge_rows(std::vector<std::unique_ptr<Part>> parts);
+    RowVector merge_rows(const std::vector<std::shared_ptr<Part>>& parts, uint64_t ttl_cutoff);
+
+    // Keys splitting the inputs into `slices` ranges of similar row counts,
+    // taken from the granule boundaries of their sparse indexes.
+    std::vector<std::string> slice_boundaries(const std::vector<std::shared_ptr<Part>>& parts,
+                                              size_t slices) const;
+
+    // Merges each key range [b_i, b_i+1) on its own thread (merge_slice),
+    // writing the slices of one new part. Merge modes only combine rows of
+    // one key, so slices never interact.
+    std::shared_ptr<Part> merge_parts_sliced(const std::vector<std::shared_ptr<Part>>& parts, uint64_t ttl_cutoff,
+                                             size_t mutation_version, const std::vector<std::string>& boundaries,
+                                             bool vertical);
+
+    // Reads slice `slice_index` of every input, merges it and appends the
+    // merged rows to `output`; with `vertical`, only sort columns are merged
+    // and values are gathered for the surviving rows. Returns rows written.
+    size_t merge_slice(const std::vector<std::shared_ptr<Part>>& parts, size_t slice_index,
+                       const std::vector<std::string>& boundaries, const std::string& max_key, uint64_t ttl_cutoff,
+                       bool vertical, Part& output);
+
+    // Writes sorted merged rows into a new part one granule at a time;
+    // `materialize` turns a merged row into the stored row.
+    std::shared_ptr<Part> write_merged_part(const std::string& partition_id, size_t mutation_version,
+                                            const RowVector& rows,
+                                            const std::function<Row(const Row&)>& materialize);
+
+    void account_read(size_t bytes);
+
+    void account_write(size_t bytes);
+
+    void yield_to_queries();
+
+    // Vertical merge: merges key, timestamp and sign columns first, carrying
+    // a reference to each source row in place of its value, then gathers the
+    // values of surviving rows granule by granule while writing the result.
+    std::shared_ptr<Part> merge_parts_vertical(const std::vector<std::shared_ptr<Part>>& parts,
+                                               uint64_t ttl_cutoff, size_t mutation_version);
+
+    void collapse_signed_rows(MergeIterator& iterator, uint64_t ttl_cutoff,
+                              const std::function<void(Row&&)>& emit) const;
 };
 
 }  // namespace clickhouse
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "row.h"
+#include <string>
+#include <functional>
+
+namespace clickhouse {
+
+enum class MutationType {
+    Update,
+    Delete
+};
+
+// A queued ALTER UPDATE/DELETE. Rows with a key in [start_key, end_key]
+// that satisfy `predicate` (all of them when it is empty) are deleted, or
+// have their value replaced by update(row). Mutations only affect data
+// inserted before they were submitted and are kept in memory, so pending
+// ones are lost on restart.
+struct Mutation {
+    size_t id = 0;
+    MutationType type = MutationType::Delete;
+    std::string start_key;
+    std::string end_key;
+    std::function<bool(const Row&)> predicate;
+    std::function<std::string(const Row&)> update;
+
+    bool matches(const Row& row) const {
+        return row.key >= start_key && row.key <= end_key && (!predicate || predicate(row));
+    }
+};
+
+}  // namespace clickhouse
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <string_view>
+
+namespace clickhouse {
+
+// Parses a whole value as a finite decimal number. Unlike strtod, leading
+// whitespace, a '+' sign, hexadecimal, inf and nan are not numbers, so every
+// reader of numeric values (aggregates, GROUP BY, skip indexes, sketches)
+// agrees on which values count.
+inline bool parse_number(std::string_view value, double& number) {
+    if (value.empty()) {
+        return false;
+    }
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+    return error == std::errc() && end == value.data() + value.size() && std::isfinite(number);
+}
+
+// Like parse_number, for values that are decimal integers in range.
+inline bool parse_integer(std::string_view value, long long& number) {
+    if (value.empty()) {
+        return false;
+    }
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+    return error == std::errc() && end == value.data() + value.size();
+}
+
+}  // namespace clickhouse
@@ -1,23 +1,179 @@
 #include "part.h"
 #include "serialization.h"
+#include "hash.h"
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
 #include <chrono>
+#include <iterator>
+#include <numeric>
 #include <stdexcept>
 
 namespace clickhouse {
 
-Part::Part(size_t part_id, const std::string& base_path)
-    : metadata_(part_id), base_path_(base_path), loaded_(false) {
+namespace {
+
+constexpr size_t TIMESTAMP_QUANTILE_STEPS = 16;
+
+// Key bloom filter density: about 1% false positives.
+constexpr size_t KEY_BLOOM_BITS_PER_KEY = 10;
+
+const char* const GRANULE_COLUMNS[] = {"keys", "values", "timestamps", "signs"};
+constexpr uint8_t ALL_COLUMNS_VERIFIED = 0xF;
+
+uint8_t column_bit(const std::string& column) {
+    for (uint8_t i = 0; i < 4; ++i) {
+        if (column == GRANULE_COLUMNS[i]) {
+            return static_cast<uint8_t>(1u << i);
+        }
+    }
+    throw std::invalid_argument("Unknown granule column: " + column);
+}
+
+std::string granule_file_name(size_t granule_index, const std::string& column) {
+    return "granule_" + std::to_string(granule_index) + "_" + column + ".bin";
+}
+
+// Columns of a granule held in memory, as views into its rows.
+class GranuleRowColumns : public PredicateColumns {
+private:
+    const Granule& granule_;
+    const RowVector& rows_;
+    std::vector<std::string_view> keys_;
+    std::vector<std::string_view> values_;
+    std::vector<uint64_t> timestamps_;
+
+public:
+    explicit GranuleRowColumns(const Granule& granule) : granule_(granule), rows_(granule.rows()) {}
+
+    size_t size() const override { return rows_.size(); }
+
+    const std::vector<uint64_t>* key_prefixes() override {
+        bool usable = granule_.key_prefix_offset() == 0 && granule_.key_prefixes().size() == rows_.size();
+        return usable ? &granule_.key_prefixes() : nullptr;
+    }
+
+    const std::vector<std::string_view>& keys() override {
+        if (keys_.size() != rows_.size()) {
+            keys_.clear();
+            for (const auto& row : rows_) {
+                keys_.push_back(row.key);
+            }
+        }
+        return keys_;
+    }
+
+    const std::vector<std::string_view>& values() override {
+        if (values_.size() != rows_.size()) {
+            values_.clear();
+            for (const auto& row : rows_) {
+                values_.push_back(row.value);
+            }
+        }
+        return values_;
+    }
+
+    const std::vector<uint64_t>& timestamps() override {
+        if (timestamps_.size() != rows_.size()) {
+            timestamps_.clear();
+            for (const auto& row : rows_) {
+                timestamps_.push_back(row.timestamp);
+            }
+        }
+        return timestamps_;
+    }
+};
+
+// Columns of a granule on disk, each read (after `verify` checks its file)
+// the first time it is requested.
+class GranuleFileColumns : public PredicateColumns {
+private:
+    std::string directory_;
+    size_t granule_index_;
+    size_t rows_;
+    std::function<void(const std::string&)> verify_;
+    std::string key_buffer_;
+    std::string value_buffer_;
+    std::vector<std::string_view> keys_;
+    std::vector<std::string_view> values_;
+    std::vector<uint64_t> timestamps_;
+    bool keys_read_ = false;
+    bool values_read_ = false;
+    bool timestamps_read_ = false;
+
+    template <typename Column>
+    void check_size(const Column& column, const std::string& name) const {
+        if (column.size() != rows_) {
+            throw std::runtime_error("Inconsistent granule data sizes: " +
+                                     Serialization::granule_file(directory_, granule_index_, name));
+        }
+    }
+
+    const std::vector<std::string_view>& read_strings(const std::string& name, std::string& buffer,
+                                                      std::vector<std::string_view>& column, bool& read) {
+        if (!read) {
+            verify_(name);
+            column = Serialization::read_string_views(
+                Serialization::granule_file(directory_, granule_index_, name), buffer);
+            check_size(column, name);
+            read = true;
+        }
+        return column;
+    }
+
+public:
+    GranuleFileColumns(const std::string& directory, size_t granule_index, size_t rows,
+                       std::function<void(const std::string&)> verify)
+        : directory_(directory), granule_index_(granule_index), rows_(rows), verify_(std::move(verify)) {}
+
+    size_t size() const override { return rows_; }
+
+    const std::vector<std::string_view>& keys() override {
+        return read_strings("keys", key_buffer_, keys_, keys_read_);
+    }
+
+    const std::vector<std::string_view>& values() override {
+        return read_strings("values", value_buffer_, values_, values_read_);
+    }
+
+    const std::vector<uint64_t>& timestamps() override {
+        if (!timestamps_read_) {
+            verify_("timestamps");
+            timestamps_ = Serialization::read_uint64_vector(
+                Serialization::granule_file(directory_, granule_index_, "timestamps"));
+            check_size(timestamps_, "timestamps");
+            timestamps_read_ = true;
+        }
+        return timestamps_;
+    }
+
+    std::vector<int8_t> signs() {
+        verify_("signs");
+        std::string signs_file = Serialization::granule_file(directory_, granule_index_, "signs");
+        if (!Serialization::file_exists(signs_file)) {
+            return std::vector<int8_t>(rows_, 1);
+        }
+        auto signs = Serialization::read_int8_vector(signs_file);
+        check_size(signs, "signs");
+        return signs;
+    }
+};
+
+}  // namespace
+
+Part::Part(size_t part_id, const std::string& base_path, const std::string& partition_id)
+    : metadata_(part_id), base_path_(base_path), skip_indexes_loaded_(false),
+      sample_hashes_loaded_(false), sketches_loaded_(false), slice_block_granules_(1), opened_(false), loaded_(false), temporary_(false) {
+    metadata_.partition_id = partition_id;
 }
 
 void Part::write_granules(const std::vector<Granule>& granules) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     if (granules.empty()) {
         throw std::runtime_error("Cannot write empty granules");
     }
 
-    create_directory();
+    begin_write();
 
     granules_ = granules;
     for (auto& granule : granules_) {
@@ -26,13 +182,36 @@ void Part::write_granules(const std::vector<Granule>& granules) {
 
     update_metadata(granules_);
     build_index(granules_);
+    compute_granule_offsets();
+    deleted_rows_.clear();
 
+    key_bloom_ = BloomFilter(metadata_.row_count, KEY_BLOOM_BITS_PER_KEY);
+    auto skip_indexes = create_skip_indexes();
+    std::vector<uint64_t> sample_hashes(granules_.size(), UINT64_MAX);
+    PartSketches sketches;
+    std::vector<std::string> values;
     for (size_t i = 0; i < granules_.size(); ++i) {
         Serialization::write_granule(part_directory(), granules_[i], i);
+        values.clear();
+        for (const auto& row : granules_[i].rows()) {
+            key_bloom_.add(row.key);
+            sample_hashes[i] = std::min(sample_hashes[i], key_sample_hash(row.key.data(), row.key.size()));
+            sketches.add(i, row.key, row.value);
+            values.push_back(row.value);
+        }
+        for (auto& index : skip_indexes) {
+            index->add_granule(values);
+        }
     }
 
     save_index();
-    save_metadata();
+    save_key_bloom();
+    save_skip_indexes(skip_indexes);
+    save_sample_hashes(std::move(sample_hashes));
+    save_sketches(std::move(sketches));
+    commit_write();
+    granule_loaded_.assign(granules_.size(), true);
+    opened_ = true;
     loaded_ = true;
 }
 
@@ -64,35 +243,908 @@ void Part::write_from_memtable_rows(const RowVector& rows) {
     write_granules(granules);
 }
 
-RowVector Part::query(const std::string& start_key, const std::string& end_key) {
-    if (!loaded_) {
-        load();
+void Part::write_granule_stream(size_t granule_count, const std::function<Granule(size_t)>& next_granule) {
+    if (granule_count == 0) {
+        throw std::runtime_error("Cannot write empty granules");
     }
 
-    RowVector result;
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    begin_write();
+
+    index_.clear();
+    metadata_.granule_count = granule_count;
+    metadata_.row_count = 0;
+    metadata_.creation_time = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::vector<uint64_t> timestamps;
+    key_bloom_ = BloomFilter(granule_count * GRANULE_SIZE, KEY_BLOOM_BITS_PER_KEY);
+    auto skip_indexes = create_skip_indexes();
+    std::vector<uint64_t> sample_hashes(granule_count, UINT64_MAX);
+    PartSketches sketches;
+    std::vector<std::string> values;
+
+    for (size_t i = 0; i < granule_count; ++i) {
+        Granule granule = next_granule(i);
+        granule.sort();
+
+        if (i == 0) {
+            metadata_.min_key = granule.min_key();
+        }
+        metadata_.max_key = granule.max_key();
+        metadata_.row_count += granule.size();
+        values.clear();
+        for (const auto& row : granule.rows()) {
+            timestamps.push_back(row.timestamp);
+            key_bloom_.add(row.key);
+            sample_hashes[i] = std::min(sample_hashes[i], key_sample_hash(row.key.data(), row.key.size()));
+            sketches.add(i, row.key, row.value);
+            values.push_back(row.value);
+        }
+        for (auto& index : skip_indexes) {
+            index->add_granule(values);
+        }
+
+        Serialization::write_granule(part_directory(), granule, i);
+        index_.add_entry(granule.min_key(), granule.max_key(), i, granule.size(),
+                         granule.min_timestamp(), granule.max_timestamp());
+    }
+
+    update_timestamp_stats(timestamps);
+    compute_granule_offsets();
+    deleted_rows_.clear();
+    save_index();
+    save_key_bloom();
+    save_skip_indexes(skip_indexes);
+    save_sample_hashes(std::move(sample_hashes));
+    save_sketches(std::move(sketches));
+    commit_write();
+
+    granules_.clear();
+    granules_.resize(granule_count);
+    granule_loaded_.assign(granule_count, false);
+    opened_ = true;
+    loaded_ = false;
+}
+
+void Part::begin_slices(size_t slice_count, size_t expected_rows) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (slice_count == 0) {
+        throw std::invalid_argument("A part needs at least one slice");
+    }
+
+    begin_write();
+
+    slice_block_granules_ = PartSketches::GROUP_GRANULES;
+    for (const auto& description : skip_index_descriptions_) {
+        slice_block_granules_ = std::lcm(slice_block_granules_, std::max<size_t>(1, description.granularity));
+    }
+
+    key_bloom_ = BloomFilter(expected_rows, KEY_BLOOM_BITS_PER_KEY);
+    slice_writers_.clear();
+    slice_writers_.resize(slice_count);
+    for (size_t i = 0; i < slice_count; ++i) {
+        auto& slice = slice_writers_[i];
+        slice.directory = part_directory() + "/slice_" + std::to_string(i);
+        std::filesystem::create_directories(slice.directory);
+        slice.skip_indexes = create_skip_indexes();
+    }
+}
+
+void Part::append_slice_row(size_t slice_index, Row row) {
+    auto& slice = slice_writers_[slice_index];
+    slice.pending_rows.push_back(std::move(row));
+
+    size_t block_rows = slice_block_granules_ * GRANULE_SIZE;
+    if (slice.pending_rows.size() < block_rows) {
+        return;
+    }
+    // The previous slice's last granule may be partly filled, so each slice
+    // but the first leaves its first block to commit_slices, which writes it
+    // together with those rows.
+    if (slice_index > 0 && !slice.head_taken) {
+        slice.head_rows = std::move(slice.pending_rows);
+        slice.pending_rows.clear();
+        slice.head_taken = true;
+        return;
+    }
+    write_slice_granules(slice, block_rows, slice_block_granules_);
+}
+
+void Part::write_slice_granules(SliceWriter& slice, size_t row_count, size_t granule_count) {
+    std::vector<std::string> values;
+    size_t first = 0;
+    for (size_t g = 0; g < granule_count; ++g) {
+        size_t last = row_count * (g + 1) / granule_count;
+        Granule granule;
+        for (size_t i = first; i < last; ++i) {
+            granule.add_row(std::move(slice.pending_rows[i]));
+        }
+        first = last;
+        granule.sort();
+
+        size_t granule_index = slice.entries.size();
+        uint64_t sample_hash = UINT64_MAX;
+        values.clear();
+        for (const auto& row : granule.rows()) {
+            slice.timestamps.push_back(row.timestamp);
+            sample_hash = std::min(sample_hash, key_sample_hash(row.key.data(), row.key.size()));
+            slice.sketches.add(granule_index, row.key, row.value);
+            values.push_back(row.value);
+        }
+        for (auto& index : slice.skip_indexes) {
+            index->add_granule(values);
+        }
+        slice.sample_hashes.push_back(sample_hash);
+        {
+            std::lock_guard<std::mutex> lock(slice_bloom_mutex_);
+            for (const auto& row : granule.rows()) {
+                key_bloom_.add(row.key);
+            }
+        }
+
+        Serialization::write_granule(slice.directory, granule, granule_index);
+        slice.entries.emplace_back(granule.min_key(), granule.max_key(), granule_index, granule.size(),
+                                   granule.min_timestamp(), granule.max_timestamp());
+    }
+    slice.pending_rows.erase(slice.pending_rows.begin(), slice.pending_rows.begin() + row_count);
+}
+
+void Part::commit_slices() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    // The rows held back between two slices' written blocks become a run of
+    // their own, cut to whole blocks unless it ends the part, so every run
+    // starts on a block boundary.
+    std::vector<SliceWriter> runs;
+    RowVector held_rows;
+    auto add_held_run = [&](bool last) {
+        if (held_rows.empty()) {
+            return;
+        }
+        SliceWriter run;
+        run.directory = part_directory() + "/run_" + std::to_string(runs.size());
+        std::filesystem::create_directories(run.directory);
+        run.skip_indexes = create_skip_indexes();
+        run.pending_rows = std::move(held_rows);
+        held_rows.clear();
+
+        size_t rows = run.pending_rows.size();
+        size_t granules = (rows + GRANULE_SIZE - 1) / GRANULE_SIZE;
+        if (!last) {
+            // Holds at least the next slice's first block, so at least one
+            // row per granule.
+            granules = (granules + slice_block_granules_ - 1) / slice_block_granules_ * slice_block_granules_;
+        }
+        write_slice_granules(run, rows, granules);
+        for (auto& index : run.skip_indexes) {
+            index->finish();
+        }
+        runs.push_back(std::move(run));
+    };
+    auto hold = [&](RowVector& rows) {
+        held_rows.insert(held_rows.end(), std::make_move_iterator(rows.begin()), std::make_move_iterator(rows.end()));
+        rows.clear();
+    };
+    for (auto& slice : slice_writers_) {
+        RowVector tail_rows = std::move(slice.pending_rows);
+        hold(slice.head_rows);
+        if (!slice.entries.empty()) {
+            add_held_run(false);
+            runs.push_back(std::move(slice));
+        } else {
+            std::filesystem::remove_all(slice.directory);
+        }
+        hold(tail_rows);
+    }
+    add_held_run(true);
+    slice_writers_.clear();
+
+    index_.clear();
+    metadata_.granule_count = 0;
+    metadata_.row_count = 0;
+    metadata_.creation_time = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::vector<uint64_t> timestamps;
+    std::vector<uint64_t> sample_hashes;
+    PartSketches sketches;
+    std::vector<std::unique_ptr<SkipIndex>> skip_indexes;
 
+    for (auto& run : runs) {
+        size_t granule_offset = metadata_.granule_count;
+        for (const auto& entry : run.entries) {
+            size_t granule_index = granule_offset + entry.granule_index;
+            for (const char* column : GRANULE_COLUMNS) {
+                std::string file = Serialization::granule_file(run.directory, entry.granule_index, column);
+                if (Serialization::file_exists(file)) {
+                    std::filesystem::rename(file, Serialization::granule_file(part_directory(), granule_index, column));
+                }
+            }
+            if (granule_index == 0) {
+                metadata_.min_key = entry.min_key;
+            }
+            metadata_.max_key = entry.max_key;
+            metadata_.row_count += entry.row_count;
+            index_.add_entry(entry.min_key, entry.max_key, granule_index, entry.row_count, entry.min_timestamp,
+                             entry.max_timestamp);
+        }
+        std::filesystem::remove_all(run.directory);
+        metadata_.granule_count += run.entries.size();
+
+        timestamps.insert(timestamps.end(), run.timestamps.begin(), run.timestamps.end());
+        sample_hashes.insert(sample_hashes.end(), run.sample_hashes.begin(), run.sample_hashes.end());
+        sketches.append(run.sketches, granule_offset);
+        if (skip_indexes.empty()) {
+            skip_indexes = std::move(run.skip_indexes);
+        } else {
+            for (size_t i = 0; i < skip_indexes.size(); ++i) {
+                skip_indexes[i]->append(*run.skip_indexes[i]);
+            }
+        }
+    }
+
+    if (metadata_.granule_count == 0) {
+        throw std::runtime_error("Cannot write empty granules");
+    }
+
+    update_timestamp_stats(timestamps);
+    compute_granule_offsets();
+    deleted_rows_.clear();
+    save_index();
+    save_key_bloom();
+    save_skip_indexes(skip_indexes);
+    save_sample_hashes(std::move(sample_hashes));
+    save_sketches(std::move(sketches));
+    commit_write();
+
+    granules_.clear();
+    granules_.resize(metadata_.granule_count);
+    granule_loaded_.assign(metadata_.granule_count, false);
+    opened_ = true;
+    loaded_ = false;
+}
+
+RowVector Part::read_sort_columns(std::vector<uint32_t>& positions) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    open();
+    return read_sort_columns(metadata_.min_key, metadata_.max_key, positions);
+}
+
+RowVector Part::read_sort_columns(const std::string& start_key, const std::string& end_key,
+                                  std::vector<uint32_t>& positions) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    open();
+
+    RowVector result;
     if (!overlaps_range(start_key, end_key)) {
         return result;
     }
 
-    auto granule_indices = index_.find_granules(start_key, end_key);
+    for (size_t granule_idx : index_.find_granules(start_key, end_key)) {
+        if (granule_idx >= metadata_.granule_count) {
+            continue;
+        }
+
+        RowVector rows;
+        if (granule_loaded_[granule_idx]) {
+            for (const auto& row : granules_[granule_idx].rows()) {
+                rows.emplace_back(row.key, std::string(), row.timestamp, row.sign);
+            }
+        } else {
+            verify_granule(granule_idx);
+            rows = Serialization::read_granule_sort_columns(part_directory(), granule_idx);
+        }
+
+        size_t offset = granule_offsets_[granule_idx];
+        for (size_t i = 0; i < rows.size(); ++i) {
+            uint32_t position = static_cast<uint32_t>(offset + i);
+            if ((!deleted_rows_.empty() && deleted_rows_.contains(position)) ||
+                compare_keys(rows[i].key, start_key) < 0 || compare_keys(rows[i].key, end_key) > 0) {
+                continue;
+            }
+            result.push_back(std::move(rows[i]));
+            positions.push_back(position);
+        }
+    }
+
+    return result;
+}
+
+size_t Part::write_mutation(Part& source, const Mutation& mutation) {
+    std::lock_guard<std::recursive_mutex> source_lock(source.mutex_);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    source.open();
+
+    const PartMetadata& source_metadata = source.metadata();
+    std::string source_directory = source.part_directory();
+    begin_write();
+    std::string target_directory = part_directory();
+
+    index_.clear();
+    size_t affected = 0;
+    size_t granule_count = 0;
+    auto skip_indexes = create_skip_indexes();
+    std::vector<std::string> values;
+    source.load_sample_hashes();
+    bool source_has_sample_hashes = source.sample_hashes_.size() == source_metadata.granule_count;
+    std::vector<uint64_t> sample_hashes;
+    PartSketches sketches;
+
+    // Granules the mutation reads, and how many precede each granule.
+    const auto& source_entries = source.index_.entries();
+    std::vector<bool> has_deleted_rows(source_metadata.granule_count, false);
+    std::vector<size_t> read_before(source_metadata.granule_count + 1, 0);
+    for (const auto& entry : source_entries) {
+        size_t granule_idx = entry.granule_index;
+        if (granule_idx >= source_metadata.granule_count) {
+            continue;
+        }
+        size_t offset = source.granule_offsets_[granule_idx];
+        for (size_t i = 0; i < entry.row_count && !source.deleted_rows_.empty(); ++i) {
+            if (source.deleted_rows_.contains(static_cast<uint32_t>(offset + i))) {
+                has_deleted_rows[granule_idx] = true;
+                break;
+            }
+        }
+        if (has_deleted_rows[granule_idx] || entry.overlaps_range(mutation.start_key, mutation.end_key)) {
+            read_before[granule_idx + 1] = 1;
+        }
+    }
+    for (size_t i = 0; i < source_metadata.granule_count; ++i) {
+        read_before[i + 1] += read_before[i];
+    }
+
+    // While no granule has been dropped, the sketch group or skip index
+    // block of a granule covers the same granules as in the source, and is
+    // copied from it when none of them is read.
+    auto block_unread = [&](size_t granule_idx, size_t granules) {
+        size_t first = granule_idx / granules * granules;
+        size_t last = std::min(first + granules, source_metadata.granule_count);
+        return read_before[last] == read_before[first];
+    };
+    auto block_count = [&](size_t granules) {
+        return (source_metadata.granule_count + granules - 1) / granules;
+    };
+    source.load_sketches();
+    bool source_has_sketches = source.sketches_.group_count() == block_count(PartSketches::GROUP_GRANULES);
+    source.load_skip_indexes();
+    std::vector<const SkipIndex*> source_skip_indexes;
+    for (const auto& index : skip_indexes) {
+        const SkipIndexDescription& description = index->description();
+        const SkipIndex* match = nullptr;
+        for (const auto& source_index : source.skip_indexes_) {
+            if (source_index->description().name == description.name &&
+                source_index->description().same_blocks(description) &&
+                source_index->block_count() == block_count(description.granularity)) {
+                match = source_index.get();
+            }
+        }
+        source_skip_indexes.push_back(match);
+    }
+
+    // Linked files keep the source's checksums rather than being read and
+    // hashed again; those the source has not verified yet are checked on
+    // first access to this part instead.
+    PartChecksums linked_checksums;
+    std::vector<uint8_t> unverified_columns;
+    auto link_granule = [&](size_t granule_idx, bool include_values) {
+        Serialization::link_granule(source_directory, granule_idx, target_directory, granule_count, include_values);
+        unverified_columns.resize(granule_count + 1, 0);
+        for (const char* column : GRANULE_COLUMNS) {
+            if ((include_values || std::string(column) != "values") &&
+                linked_checksums.copy_entry(source.checksums_, granule_file_name(granule_idx, column),
+                                            granule_file_name(granule_count, column)) &&
+                !(source.granule_verified_[granule_idx] & column_bit(column))) {
+                unverified_columns[granule_count] |= column_bit(column);
+            }
+        }
+    };
+
+    for (const auto& entry : source_entries) {
+        size_t granule_idx = entry.granule_index;
+        if (granule_idx >= source_metadata.granule_count) {
+            continue;
+        }
+
+        if (!has_deleted_rows[granule_idx] && !entry.overlaps_range(mutation.start_key, mutation.end_key)) {
+            bool aligned = granule_count == granule_idx;
+            bool copy_sketches = aligned && source_has_sketches &&
+                                 block_unread(granule_idx, PartSketches::GROUP_GRANULES);
+            if (copy_sketches && granule_idx % PartSketches::GROUP_GRANULES == 0) {
+                sketches.add_group(granule_idx / PartSketches::GROUP_GRANULES,
+                                   source.sketches_.group(granule_idx / PartSketches::GROUP_GRANULES));
+            }
+            std::vector<bool> copy_blocks(skip_indexes.size(), false);
+            bool read_values = !copy_sketches;
+            for (size_t i = 0; i < skip_indexes.size(); ++i) {
+                size_t granularity = skip_indexes[i]->description().granularity;
+                copy_blocks[i] = aligned && source_skip_indexes[i] && block_unread(granule_idx, granularity);
+                if (copy_blocks[i] && granule_idx % granularity == 0) {
+                    skip_indexes[i]->copy_block(*source_skip_indexes[i], granule_idx / granularity);
+                }
+                read_values = read_values || !copy_blocks[i];
+            }
+
+            // Only groups and blocks holding a read granule, or shifted by a
+            // dropped one, are rebuilt from the linked files.
+            std::vector<std::string> keys;
+            if (!copy_sketches || !source_has_sample_hashes) {
+                source.verify_granule_column(granule_idx, "keys");
+                keys = Serialization::read_granule_keys(source_directory, granule_idx);
+            }
+            if (read_values) {
+                source.verify_granule_column(granule_idx, "values");
+                values = Serialization::read_granule_values(source_directory, granule_idx);
+            }
+            link_granule(granule_idx, true);
+            if (!copy_sketches) {
+                for (size_t i = 0; i < keys.size(); ++i) {
+                    sketches.add(granule_count, keys[i], values[i]);
+                }
+            }
+            for (size_t i = 0; i < skip_indexes.size(); ++i) {
+                if (!copy_blocks[i]) {
+                    skip_indexes[i]->add_granule(values);
+                }
+            }
+            if (source_has_sample_hashes) {
+                sample_hashes.push_back(source.sample_hashes_[granule_idx]);
+            } else {
+                uint64_t sample_hash = UINT64_MAX;
+                for (const auto& key : keys) {
+                    sample_hash = std::min(sample_hash, key_sample_hash(key.data(), key.size()));
+                }
+                sample_hashes.push_back(sample_hash);
+            }
+            IndexEntry linked = entry;
+            linked.granule_index = granule_count++;
+            index_.add_entry(linked);
+            continue;
+        }
+
+        size_t offset = source.granule_offsets_[granule_idx];
+        const auto& rows = source.load_granule(granule_idx).rows();
+        Granule granule;
+        size_t matched = 0;
+
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (has_deleted_rows[granule_idx] && source.deleted_rows_.contains(static_cast<uint32_t>(offset + i))) {
+                continue;
+            }
+
+            Row row = rows[i];
+            if (mutation.matches(row)) {
+                ++matched;
+                if (mutation.type == MutationType::Delete) {
+                    continue;
+                }
+                row.value = mutation.update(row);
+            }
+            granule.add_row(row);
+        }
+
+        affected += matched;
+        if (granule.is_empty()) {
+            continue;
+        }
+        granule.sort();
+        values.clear();
+        uint64_t sample_hash = UINT64_MAX;
+        for (const auto& row : granule.rows()) {
+            values.push_back(row.value);
+            sketches.add(granule_count, row.key, row.value);
+            sample_hash = std::min(sample_hash, key_sample_hash(row.key.data(), row.key.size()));
+        }
+        sample_hashes.push_back(sample_hash);
+        for (auto& index : skip_indexes) {
+            index->add_granule(values);
+        }
+
+        // Rows keep their order, so only changed columns need new files.
+        if (!has_deleted_rows[granule_idx] && matched == 0) {
+            link_granule(granule_idx, true);
+        } else if (!has_deleted_rows[granule_idx] && mutation.type == MutationType::Update) {
+            link_granule(granule_idx, false);
+            Serialization::write_granule_values(target_directory, granule, granule_count);
+        } else {
+            Serialization::write_granule(target_directory, granule, granule_count);
+        }
+
+        index_.add_entry(granule.min_key(), granule.max_key(), granule_count, granule.size(),
+                         granule.min_timestamp(), granule.max_timestamp());
+        ++granule_count;
+    }
+
+    metadata_.granule_count = granule_count;
+    metadata_.row_count = 0;
+    if (granule_count == 0) {
+        std::filesystem::remove_all(target_directory);
+        temporary_ = false;
+        return affected;
+    }
+
+    // Untouched granules are never read, so bounds come from the index and
+    // the timestamp quantiles are carried over from the source.
+    const auto& entries = index_.entries();
+    metadata_.min_key = entries.front().min_key;
+    metadata_.max_key = entries.back().max_key;
+    metadata_.min_timestamp = UINT64_MAX;
+    metadata_.max_timestamp = 0;
+    for (const auto& entry : entries) {
+        metadata_.row_count += entry.row_count;
+        metadata_.min_timestamp = std::min(metadata_.min_timestamp, entry.min_timestamp);
+        metadata_.max_timestamp = std::max(metadata_.max_timestamp, entry.max_timestamp);
+    }
+    metadata_.min_timestamp = std::max(metadata_.min_timestamp, source_metadata.min_timestamp);
+    metadata_.max_timestamp = std::min(metadata_.max_timestamp, source_metadata.max_timestamp);
+    metadata_.timestamp_quantiles = source_metadata.timestamp_quantiles;
+    metadata_.creation_time = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    metadata_.mutation_version = mutation.id;
+
+    compute_granule_offsets();
+    deleted_rows_.clear();
+    save_index();
+
+    // Mutations never add keys, so the source filter still covers this part.
+    std::string source_bloom = source_directory + "/key_bloom.bin";
+    if (Serialization::file_exists(source_bloom)) {
+        std::filesystem::copy_file(source_bloom, target_directory + "/key_bloom.bin");
+        linked_checksums.copy_entry(source.checksums_, "key_bloom.bin", "key_bloom.bin");
+    }
+    key_bloom_ = source.key_bloom_;
+    save_skip_indexes(skip_indexes);
+    save_sample_hashes(std::move(sample_hashes));
+    save_sketches(std::move(sketches));
+    commit_write(linked_checksums);
+    for (size_t i = 0; i < unverified_columns.size(); ++i) {
+        granule_verified_[i] &= static_cast<uint8_t>(~unverified_columns[i]);
+    }
+
+    granules_.clear();
+    granules_.resize(granule_count);
+    granule_loaded_.assign(granule_count, false);
+    opened_ = true;
+    loaded_ = false;
+    return affected;
+}
+
+RowVector Part::query(const std::string& start_key, const std::string& end_key) {
+    return query(start_key, end_key, 0, UINT64_MAX);
+}
+
+RowVector Part::query(const std::string& start_key, const std::string& end_key,
+                      uint64_t ts_from, uint64_t ts_to) {
+    return query_granules(start_key, end_key, ts_from, ts_to, nullptr, nullptr, nullptr);
+}
+
+RowVector Part::query(const std::string& start_key, const std::string& end_key,
+                      uint64_t ts_from, uint64_t ts_to, const ValueCondition& value_filter,
+                      SkipIndexStats* stats) {
+    return query_granules(start_key, end_key, ts_from, ts_to, &value_filter, nullptr, stats);
+}
+
+RowVector Part::query(const std::string& start_key, const std::string& end_key,
+                      uint64_t ts_from, uint64_t ts_to, const Predicate& predicate,
+                      const ValueCondition* value_filter, SkipIndexStats* stats) {
+    return query_granules(start_key, end_key, ts_from, ts_to, value_filter, &predicate, stats);
+}
+
+RowVector Part::query_granules(const std::string& start_key, const std::string& end_key,
+                               uint64_t ts_from, uint64_t ts_to, const ValueCondition* value_filter,
+                               const Predicate* predicate, SkipIndexStats* stats) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    open();
+
+    RowVector result;
+
+    if (!overlaps_range(start_key, end_key) || !overlaps_time_range(ts_from, ts_to)) {
+        return result;
+    }
+
+    auto granule_indices = index_.find_granules(start_key, end_key, ts_from, ts_to);
+    bool filtered = value_filter || predicate;
+    if (filtered) {
+        load_skip_indexes();
+    }
+    if (predicate) {
+        load_sample_hashes();
+    }
 
     for (size_t granule_idx : granule_indices) {
-        if (granule_idx < granules_.size()) {
-            auto granule_results = granules_[granule_idx].query_range(start_key, end_key);
-            result.insert(result.end(), granule_results.begin(), granule_results.end());
+        if (granule_idx >= metadata_.granule_count) {
+            continue;
+        }
+
+        if (filtered && !granule_passes_skip_indexes(granule_idx, value_filter, predicate, stats)) {
+            continue;
+        }
+
+        if (predicate && !granule_loaded_[granule_idx]) {
+            read_granule_filtered(granule_idx, start_key, end_key, ts_from, ts_to, value_filter, *predicate,
+                                  result);
+            continue;
+        }
+
+        const Granule& granule = load_granule(granule_idx);
+        auto [first, last] = granule.find_key_range(start_key, end_key);
+        const auto& rows = granule.rows();
+        size_t offset = granule_offsets_[granule_idx];
+
+        std::vector<uint8_t> selection(predicate ? rows.size() : 0, 0);
+        for (size_t i = first; i < last; ++i) {
+            if (rows[i].timestamp >= ts_from && rows[i].timestamp <= ts_to &&
+                (deleted_rows_.empty() || !deleted_rows_.contains(static_cast<uint32_t>(offset + i))) &&
+                (!value_filter || value_filter->matches(rows[i].value))) {
+                if (!predicate) {
+                    result.push_back(rows[i]);
+                } else {
+                    selection[i] = 1;
+                }
+            }
+        }
+
+        if (predicate) {
+            GranuleRowColumns columns(granule);
+            predicate->filter(columns, selection);
+            for (size_t i = first; i < last; ++i) {
+                if (selection[i]) {
+                    result.push_back(rows[i]);
+                }
+            }
         }
     }
 
     return result;
 }
 
+bool Part::granule_passes_skip_indexes(size_t granule_index, const ValueCondition* value_filter,
+                                       const Predicate* predicate, SkipIndexStats* stats) const {
+    if (skip_indexes_.empty() && (!predicate || sample_hashes_.empty())) {
+        return true;
+    }
+    bool may_match = granule_may_match(granule_index, value_filter, predicate);
+    if (stats) {
+        ++stats->granules_checked;
+        stats->granules_skipped += may_match ? 0 : 1;
+    }
+    return may_match;
+}
+
+void Part::read_granule_filtered(size_t granule_index, const std::string& start_key, const std::string& end_key,
+                                 uint64_t ts_from, uint64_t ts_to, const ValueCondition* value_filter,
+                                 const Predicate& predicate, RowVector& result) {
+    size_t rows = granule_offsets_[granule_index + 1] - granule_offsets_[granule_index];
+    GranuleFileColumns columns(part_directory(), granule_index, rows,
+                               [&](const std::string& column) { verify_granule_column(granule_index, column); });
+
+    std::vector<uint8_t> selection;
+    if (!select_granule_rows(granule_index, columns, start_key, end_key, ts_from, ts_to, value_filter, &predicate,
+                             selection)) {
+        return;
+    }
+
+    const auto& keys = columns.keys();
+    const auto& values = columns.values();
+    const auto& timestamps = columns.timestamps();
+    auto signs = columns.signs();
+    for (size_t i = 0; i < rows; ++i) {
+        if (selection[i]) {
+            result.emplace_back(std::string(keys[i]), std::string(values[i]), timestamps[i], signs[i]);
+        }
+    }
+}
+
+bool Part::select_granule_rows(size_t granule_index, PredicateColumns& columns, const std::string& start_key,
+                               const std::string& end_key, uint64_t ts_from, uint64_t ts_to,
+                               const ValueCondition* value_filter, const Predicate* predicate,
+                               std::vector<uint8_t>& selection) {
+    size_t offset = granule_offsets_[granule_index];
+    size_t rows = columns.size();
+
+    // The key and time bounds only need their columns when the granule
+    // straddles them.
+    selection.assign(rows, 1);
+    IndexEntry entry = index_.entry(granule_index);
+    bool bounds_known = entry.granule_index == granule_index;
+
+    if (!bounds_known || entry.min_key < start_key || entry.max_key > end_key) {
+        // Stored keys are sorted, so the range is contiguous.
+        const auto& keys = columns.keys();
+        size_t first = std::lower_bound(keys.begin(), keys.end(), start_key,
+            [](std::string_view key, const std::string& bound) { return compare_keys(key, bound) < 0; }) - keys.begin();
+        size_t last = std::upper_bound(keys.begin() + first, keys.end(), end_key,
+            [](const std::string& bound, std::string_view key) { return compare_keys(bound, key) < 0; }) - keys.begin();
+        std::fill(selection.begin(), selection.begin() + first, 0);
+        std::fill(selection.begin() + last, selection.end(), 0);
+    }
+    if (!bounds_known || entry.min_timestamp < ts_from || entry.max_timestamp > ts_to) {
+        const auto& timestamps = columns.timestamps();
+        for (size_t i = 0; i < rows; ++i) {
+            selection[i] &= static_cast<uint8_t>(timestamps[i] >= ts_from && timestamps[i] <= ts_to);
+        }
+    }
+    if (!deleted_rows_.empty()) {
+        for (size_t i = 0; i < rows; ++i) {
+            if (selection[i] && deleted_rows_.contains(static_cast<uint32_t>(offset + i))) {
+                selection[i] = 0;
+            }
+        }
+    }
+    if (value_filter) {
+        const auto& values = columns.values();
+        for (size_t i = 0; i < rows; ++i) {
+            if (selection[i]) {
+                selection[i] = static_cast<uint8_t>(value_filter->matches(values[i]));
+            }
+        }
+    }
+
+    if (predicate) {
+        predicate->filter(columns, selection);
+    }
+    return std::find(selection.begin(), selection.end(), 1) != selection.end();
+}
+
+void Part::aggregate(const std::string& start_key, const std::string& end_key, uint64_t ts_from, uint64_t ts_to,
+                     const GroupBySpec& spec, GroupByTable& table, const Predicate* predicate,
+                     const ValueCondition* value_filter, SkipIndexStats* stats) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    open();
+
+    if (!overlaps_range(start_key, end_key) || !overlaps_time_range(ts_from, ts_to)) {
+        return;
+    }
+
+    bool filtered = value_filter || predicate;
+    if (filtered) {
+        load_skip_indexes();
+    }
+    if (predicate) {
+        load_sample_hashes();
+    }
+
+    std::vector<uint8_t> selection;
+    for (size_t granule_idx : index_.find_granules(start_key, end_key, ts_from, ts_to)) {
+        if (granule_idx >= metadata_.granule_count ||
+            (filtered && !granule_passes_skip_indexes(granule_idx, value_filter, predicate, stats))) {
+            continue;
+        }
+
+        if (granule_loaded_[granule_idx]) {
+            const Granule& granule = granules_[granule_idx];
+            GranuleRowColumns columns(granule);
+            if (!select_granule_rows(granule_idx, columns, start_key, end_key, ts_from, ts_to, value_filter,
+                                     predicate, selection)) {
+                continue;
+            }
+            const auto& rows = granule.rows();
+            for (size_t i = 0; i < rows.size(); ++i) {
+                if (selection[i]) {
+                    table.add(spec.group_of(rows[i].key), rows[i].value, rows[i].sign);
+                }
+            }
+            continue;
+        }
+
+        size_t rows = granule_offsets_[granule_idx + 1] - granule_offsets_[granule_idx];
+        GranuleFileColumns columns(part_directory(), granule_idx, rows,
+                                   [&](const std::string& column) { verify_granule_column(granule_idx, column); });
+        if (!select_granule_rows(granule_idx, columns, start_key, end_key, ts_from, ts_to, value_filter, predicate,
+                                 selection)) {
+            continue;
+        }
+        const auto& keys = columns.keys();
+        const auto& values = columns.values();
+        auto signs = columns.signs();
+        for (size_t i = 0; i < rows; ++i) {
+            if (selection[i]) {
+                table.add(spec.group_of(keys[i]), values[i], signs[i]);
+            }
+        }
+    }
+}
+
+void Part::add_sketches(const std::string& start_key, const std::string& end_key, RowSketches& sketches) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    open();
+
+    if (!overlaps_range(start_key, end_key)) {
+        return;
+    }
+
+    load_sketches();
+    size_t group_size = PartSketches::GROUP_GRANULES;
+    bool usable = deleted_rows_.empty() &&
+                  sketches_.group_count() == (metadata_.granule_count + group_size - 1) / group_size;
+    if (usable && start_key <= metadata_.min_key && metadata_.max_key <= end_key) {
+        sketches.merge(sketches_.part());
+        return;
+    }
+
+    auto granule_indices = index_.find_granules(start_key, end_key);
+    for (size_t i = 0; i < granule_indices.size();) {
+        size_t group = granule_indices[i] / group_size;
+        size_t group_end = i;
+        while (group_end < granule_indices.size() && granule_indices[group_end] / group_size == group) {
+            ++group_end;
+        }
+
+        // A group's sketch stands for it only when all of its granules lie
+        // inside the range.
+        bool covered = usable;
+        size_t first_granule = group * group_size;
+        size_t last_granule = std::min<size_t>(first_granule + group_size, metadata_.granule_count);
+        for (size_t g = first_granule; covered && g < last_granule; ++g) {
+            IndexEntry entry = index_.entry(g);
+            covered = entry.granule_index == g && start_key <= entry.min_key && entry.max_key <= end_key;
+        }
+
+        if (covered) {
+            sketches.merge(sketches_.group(group));
+        } else {
+            for (size_t j = i; j < group_end; ++j) {
+                if (granule_indices[j] < metadata_.granule_count) {
+                    add_granule_sketches(granule_indices[j], start_key, end_key, sketches);
+                }
+            }
+        }
+        i = group_end;
+    }
+}
+
 RowVector Part::query_key(const std::string& key) {
     return query(key, key);
 }
 
-void Part::load() {
-    if (loaded_) {
+bool Part::may_contain_key(const std::string& key) {
+    return overlaps_range(key, key) && key_bloom_.may_contain(key);
+}
+
+size_t Part::delete_range(const std::string& start_key, const std::string& end_key) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    open();
+
+    if (!overlaps_range(start_key, end_key)) {
+        return 0;
+    }
+
+    size_t newly_deleted = 0;
+
+    for (size_t granule_idx : index_.find_granules(start_key, end_key)) {
+        if (granule_idx >= metadata_.granule_count) {
+            continue;
+        }
+
+        size_t offset = granule_offsets_[granule_idx];
+
+        if (granule_loaded_[granule_idx]) {
+            auto [first, last] = granules_[granule_idx].find_key_range(start_key, end_key);
+            for (size_t i = first; i < last; ++i) {
+                newly_deleted += deleted_rows_.add(static_cast<uint32_t>(offset + i));
+            }
+        } else {
+            verify_granule(granule_idx);
+            auto keys = Serialization::read_granule_keys(part_directory(), granule_idx);
+            auto first = std::lower_bound(keys.begin(), keys.end(), start_key);
+            auto last = std::upper_bound(first, keys.end(), end_key);
+            for (auto it = first; it != last; ++it) {
+                newly_deleted += deleted_rows_.add(static_cast<uint32_t>(offset + (it - keys.begin())));
+            }
+        }
+    }
+
+    if (newly_deleted > 0) {
+        save_deleted_rows();
+    }
+
+    return newly_deleted;
+}
+
+void Part::open() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (opened_) {
         return;
     }
 
@@ -101,30 +1153,78 @@ void Part::load() {
     }
 
     load_metadata();
+
+    // Parts written before checksums existed are read unverified.
+    checksums_ = PartChecksums();
+    std::string checksums_file = part_directory() + "/checksums.bin";
+    if (Serialization::file_exists(checksums_file)) {
+        checksums_.load_from_file(checksums_file);
+        checksums_.verify(part_directory(), "primary.idx");
+        checksums_.verify(part_directory(), "minmax_timestamp.idx");
+    }
+
     load_index();
+    compute_granule_offsets();
+    load_deleted_rows();
+    load_key_bloom();
+
+    if (metadata_.disk_size == 0) {
+        metadata_.disk_size = compute_disk_size();
+    }
 
     granules_.clear();
-    granules_.reserve(metadata_.granule_count);
+    granules_.resize(metadata_.granule_count);
+    granule_loaded_.assign(metadata_.granule_count, false);
+    granule_verified_.assign(metadata_.granule_count, 0);
+    opened_ = true;
+}
+
+void Part::load() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (loaded_) {
+        return;
+    }
+
+    open();
 
     for (size_t i = 0; i < metadata_.granule_count; ++i) {
-        granules_.push_back(Serialization::read_granule(part_directory(), i));
+        load_granule(i);
     }
 
     loaded_ = true;
 }
 
 void Part::unload() {
-    granules_.clear();
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    for (size_t i = 0; i < granules_.size(); ++i) {
+        granules_[i] = Granule();
+        granule_loaded_[i] = false;
+    }
     loaded_ = false;
 }
 
 std::string Part::part_directory() const {
-    return base_path_ + "/part_" + std::to_string(metadata_.part_id);
+    return partition_directory(base_path_, metadata_.partition_id) + (temporary_ ? "/tmp_part_" : "/part_") +
+           std::to_string(metadata_.part_id);
+}
+
+bool Part::is_temporary_directory(const std::string& dirname) {
+    return dirname.rfind("tmp_part_", 0) == 0;
+}
+
+std::string Part::partition_directory(const std::string& base_path, const std::string& partition_id) {
+    if (partition_id.empty()) {
+        return base_path;
+    }
+    return base_path + "/partition_" + partition_id;
 }
 
 void Part::save_metadata() {
+    // Committed parts rewrite metadata (mutation version bumps), so it is
+    // replaced atomically rather than truncated in place.
     std::string metadata_file = part_directory() + "/metadata.bin";
-    std::ofstream ofs(metadata_file, std::ios::binary);
+    std::string tmp_file = metadata_file + ".tmp";
+    std::ofstream ofs(tmp_file, std::ios::binary);
 
     if (!ofs) {
         throw std::runtime_error("Cannot save metadata: " + metadata_file);
@@ -139,6 +1239,18 @@ void Part::save_metadata() {
     Serialization::write_uint64(ofs, metadata_.granule_count);
     Serialization::write_uint64(ofs, metadata_.disk_size);
     Serialization::write_uint64(ofs, metadata_.creation_time);
+    Serialization::write_string(ofs, metadata_.partition_id);
+    Serialization::write_uint64(ofs, metadata_.timestamp_quantiles.size());
+    for (uint64_t quantile : metadata_.timestamp_quantiles) {
+        Serialization::write_uint64(ofs, quantile);
+    }
+    Serialization::write_uint64(ofs, metadata_.mutation_version);
+    ofs.close();
+
+    if (!temporary_) {
+        Serialization::sync_file(tmp_file);
+    }
+    std::filesystem::rename(tmp_file, metadata_file);
 }
 
 void Part::load_metadata() {
@@ -158,6 +1270,21 @@ void Part::load_metadata() {
     metadata_.granule_count = Serialization::read_uint64(ifs);
     metadata_.disk_size = Serialization::read_uint64(ifs);
     metadata_.creation_time = Serialization::read_uint64(ifs);
+
+    // Fields below were appended later; older parts simply end here.
+    if (ifs.peek() != std::ifstream::traits_type::eof()) {
+        metadata_.partition_id = Serialization::read_string(ifs);
+    }
+    if (ifs.peek() != std::ifstream::traits_type::eof()) {
+        uint64_t count = Serialization::read_uint64(ifs);
+        metadata_.timestamp_quantiles.resize(count);
+        for (auto& quantile : metadata_.timestamp_quantiles) {
+            quantile = Serialization::read_uint64(ifs);
+        }
+    }
+    if (ifs.peek() != std::ifstream::traits_type::eof()) {
+        metadata_.mutation_version = Serialization::read_uint64(ifs);
+    }
 }
 
 bool Part::exists_on_disk() const {
@@ -166,17 +1293,16 @@ bool Part::exists_on_disk() const {
 }
 
 void Part::delete_from_disk() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     if (exists_on_disk()) {
         std::filesystem::remove_all(part_directory());
     }
-    unload();
+    granules_.clear();
+    granule_loaded_.clear();
+    loaded_ = false;
 }
 
-size_t Part::disk_usage() const {
-    if (!exists_on_disk()) {
-        return 0;
-    }
-
+size_t Part::compute_disk_size() const {
     size_t total = 0;
     for (const auto& entry : std::filesystem::recursive_directory_iterator(part_directory())) {
         if (entry.is_regular_file()) {
@@ -187,13 +1313,21 @@ size_t Part::disk_usage() const {
 }
 
 size_t Part::memory_usage() const {
-    if (!loaded_) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (!opened_) {
         return sizeof(Part) + sizeof(metadata_);
     }
 
-    size_t total = sizeof(Part) + sizeof(metadata_) + index_.memory_usage();
-    for (const auto& granule : granules_) {
-        total += granule.memory_usage();
+    size_t total = sizeof(Part) + sizeof(metadata_) + index_.memory_usage() + deleted_rows_.memory_usage() +
+                   key_bloom_.memory_usage() + sample_hashes_.capacity() * sizeof(uint64_t) +
+                   sketches_.memory_usage();
+    for (const auto& index : skip_indexes_) {
+        total += index->memory_usage();
+    }
+    for (size_t i = 0; i < granules_.size(); ++i) {
+        if (granule_loaded_[i]) {
+            total += granules_[i].memory_usage();
+        }
     }
     return total;
 }
@@ -202,20 +1336,99 @@ bool Part::overlaps_range(const std::string& start_key, const std::string& end_k
     return !(metadata_.max_key < start_key || metadata_.min_key > end_key);
 }
 
+bool Part::overlaps_time_range(uint64_t ts_from, uint64_t ts_to) const {
+    return !(metadata_.max_timestamp < ts_from || metadata_.min_timestamp > ts_to);
+}
+
+size_t Part::estimate_rows_older_than(uint64_t cutoff) const {
+    if (metadata_.max_timestamp < cutoff) {
+        return metadata_.row_count;
+    }
+    if (metadata_.min_timestamp >= cutoff) {
+        return 0;
+    }
+
+    const auto& quantiles = metadata_.timestamp_quantiles;
+    if (quantiles.size() >= 2) {
+        size_t i = std::lower_bound(quantiles.begin(), quantiles.end(), cutoff) - quantiles.begin();
+        double low = static_cast<double>(quantiles[i - 1]);
+        double high = static_cast<double>(quantiles[i]);
+        double within = high > low ? (static_cast<double>(cutoff) - low) / (high - low) : 0.0;
+        double fraction = (static_cast<double>(i - 1) + within) / static_cast<double>(quantiles.size() - 1);
+        return static_cast<size_t>(metadata_.row_count * fraction);
+    }
+
+    double expired = 0;
+    for (const auto& entry : index_.entries()) {
+        if (entry.max_timestamp < cutoff) {
+            expired += entry.row_count;
+        } else if (entry.min_timestamp < cutoff) {
+            double span = static_cast<double>(entry.max_timestamp - entry.min_timestamp) + 1.0;
+            expired += entry.row_count * (static_cast<double>(cutoff - entry.min_timestamp) / span);
+        }
+    }
+    return static_cast<size_t>(expired);
+}
+
+size_t Part::live_row_count() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return metadata_.row_count - deleted_rows_.cardinality();
+}
+
 RowVector Part::get_all_rows() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     if (!loaded_) {
         load();
     }
 
     RowVector result;
-    for (const auto& granule : granules_) {
-        const auto& rows = granule.rows();
-        result.insert(result.end(), rows.begin(), rows.end());
+    result.reserve(live_row_count());
+
+    for (size_t granule_idx = 0; granule_idx < granules_.size(); ++granule_idx) {
+        const auto& rows = granules_[granule_idx].rows();
+
+        if (deleted_rows_.empty()) {
+            result.insert(result.end(), rows.begin(), rows.end());
+            continue;
+        }
+
+        size_t offset = granule_offsets_[granule_idx];
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (!deleted_rows_.contains(static_cast<uint32_t>(offset + i))) {
+                result.push_back(rows[i]);
+            }
+        }
     }
 
     return result;
 }
 
+RowVector Part::read_granule_rows(size_t granule_index) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    open();
+
+    RowVector rows;
+    if (granule_loaded_[granule_index]) {
+        rows = granules_[granule_index].rows();
+    } else {
+        verify_granule(granule_index);
+        Granule granule = Serialization::read_granule(part_directory(), granule_index);
+        rows = std::move(granule.rows());
+    }
+
+    if (!deleted_rows_.empty()) {
+        size_t offset = granule_offsets_[granule_index];
+        size_t kept = 0;
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (!deleted_rows_.contains(static_cast<uint32_t>(offset + i))) {
+                rows[kept++] = std::move(rows[i]);
+            }
+        }
+        rows.resize(kept);
+    }
+    return rows;
+}
+
 void Part::update_metadata(const std::vector<Granule>& granules) {
     metadata_.granule_count = granules.size();
     metadata_.row_count = 0;
@@ -229,20 +1442,34 @@ void Part::update_metadata(const std::vector<Granule>& granules) {
     metadata_.min_key = granules.front().min_key();
     metadata_.max_key = granules.back().max_key();
 
-    uint64_t min_ts = UINT64_MAX;
-    uint64_t max_ts = 0;
+    std::vector<uint64_t> timestamps;
 
     for (const auto& granule : granules) {
         metadata_.row_count += granule.size();
 
         for (const auto& row : granule.rows()) {
-            min_ts = std::min(min_ts, row.timestamp);
-            max_ts = std::max(max_ts, row.timestamp);
+            timestamps.push_back(row.timestamp);
         }
     }
 
-    metadata_.min_timestamp = min_ts;
-    metadata_.max_timestamp = max_ts;
+    update_timestamp_stats(timestamps);
+}
+
+void Part::update_timestamp_stats(std::vector<uint64_t>& timestamps) {
+    metadata_.timestamp_quantiles.clear();
+    if (timestamps.empty()) {
+        return;
+    }
+
+    std::sort(timestamps.begin(), timestamps.end());
+
+    metadata_.min_timestamp = timestamps.front();
+    metadata_.max_timestamp = timestamps.back();
+
+    for (size_t i = 0; i <= TIMESTAMP_QUANTILE_STEPS; ++i) {
+        size_t position = (timestamps.size() - 1) * i / TIMESTAMP_QUANTILE_STEPS;
+        metadata_.timestamp_quantiles.push_back(timestamps[position]);
+    }
 }
 
 void Part::build_index(const std::vector<Granule>& granules) {
@@ -251,19 +1478,253 @@ void Part::build_index(const std::vector<Granule>& granules) {
     for (size_t i = 0; i < granules.size(); ++i) {
         const auto& granule = granules[i];
         if (!granule.is_empty()) {
-            index_.add_entry(granule.min_key(), granule.max_key(), i, granule.size());
+            index_.add_entry(granule.min_key(), granule.max_key(), i, granule.size(),
+                             granule.min_timestamp(), granule.max_timestamp());
         }
     }
 }
 
 void Part::save_index() {
+    index_.build_search_tree();
     std::string index_file = part_directory() + "/primary.idx";
     index_.save_to_file(index_file);
+    index_.save_timestamp_index(part_directory() + "/minmax_timestamp.idx");
 }
 
 void Part::load_index() {
     std::string index_file = part_directory() + "/primary.idx";
     index_.load_from_file(index_file);
+
+    std::string timestamp_index_file = part_directory() + "/minmax_timestamp.idx";
+    if (Serialization::file_exists(timestamp_index_file)) {
+        index_.load_timestamp_index(timestamp_index_file);
+    }
+}
+
+const Granule& Part::load_granule(size_t granule_index) {
+    if (!granule_loaded_[granule_index]) {
+        verify_granule(granule_index);
+        granules_[granule_index] = Serialization::read_granule(part_directory(), granule_index);
+        granule_loaded_[granule_index] = true;
+    }
+    return granules_[granule_index];
+}
+
+void Part::compute_granule_offsets() {
+    granule_offsets_.assign(metadata_.granule_count + 1, 0);
+
+    std::vector<size_t> granule_rows(metadata_.granule_count, 0);
+    for (const auto& entry : index_.entries()) {
+        if (entry.granule_index < granule_rows.size()) {
+            granule_rows[entry.granule_index] = entry.row_count;
+        }
+    }
+
+    for (size_t i = 0; i < granule_rows.size(); ++i) {
+        granule_offsets_[i + 1] = granule_offsets_[i] + granule_rows[i];
+    }
+
+    if (granule_offsets_.back() > UINT32_MAX) {
+        throw std::runtime_error("Part has too many rows for a row mask: " + part_directory());
+    }
+}
+
+void Part::save_deleted_rows() {
+    std::string mask_file = part_directory() + "/deleted_rows.bin";
+    std::string tmp_file = mask_file + ".tmp";
+    deleted_rows_.save_to_file(tmp_file);
+    std::filesystem::rename(tmp_file, mask_file);
+}
+
+void Part::load_deleted_rows() {
+    std::string mask_file = part_directory() + "/deleted_rows.bin";
+    deleted_rows_.clear();
+    if (Serialization::file_exists(mask_file)) {
+        deleted_rows_.load_from_file(mask_file);
+    }
+}
+
+void Part::save_key_bloom() {
+    key_bloom_.save_to_file(part_directory() + "/key_bloom.bin");
+}
+
+void Part::load_key_bloom() {
+    key_bloom_ = BloomFilter();
+    std::string bloom_file = part_directory() + "/key_bloom.bin";
+    if (Serialization::file_exists(bloom_file)) {
+        checksums_.verify(part_directory(), "key_bloom.bin");
+        key_bloom_.load_from_file(bloom_file);
+    }
+}
+
+std::vector<std::unique_ptr<SkipIndex>> Part::create_skip_indexes() const {
+    std::vector<std::unique_ptr<SkipIndex>> indexes;
+    for (const auto& description : skip_index_descriptions_) {
+        indexes.push_back(create_skip_index(description));
+    }
+    return indexes;
+}
+
+void Part::save_skip_indexes(std::vector<std::unique_ptr<SkipIndex>>& indexes) {
+    for (auto& index : indexes) {
+        index->finish();
+        index->save_to_file(part_directory() + "/" + SkipIndex::file_name(index->description().name));
+    }
+    skip_indexes_ = std::move(indexes);
+    skip_indexes_loaded_ = true;
+}
+
+void Part::load_skip_indexes() {
+    if (skip_indexes_loaded_) {
+        return;
+    }
+
+    skip_indexes_.clear();
+    for (const auto& entry : std::filesystem::directory_iterator(part_directory())) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("skp_idx_", 0) != 0 || entry.path().extension() != ".idx") {
+            continue;
+        }
+        checksums_.verify(part_directory(), name);
+        skip_indexes_.push_back(load_skip_index(entry.path().string()));
+    }
+    skip_indexes_loaded_ = true;
+}
+
+void Part::save_sample_hashes(std::vector<uint64_t> hashes) {
+    Serialization::write_uint64_vector(part_directory() + "/sample_hashes.bin", hashes);
+    sample_hashes_ = std::move(hashes);
+    sample_hashes_loaded_ = true;
+}
+
+void Part::load_sample_hashes() {
+    if (sample_hashes_loaded_) {
+        return;
+    }
+
+    sample_hashes_.clear();
+    std::string file = part_directory() + "/sample_hashes.bin";
+    if (Serialization::file_exists(file)) {
+        checksums_.verify(part_directory(), "sample_hashes.bin");
+        sample_hashes_ = Serialization::read_uint64_vector(file);
+    }
+    sample_hashes_loaded_ = true;
+}
+
+void Part::save_sketches(PartSketches sketches) {
+    sketches.finish();
+    sketches.save_to_file(part_directory() + "/sketches.bin");
+    sketches_ = std::move(sketches);
+    sketches_loaded_ = true;
+}
+
+void Part::load_sketches() {
+    if (sketches_loaded_) {
+        return;
+    }
+
+    sketches_ = PartSketches();
+    std::string file = part_directory() + "/sketches.bin";
+    if (Serialization::file_exists(file)) {
+        checksums_.verify(part_directory(), "sketches.bin");
+        sketches_.load_from_file(file);
+    }
+    sketches_loaded_ = true;
+}
+
+void Part::add_granule_sketches(size_t granule_index, const std::string& start_key, const std::string& end_key,
+                                RowSketches& sketches) {
+    std::vector<uint8_t> selection;
+    if (granule_loaded_[granule_index]) {
+        const Granule& granule = granules_[granule_index];
+        GranuleRowColumns columns(granule);
+        if (select_granule_rows(granule_index, columns, start_key, end_key, 0, UINT64_MAX, nullptr, nullptr,
+                                selection)) {
+            const auto& rows = granule.rows();
+            for (size_t i = 0; i < rows.size(); ++i) {
+                if (selection[i]) {
+                    sketches.add(rows[i].key, rows[i].value);
+                }
+            }
+        }
+        return;
+    }
+
+    size_t rows = granule_offsets_[granule_index + 1] - granule_offsets_[granule_index];
+    GranuleFileColumns columns(part_directory(), granule_index, rows,
+                               [&](const std::string& column) { verify_granule_column(granule_index, column); });
+    if (!select_granule_rows(granule_index, columns, start_key, end_key, 0, UINT64_MAX, nullptr, nullptr,
+                             selection)) {
+        return;
+    }
+    const auto& keys = columns.keys();
+    const auto& values = columns.values();
+    for (size_t i = 0; i < rows; ++i) {
+        if (selection[i]) {
+            sketches.add(keys[i], values[i]);
+        }
+    }
+}
+
+bool Part::granule_may_match(size_t granule_index, const ValueCondition* value_filter,
+                             const Predicate* predicate) const {
+    auto value_may_match = [&](const ValueCondition& condition) {
+        for (const auto& index : skip_indexes_) {
+            if (!index->may_match(granule_index, condition)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto sample_may_match = [&](uint64_t bound) {
+        return sample_hashes_.size() != metadata_.granule_count || sample_hashes_[granule_index] <= bound;
+    };
+    return (!value_filter || value_may_match(*value_filter)) &&
+           (!predicate || predicate->may_match(value_may_match, sample_may_match));
+}
+
+void Part::begin_write() {
+    temporary_ = true;
+    std::filesystem::remove_all(part_directory());
+    create_directory();
+}
+
+void Part::commit_write(const PartChecksums& linked) {
+    std::string directory = part_directory();
+
+    checksums_ = PartChecksums::compute(directory, linked);
+    checksums_.save_to_file(directory + "/checksums.bin");
+    metadata_.disk_size = compute_disk_size();
+    save_metadata();
+
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            Serialization::sync_file(entry.path().string());
+        }
+    }
+    Serialization::sync_directory(directory);
+
+    temporary_ = false;
+    std::filesystem::rename(directory, part_directory());
+    Serialization::sync_directory(partition_directory(base_path_, metadata_.partition_id));
+
+    granule_verified_.assign(metadata_.granule_count, ALL_COLUMNS_VERIFIED);
+}
+
+void Part::verify_granule(size_t granule_index) {
+    for (const char* column : GRANULE_COLUMNS) {
+        verify_granule_column(granule_index, column);
+    }
+}
+
+void Part::verify_granule_column(size_t granule_index, const std::string& column) {
+    uint8_t bit = column_bit(column);
+    if (checksums_.empty() || (granule_verified_[granule_index] & bit)) {
+        return;
+    }
+
+    checksums_.verify(part_directory(), granule_file_name(granule_index, column));
+    granule_verified_[granule_index] |= bit;
 }
 
 void Part::create_directory() {
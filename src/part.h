@@ -3,9 +3,19 @@
 #include "row.h"
 #include "granule.h"
 #include "sparse_index.h"
+#include "row_mask.h"
+#include "mutation.h"
+#include "part_checksums.h"
+#include "bloom_filter.h"
+#include "skip_index.h"
+#include "predicate.h"
+#include "group_by.h"
+#include "part_sketches.h"
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <functional>
 
 namespace clickhouse {
 
@@ -19,31 +29,183 @@ struct PartMetadata {
     size_t granule_count;
     size_t disk_size;
     uint64_t creation_time;
+    std::string partition_id;
+    // Evenly spaced timestamp quantiles (min, ..., max) used to estimate how
+    // many rows a TTL cutoff would remove without reading the part.
+    std::vector<uint64_t> timestamp_quantiles;
+    // Id of the last mutation applied to (or submitted before) this data.
+    size_t mutation_version;
 
     PartMetadata() = default;
-    PartMetadata(size_t id) : part_id(id), row_count(0), granule_count(0),
-                              disk_size(0), creation_time(0) {}
+    PartMetadata(size_t id) : part_id(id), min_timestamp(0), max_timestamp(0), row_count(0),
+                              granule_count(0), disk_size(0), creation_time(0), mutation_version(0) {}
 };
 
-class Part {
+class Part : public std::enable_shared_from_this<Part> {
 private:
     PartMetadata metadata_;
     std::string base_path_;
     std::vector<Granule> granules_;
+    std::vector<bool> granule_loaded_;
     SparseIndex index_;
+    std::vector<size_t> granule_offsets_;
+    RowMask deleted_rows_;
+    PartChecksums checksums_;
+    // Bloom filter over the part's keys (key_bloom.bin), read when the part
+    // is opened so point lookups never touch the disk; empty for parts
+    // written without one.
+    BloomFilter key_bloom_;
+    // Skip indexes built by the next write, and those of the written part
+    // (skp_idx_*.idx), read on the first filtered query.
+    std::vector<SkipIndexDescription> skip_index_descriptions_;
+    std::vector<std::unique_ptr<SkipIndex>> skip_indexes_;
+    bool skip_indexes_loaded_;
+    // Smallest key_sample_hash of each granule (sample_hashes.bin), read on
+    // the first sampled query, so SAMPLE skips granules holding no sampled
+    // key. Empty for parts written without it.
+    std::vector<uint64_t> sample_hashes_;
+    bool sample_hashes_loaded_;
+    // Key and value sketches of the part and of its granule groups
+    // (sketches.bin), read on the first estimate. Empty for parts written
+    // without them.
+    PartSketches sketches_;
+    bool sketches_loaded_;
+    // One slice of a parallel write (see begin_slices): its first block of
+    // rows (held back for commit_slices), rows not yet cut into granules,
+    // and the index entries, timestamps, sample hashes, sketches and skip
+    // indexes of the blocks written so far, numbered from 0 within the slice.
+    struct SliceWriter {
+        std::string directory;
+        RowVector head_rows;
+        bool head_taken = false;
+        RowVector pending_rows;
+        std::vector<IndexEntry> entries;
+        std::vector<uint64_t> timestamps;
+        std::vector<uint64_t> sample_hashes;
+        PartSketches sketches;
+        std::vector<std::unique_ptr<SkipIndex>> skip_indexes;
+    };
+    std::vector<SliceWriter> slice_writers_;
+    // Granules per block that slices write at a time: the sketch group size
+    // and every skip index granularity divide it, so the blocks of all
+    // slices join up in commit_slices.
+    size_t slice_block_granules_;
+    // Guards key_bloom_ while slices add their keys to it.
+    std::mutex slice_bloom_mutex_;
+    // Per granule, a bit per column file already checked against checksums.bin.
+    std::vector<uint8_t> granule_verified_;
+    bool opened_;
     bool loaded_;
+    // Set while the part is being written into tmp_part_N; it becomes
+    // part_N (and visible to load_existing_parts) only once complete.
+    bool temporary_;
+    // Guards lazily loaded granules and the row mask so a part can be read
+    // by queries while a mutation rewrites it.
+    mutable std::recursive_mutex mutex_;
 
 public:
-    Part(size_t part_id, const std::string& base_path);
+    Part(size_t part_id, const std::string& base_path, const std::string& partition_id = "");
 
     void write_granules(const std::vector<Granule>& granules);
 
     void write_from_memtable_rows(const RowVector& rows);
 
+    // Writes `granule_count` granules produced one at a time, keeping none
+    // of them in memory; used by vertical merges.
+    void write_granule_stream(size_t granule_count, const std::function<Granule(size_t)>& next_granule);
+
+    // Parallel write from `slice_count` consecutive key ranges: after
+    // begin_slices, each slice appends its sorted rows from its own thread,
+    // which cuts them into blocks of full granules and writes those (with
+    // their index entries, bloom filter keys, sketches and skip indexes) to
+    // a staging directory. commit_slices writes the rows each slice held
+    // back at its ends, numbers all granules in slice order and completes
+    // the part. `expected_rows` bounds the row count and sizes the key bloom
+    // filter.
+    void begin_slices(size_t slice_count, size_t expected_rows);
+
+    void append_slice_row(size_t slice_index, Row row);
+
+    void commit_slices();
+
+    // Key, timestamp and sign columns of the live rows (values left empty),
+    // with each row's position in the part appended to `positions`.
+    RowVector read_sort_columns(std::vector<uint32_t>& positions);
+
+    // As above, for the rows with a key in [start_key, end_key].
+    RowVector read_sort_columns(const std::string& start_key, const std::string& end_key,
+                                std::vector<uint32_t>& positions);
+
+    // Writes this (new) part as `source` with `mutation` applied. Granules the
+    // mutation cannot touch are hard-linked; an UPDATE rewrites only the value
+    // column of affected granules. Rows masked in the source are dropped.
+    // Returns rows affected; the part is left empty and not written when no
+    // row survives.
+    size_t write_mutation(Part& source, const Mutation& mutation);
+
+    void set_mutation_version(size_t version) { metadata_.mutation_version = version; }
+
+    // Skip indexes to build when the part is written, by a mutation as well:
+    // it reads the values of the granules it hard-links to index them.
+    void set_skip_indexes(const std::vector<SkipIndexDescription>& descriptions) {
+        skip_index_descriptions_ = descriptions;
+    }
+
     RowVector query(const std::string& start_key, const std::string& end_key);
 
+    RowVector query(const std::string& start_key, const std::string& end_key,
+                    uint64_t ts_from, uint64_t ts_to);
+
+    // Rows whose value satisfies `value_filter` as well; granules ruled out
+    // by any skip index of the part are not read.
+    RowVector query(const std::string& start_key, const std::string& end_key,
+                    uint64_t ts_from, uint64_t ts_to, const ValueCondition& value_filter,
+                    SkipIndexStats* stats = nullptr);
+
+    // Rows also accepted by `predicate` (and `value_filter`, when given).
+    // Granules not in memory are filtered column by column from their files:
+    // columns the filters need are read first into a selection, and the
+    // others only if some row is selected, copying just the selected rows.
+    RowVector query(const std::string& start_key, const std::string& end_key,
+                    uint64_t ts_from, uint64_t ts_to, const Predicate& predicate,
+                    const ValueCondition* value_filter = nullptr, SkipIndexStats* stats = nullptr);
+
+    // Folds the rows query() would return (under the same filters) into
+    // `table`, grouped by `spec`. Granules not in memory are aggregated
+    // straight from their column files, without building rows.
+    void aggregate(const std::string& start_key, const std::string& end_key, uint64_t ts_from, uint64_t ts_to,
+                   const GroupBySpec& spec, GroupByTable& table, const Predicate* predicate = nullptr,
+                   const ValueCondition* value_filter = nullptr, SkipIndexStats* stats = nullptr);
+
+    // Merges into `sketches` the sketches of the part's rows with a key in
+    // [start_key, end_key]: the part sketch when the range covers the part,
+    // else those of the granule groups inside the range, with the granules
+    // at its edges (and every granule of parts without sketches or with
+    // deleted rows) read exactly.
+    void add_sketches(const std::string& start_key, const std::string& end_key, RowSketches& sketches);
+
     RowVector query_key(const std::string& key);
 
+    // False when the key is outside the part's range or its bloom filter
+    // rules it out. Takes no lock: the filter does not change once the part
+    // is opened or written.
+    bool may_contain_key(const std::string& key);
+
+    // Marks rows with a key in [start_key, end_key] as deleted in the part's
+    // row mask (deleted_rows.bin). Only key columns are read; masked rows are
+    // skipped by reads and dropped by the next merge. Returns rows newly masked.
+    size_t delete_range(const std::string& start_key, const std::string& end_key);
+
+    const RowMask& deleted_rows() const { return deleted_rows_; }
+
+    // Rows not masked by deletes; safe while delete_range runs.
+    size_t live_row_count() const;
+
+    // Loads metadata and the sparse index only; granules are read on demand.
+    void open();
+
+    bool is_open() const { return opened_; }
+
     void load();
 
     void unload();
@@ -54,8 +216,17 @@ public:
 
     const SparseIndex& index() const { return index_; }
 
+    const std::string& base_path() const { return base_path_; }
+
+    const std::string& partition_id() const { return metadata_.partition_id; }
+
+    // tmp_part_N while the part is being written, part_N afterwards.
     std::string part_directory() const;
 
+    static bool is_temporary_directory(const std::string& dirname);
+
+    static std::string partition_directory(const std::string& base_path, const std::string& partition_id);
+
     void save_metadata();
 
     void load_metadata();
@@ -64,23 +235,114 @@ public:
 
     void delete_from_disk();
 
-    size_t disk_usage() const;
+    // Size of the part's files, recorded in metadata when it is written
+    // (measured once on open for parts written without it).
+    size_t disk_usage() const { return metadata_.disk_size; }
 
     size_t memory_usage() const;
 
     bool overlaps_range(const std::string& start_key, const std::string& end_key) const;
 
+    bool overlaps_time_range(uint64_t ts_from, uint64_t ts_to) const;
+
+    // Estimates rows with timestamp < cutoff from the timestamp quantiles, or
+    // from per-granule timestamp bounds for parts written without them.
+    size_t estimate_rows_older_than(uint64_t cutoff) const;
+
     RowVector get_all_rows();
 
+    // Live rows of one granule, read from disk without keeping the granule
+    // in memory unless it is loaded already.
+    RowVector read_granule_rows(size_t granule_index);
+
 private:
     void update_metadata(const std::vector<Granule>& granules);
 
+    // Sets min/max timestamp and the timestamp quantiles; sorts `timestamps`.
+    void update_timestamp_stats(std::vector<uint64_t>& timestamps);
+
     void build_index(const std::vector<Granule>& granules);
 
     void save_index();
 
     void load_index();
 
+    const Granule& load_granule(size_t granule_index);
+
+    void compute_granule_offsets();
+
+    void save_deleted_rows();
+
+    void load_deleted_rows();
+
+    size_t compute_disk_size() const;
+
+    void save_key_bloom();
+
+    void load_key_bloom();
+
+    std::vector<std::unique_ptr<SkipIndex>> create_skip_indexes() const;
+
+    void save_skip_indexes(std::vector<std::unique_ptr<SkipIndex>>& indexes);
+
+    void load_skip_indexes();
+
+    void save_sample_hashes(std::vector<uint64_t> hashes);
+
+    void load_sample_hashes();
+
+    void save_sketches(PartSketches sketches);
+
+    void load_sketches();
+
+    // Cuts the first `row_count` pending rows of the slice into
+    // `granule_count` granules of similar size and writes them.
+    void write_slice_granules(SliceWriter& slice, size_t row_count, size_t granule_count);
+
+    // Adds the granule's rows with a key in [start_key, end_key] that are
+    // not deleted, read from memory or its key and value columns.
+    void add_granule_sketches(size_t granule_index, const std::string& start_key, const std::string& end_key,
+                              RowSketches& sketches);
+
+    bool granule_may_match(size_t granule_index, const ValueCondition* value_filter,
+                           const Predicate* predicate) const;
+
+    RowVector query_granules(const std::string& start_key, const std::string& end_key,
+                             uint64_t ts_from, uint64_t ts_to, const ValueCondition* value_filter,
+                             const Predicate* predicate, SkipIndexStats* stats);
+
+    // Appends the granule's rows passing all filters, read column-wise from disk.
+    void read_granule_filtered(size_t granule_index, const std::string& start_key, const std::string& end_key,
+                               uint64_t ts_from, uint64_t ts_to, const ValueCondition* value_filter,
+                               const Predicate& predicate, RowVector& result);
+
+    // Selection of the granule's rows (read through `columns`) passing the
+    // key and time bounds, the row mask and the filters given; false if
+    // none does.
+    bool select_granule_rows(size_t granule_index, PredicateColumns& columns, const std::string& start_key,
+                             const std::string& end_key, uint64_t ts_from, uint64_t ts_to,
+                             const ValueCondition* value_filter, const Predicate* predicate,
+                             std::vector<uint8_t>& selection);
+
+    // True unless a skip index (or, for a key sample, the granule's smallest
+    // sample hash) rules the granule out for the filters.
+    bool granule_passes_skip_indexes(size_t granule_index, const ValueCondition* value_filter,
+                                     const Predicate* predicate, SkipIndexStats* stats) const;
+
+    // Starts writing into a fresh temporary directory.
+    void begin_write();
+
+    // Records checksums, fsyncs the files, renames the temporary directory
+    // to part_N and fsyncs the partition directory. Files `linked` lists
+    // keep those checksums instead of being hashed.
+    void commit_write(const PartChecksums& linked = PartChecksums());
+
+    // Checks the granule's files against checksums.bin on first access.
+    void verify_granule(size_t granule_index);
+
+    // Checks one column file ("keys", "values", "timestamps" or "signs").
+    void verify_granule_column(size_t granule_index, const std::string& column);
+
     void create_directory();
 };
 
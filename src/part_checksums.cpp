@@ -0,0 +1,100 @@
+#include "part_checksums.h"
+#include "serialization.h"
+#include "hash.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace clickhouse {
+
+namespace {
+
+std::string read_file(const std::string& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file for checksum: " + file_path);
+    }
+    return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+}  // namespace
+
+PartChecksums PartChecksums::compute(const std::string& directory) {
+    return compute(directory, PartChecksums());
+}
+
+PartChecksums PartChecksums::compute(const std::string& directory, const PartChecksums& known) {
+    PartChecksums checksums = known;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::string file_name = entry.path().filename().string();
+        if (!entry.is_regular_file() || !is_covered(file_name) || known.files_.count(file_name)) {
+            continue;
+        }
+
+        std::string data = read_file(entry.path().string());
+        checksums.files_[file_name] = Checksum{data.size(), hash64(data)};
+    }
+    return checksums;
+}
+
+bool PartChecksums::copy_entry(const PartChecksums& source, const std::string& source_file,
+                               const std::string& file_name) {
+    auto it = source.files_.find(source_file);
+    if (it == source.files_.end()) {
+        return false;
+    }
+    files_[file_name] = it->second;
+    return true;
+}
+
+void PartChecksums::verify(const std::string& directory, const std::string& file_name) const {
+    auto it = files_.find(file_name);
+    if (it == files_.end()) {
+        return;
+    }
+
+    std::string file_path = directory + "/" + file_name;
+    if (!Serialization::file_exists(file_path) || Serialization::file_size(file_path) != it->second.size ||
+        hash64(read_file(file_path)) != it->second.hash) {
+        throw std::runtime_error("Checksum mismatch: " + file_path);
+    }
+}
+
+void PartChecksums::save_to_file(const std::string& file_path) const {
+    std::ofstream ofs(file_path, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Cannot save checksums: " + file_path);
+    }
+
+    Serialization::write_uint64(ofs, files_.size());
+    for (const auto& [file_name, checksum] : files_) {
+        Serialization::write_string(ofs, file_name);
+        Serialization::write_uint64(ofs, checksum.size);
+        Serialization::write_uint64(ofs, checksum.hash);
+    }
+}
+
+void PartChecksums::load_from_file(const std::string& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot load checksums: " + file_path);
+    }
+
+    files_.clear();
+    uint64_t count = Serialization::read_uint64(ifs);
+    for (uint64_t i = 0; i < count; ++i) {
+        std::string file_name = Serialization::read_string(ifs);
+        Checksum checksum;
+        checksum.size = Serialization::read_uint64(ifs);
+        checksum.hash = Serialization::read_uint64(ifs);
+        files_[file_name] = checksum;
+    }
+}
+
+bool PartChecksums::is_covered(const std::string& file_name) {
+    return file_name != "metadata.bin" && file_name != "deleted_rows.bin" && file_name != "checksums.bin" &&
+           file_name.find(".tmp") == std::string::npos;
+}
+
+}  // namespace clickhouse
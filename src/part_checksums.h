@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <cstdint>
+
+namespace clickhouse {
+
+// Sizes and hashes of a part's immutable files (columns and indexes),
+// stored in checksums.bin. Files rewritten in place after the part is
+// committed (metadata.bin, deleted_rows.bin) are not covered. Checked one
+// file at a time on first read, so opening a part never scans its data.
+class PartChecksums {
+private:
+    struct Checksum {
+        uint64_t size = 0;
+        uint64_t hash = 0;
+    };
+
+    std::map<std::string, Checksum> files_;
+
+public:
+    // Hashes every covered file in `directory`.
+    static PartChecksums compute(const std::string& directory);
+
+    // Hashes every covered file in `directory` but those `known` lists,
+    // whose entries are taken as they are.
+    static PartChecksums compute(const std::string& directory, const PartChecksums& known);
+
+    // Lists `file_name` with the entry `source` has for `source_file`, a file
+    // with the same bytes (such as a hard link); false if `source` has none.
+    bool copy_entry(const PartChecksums& source, const std::string& source_file, const std::string& file_name);
+
+    bool empty() const { return files_.empty(); }
+
+    size_t file_count() const { return files_.size(); }
+
+    // Throws if `file_name` is listed and the file in `directory` is missing
+    // or differs; files not listed are accepted.
+    void verify(const std::string& directory, const std::string& file_name) const;
+
+    void save_to_file(const std::string& file_path) const;
+
+    void load_from_file(const std::string& file_path);
+
+    static bool is_covered(const std::string& file_name);
+};
+
+}  // namespace clickhouse
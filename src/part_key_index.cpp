@@ -0,0 +1,168 @@
+#include "part_key_index.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace clickhouse {
+
+namespace {
+
+bool ordered_before(const std::string& min_key, uint64_t sequence, const std::string& other_min_key,
+                    uint64_t other_sequence) {
+    int cmp = min_key.compare(other_min_key);
+    return cmp < 0 || (cmp == 0 && sequence < other_sequence);
+}
+
+}  // namespace
+
+void PartKeyIndex::add(Part* part) {
+    insert(part, next_sequence_++);
+}
+
+void PartKeyIndex::replace(const Part* old_part, Part* part) {
+    auto it = sequences_.find(old_part);
+    if (it == sequences_.end()) {
+        throw std::logic_error("Part is not in the key index");
+    }
+    uint64_t sequence = it->second;
+    remove(old_part);
+    insert(part, sequence);
+}
+
+void PartKeyIndex::remove(const Part* part) {
+    auto it = sequences_.find(part);
+    if (it == sequences_.end()) {
+        return;
+    }
+    erase(root_, part->metadata().min_key, it->second);
+    sequences_.erase(it);
+}
+
+void PartKeyIndex::insert(Part* part, uint64_t sequence) {
+    auto node = std::make_unique<Node>();
+    const PartMetadata& metadata = part->metadata();
+    node->part = part;
+    node->min_key = &metadata.min_key;
+    node->max_key = &metadata.max_key;
+    node->sequence = sequence;
+    node->priority = rng_();
+    node->subtree_max = node->max_key;
+
+    std::unique_ptr<Node> before;
+    std::unique_ptr<Node> rest;
+    split(std::move(root_), metadata.min_key, sequence, before, rest);
+    root_ = join(join(std::move(before), std::move(node)), std::move(rest));
+    sequences_[part] = sequence;
+}
+
+void PartKeyIndex::split(std::unique_ptr<Node> node, const std::string& min_key, uint64_t sequence,
+                         std::unique_ptr<Node>& before, std::unique_ptr<Node>& rest) {
+    if (!node) {
+        before.reset();
+        rest.reset();
+        return;
+    }
+
+    if (ordered_before(*node->min_key, node->sequence, min_key, sequence)) {
+        split(std::move(node->right), min_key, sequence, node->right, rest);
+        update(*node);
+        before = std::move(node);
+    } else {
+        split(std::move(node->left), min_key, sequence, before, node->left);
+        update(*node);
+        rest = std::move(node);
+    }
+}
+
+std::unique_ptr<PartKeyIndex::Node> PartKeyIndex::join(std::unique_ptr<Node> left, std::unique_ptr<Node> right) {
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+
+    if (left->priority > right->priority) {
+        left->right = join(std::move(left->right), std::move(right));
+        update(*left);
+        return left;
+    }
+    right->left = join(std::move(left), std::move(right->left));
+    update(*right);
+    return right;
+}
+
+bool PartKeyIndex::erase(std::unique_ptr<Node>& node, const std::string& min_key, uint64_t sequence) {
+    if (!node) {
+        return false;
+    }
+
+    if (node->sequence == sequence) {
+        node = join(std::move(node->left), std::move(node->right));
+        return true;
+    }
+
+    bool erased = ordered_before(min_key, sequence, *node->min_key, node->sequence)
+                      ? erase(node->left, min_key, sequence)
+                      : erase(node->right, min_key, sequence);
+    if (erased) {
+        update(*node);
+    }
+    return erased;
+}
+
+void PartKeyIndex::update(Node& node) {
+    node.subtree_max = node.max_key;
+    for (const Node* child : {node.left.get(), node.right.get()}) {
+        if (child && *child->subtree_max > *node.subtree_max) {
+            node.subtree_max = child->subtree_max;
+        }
+    }
+}
+
+void PartKeyIndex::collect(const Node* node, const std::string& start_key, const std::string& end_key,
+                           std::vector<std::pair<uint64_t, Part*>>& result) {
+    // Nothing below ends at or after start_key.
+    if (!node || *node->subtree_max < start_key) {
+        return;
+    }
+
+    collect(node->left.get(), start_key, end_key, result);
+
+    // This part and those ordered after it start after end_key.
+    if (*node->min_key > end_key) {
+        return;
+    }
+
+    if (!(*node->max_key < start_key)) {
+        result.emplace_back(node->sequence, node->part);
+    }
+    collect(node->right.get(), start_key, end_key, result);
+}
+
+std::vector<Part*> PartKeyIndex::find_overlapping(const std::string& start_key, const std::string& end_key) const {
+    std::vector<std::pair<uint64_t, Part*>> matches;
+    collect(root_.get(), start_key, end_key, matches);
+    std::sort(matches.begin(), matches.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<Part*> result;
+    result.reserve(matches.size());
+    for (const auto& match : matches) {
+        result.push_back(match.second);
+    }
+    return result;
+}
+
+std::vector<Part*> PartKeyIndex::find_key(const std::string& key) const {
+    std::vector<Part*> result = find_overlapping(key, key);
+    result.erase(std::remove_if(result.begin(), result.end(),
+        [&](Part* part) { return !part->may_contain_key(key); }), result.end());
+    return result;
+}
+
+size_t PartKeyIndex::memory_usage() const {
+    return sizeof(PartKeyIndex) + sequences_.size() * (sizeof(Node) + sizeof(std::pair<const Part*, uint64_t>) +
+                                                       sizeof(void*));
+}
+
+}  // namespace clickhouse
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "part.h"
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace clickhouse {
+
+// Table-wide index over the key ranges of all parts: a treap ordered by min
+// key, each node annotated with the largest max key in its subtree. Parts
+// are added and removed one at a time as the part list changes, in
+// O(log parts), and finding the parts that overlap a range costs
+// O(log parts + matches); point lookups also consult each candidate's key
+// bloom filter. Results follow the order of the part list, which the index
+// tracks as a sequence number per part.
+class PartKeyIndex {
+private:
+    struct Node {
+        Part* part;
+        const std::string* min_key;
+        const std::string* max_key;
+        uint64_t sequence;
+        uint64_t priority;
+        // Largest max key in the subtree rooted here.
+        const std::string* subtree_max;
+        std::unique_ptr<Node> left;
+        std::unique_ptr<Node> right;
+    };
+
+    std::unique_ptr<Node> root_;
+    std::unordered_map<const Part*, uint64_t> sequences_;
+    uint64_t next_sequence_ = 0;
+    std::mt19937_64 rng_;
+
+public:
+    // Adds a part after every part already indexed.
+    void add(Part* part);
+
+    // Puts `part` in the place of `old_part` in the list order, as a merge
+    // does with its result and first input.
+    void replace(const Part* old_part, Part* part);
+
+    // Parts never added are ignored.
+    void remove(const Part* part);
+
+    // Parts whose key range overlaps [start_key, end_key], in list order.
+    std::vector<Part*> find_overlapping(const std::string& start_key, const std::string& end_key) const;
+
+    // Parts that may hold `key`: its range covers the key and its bloom
+    // filter does not rule it out.
+    std::vector<Part*> find_key(const std::string& key) const;
+
+    size_t memory_usage() const;
+
+private:
+    void insert(Part* part, uint64_t sequence);
+
+    // Splits `node` into the nodes ordered before (min_key, sequence) and
+    // the rest.
+    static void split(std::unique_ptr<Node> node, const std::string& min_key, uint64_t sequence,
+                      std::unique_ptr<Node>& before, std::unique_ptr<Node>& rest);
+
+    // Joins two treaps, every node of `left` ordered before those of `right`.
+    static std::unique_ptr<Node> join(std::unique_ptr<Node> left, std::unique_ptr<Node> right);
+
+    static bool erase(std::unique_ptr<Node>& node, const std::string& min_key, uint64_t sequence);
+
+    static void update(Node& node);
+
+    static void collect(const Node* node, const std::string& start_key, const std::string& end_key,
+                        std::vector<std::pair<uint64_t, Part*>>& result);
+};
+
+}  // namespace clickhouse
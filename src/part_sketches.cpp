@@ -0,0 +1,121 @@
+#include "part_sketches.h"
+#include "hash.h"
+#include "number.h"
+#include "serialization.h"
+#include <stdexcept>
+
+namespace clickhouse {
+
+namespace {
+
+constexpr uint64_t SKETCHES_FORMAT_VERSION = 1;
+
+}  // namespace
+
+void RowSketches::add(std::string_view key, std::string_view value) {
+    keys.add_hash(hash64(key.data(), key.size()));
+    double number;
+    if (parse_number(value, number)) {
+        values.add(number);
+    }
+    value_lengths.add(static_cast<double>(value.size()));
+}
+
+void RowSketches::merge(const RowSketches& other) {
+    keys.merge(other.keys);
+    values.merge(other.values);
+    value_lengths.merge(other.value_lengths);
+}
+
+size_t RowSketches::memory_usage() const {
+    return keys.memory_usage() + values.memory_usage() + value_lengths.memory_usage();
+}
+
+void RowSketches::serialize(std::ofstream& ofs) const {
+    Serialization::write_string(ofs, keys.serialize());
+    values.serialize(ofs);
+    value_lengths.serialize(ofs);
+}
+
+void RowSketches::deserialize(std::ifstream& ifs) {
+    keys = HyperLogLog::deserialize(Serialization::read_string(ifs));
+    values.deserialize(ifs);
+    value_lengths.deserialize(ifs);
+}
+
+void PartSketches::add(size_t granule_index, std::string_view key, std::string_view value) {
+    size_t group = granule_index / GROUP_GRANULES;
+    if (groups_.size() <= group) {
+        groups_.resize(group + 1);
+    }
+    groups_[group].add(key, value);
+}
+
+void PartSketches::append(const PartSketches& other, size_t granule_offset) {
+    if (granule_offset != groups_.size() * GROUP_GRANULES) {
+        throw std::logic_error("Sketch groups must start at a group boundary");
+    }
+    groups_.insert(groups_.end(), other.groups_.begin(), other.groups_.end());
+}
+
+void PartSketches::add_group(size_t group_index, const RowSketches& group) {
+    if (groups_.size() > group_index) {
+        throw std::logic_error("Sketch group already has rows");
+    }
+    groups_.resize(group_index + 1);
+    groups_[group_index] = group;
+}
+
+void PartSketches::finish() {
+    part_ = RowSketches();
+    for (const auto& group : groups_) {
+        part_.merge(group);
+    }
+}
+
+size_t PartSketches::memory_usage() const {
+    size_t total = sizeof(PartSketches) + part_.memory_usage();
+    for (const auto& group : groups_) {
+        total += group.memory_usage();
+    }
+    return total;
+}
+
+void PartSketches::save_to_file(const std::string& file_path) const {
+    std::ofstream ofs(file_path, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Cannot open file for writing: " + file_path);
+    }
+
+    Serialization::write_uint64(ofs, SKETCHES_FORMAT_VERSION);
+    part_.serialize(ofs);
+    Serialization::write_uint64(ofs, groups_.size());
+    for (const auto& group : groups_) {
+        group.serialize(ofs);
+    }
+}
+
+void PartSketches::load_from_file(const std::string& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file for reading: " + file_path);
+    }
+
+    if (Serialization::read_uint64(ifs) != SKETCHES_FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported sketches format: " + file_path);
+    }
+    part_.deserialize(ifs);
+    uint64_t group_count = Serialization::read_uint64(ifs);
+    if (!ifs) {
+        throw std::runtime_error("Truncated sketches: " + file_path);
+    }
+    groups_.assign(group_count, RowSketches());
+    for (auto& group : groups_) {
+        group.deserialize(ifs);
+    }
+    if (!ifs) {
+        throw std::runtime_error("Truncated sketches: " + file_path);
+    }
+}
+
+}  // namespace clickhouse
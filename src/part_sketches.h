@@ -0,0 +1,70 @@
+#pragma once
+
+#include "hyperloglog.h"
+#include "kll_sketch.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace clickhouse {
+
+// Approximate statistics of a set of rows: distinct keys, the values that
+// parse as numbers and the value lengths. Sketches of disjoint row sets
+// merge into the sketch of their union.
+struct RowSketches {
+    HyperLogLog keys;
+    KllSketch values;
+    KllSketch value_lengths;
+
+    void add(std::string_view key, std::string_view value);
+
+    void merge(const RowSketches& other);
+
+    size_t memory_usage() const;
+
+    void serialize(std::ofstream& ofs) const;
+
+    void deserialize(std::ifstream& ifs);
+};
+
+// Sketches of a part's rows as a whole and of each group of GROUP_GRANULES
+// consecutive granules, built while the part is written (sketches.bin).
+// Key ranges cutting through a part combine the groups they overlap.
+class PartSketches {
+private:
+    RowSketches part_;
+    std::vector<RowSketches> groups_;
+
+public:
+    static constexpr size_t GROUP_GRANULES = 8;
+
+    // Rows must arrive in granule order.
+    void add(size_t granule_index, std::string_view key, std::string_view value);
+
+    // Appends the groups of sketches built over the granules that follow,
+    // starting at `granule_offset`, which must begin a group.
+    void append(const PartSketches& other, size_t granule_offset);
+
+    // Takes the sketches of a whole group, built by another part over the
+    // same rows; no row of the group or a later one may be added yet.
+    void add_group(size_t group_index, const RowSketches& group);
+
+    // Folds the groups into the part sketches once every row is added.
+    void finish();
+
+    bool empty() const { return groups_.empty(); }
+
+    const RowSketches& part() const { return part_; }
+
+    size_t group_count() const { return groups_.size(); }
+
+    const RowSketches& group(size_t group_index) const { return groups_[group_index]; }
+
+    size_t memory_usage() const;
+
+    void save_to_file(const std::string& file_path) const;
+
+    void load_from_file(const std::string& file_path);
+};
+
+}  // namespace clickhouse
@@ -0,0 +1,146 @@
+#include "partition.h"
+#include <cstdio>
+#include <stdexcept>
+
+namespace clickhouse {
+
+namespace {
+
+constexpr int64_t SECONDS_PER_HOUR = 3600;
+constexpr int64_t SECONDS_PER_DAY = 86400;
+
+// Proleptic Gregorian calendar conversions (Howard Hinnant's algorithms).
+int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+void civil_from_days(int64_t z, int64_t& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+bool parse_digits(const std::string& str, size_t pos, size_t len, unsigned& out) {
+    out = 0;
+    for (size_t i = pos; i < pos + len; ++i) {
+        if (str[i] < '0' || str[i] > '9') {
+            return false;
+        }
+        out = out * 10 + static_cast<unsigned>(str[i] - '0');
+    }
+    return true;
+}
+
+}  // namespace
+
+PartitionKey::PartitionKey(PartitionGranularity granularity, uint64_t timestamp_units_per_second)
+    : granularity_(granularity), units_per_second_(timestamp_units_per_second) {
+    if (units_per_second_ == 0) {
+        throw std::invalid_argument("timestamp_units_per_second must be positive");
+    }
+}
+
+std::string PartitionKey::partition_id(uint64_t timestamp) const {
+    if (!enabled()) {
+        return "";
+    }
+
+    int64_t seconds = static_cast<int64_t>(timestamp / units_per_second_);
+    int64_t days = seconds / SECONDS_PER_DAY;
+    unsigned hour = static_cast<unsigned>((seconds % SECONDS_PER_DAY) / SECONDS_PER_HOUR);
+
+    int64_t year;
+    unsigned month, day;
+    civil_from_days(days, year, month, day);
+
+    char buffer[32];
+    switch (granularity_) {
+        case PartitionGranularity::Hour:
+            std::snprintf(buffer, sizeof(buffer), "%04lld%02u%02u%02u",
+                          static_cast<long long>(year), month, day, hour);
+            break;
+        case PartitionGranularity::Day:
+            std::snprintf(buffer, sizeof(buffer), "%04lld%02u%02u",
+                          static_cast<long long>(year), month, day);
+            break;
+        case PartitionGranularity::Month:
+            std::snprintf(buffer, sizeof(buffer), "%04lld%02u",
+                          static_cast<long long>(year), month);
+            break;
+        case PartitionGranularity::None:
+            return "";
+    }
+
+    return buffer;
+}
+
+bool PartitionKey::time_bounds(const std::string& partition_id, uint64_t& ts_from, uint64_t& ts_to) const {
+    size_t expected_length = 0;
+    switch (granularity_) {
+        case PartitionGranularity::Hour: expected_length = 10; break;
+        case PartitionGranularity::Day: expected_length = 8; break;
+        case PartitionGranularity::Month: expected_length = 6; break;
+        case PartitionGranularity::None: return false;
+    }
+
+    if (partition_id.size() != expected_length) {
+        return false;
+    }
+
+    unsigned year, month, day = 1, hour = 0;
+    if (!parse_digits(partition_id, 0, 4, year) || !parse_digits(partition_id, 4, 2, month)) {
+        return false;
+    }
+    if (expected_length >= 8 && !parse_digits(partition_id, 6, 2, day)) {
+        return false;
+    }
+    if (expected_length == 10 && !parse_digits(partition_id, 8, 2, hour)) {
+        return false;
+    }
+
+    int64_t start_days = days_from_civil(year, month, day);
+    int64_t start = start_days * SECONDS_PER_DAY + hour * SECONDS_PER_HOUR;
+    int64_t end;
+
+    switch (granularity_) {
+        case PartitionGranularity::Hour:
+            end = start + SECONDS_PER_HOUR;
+            break;
+        case PartitionGranularity::Day:
+            end = start + SECONDS_PER_DAY;
+            break;
+        default:
+            end = days_from_civil(month == 12 ? year + 1 : year, month == 12 ? 1 : month + 1, 1) *
+                  SECONDS_PER_DAY;
+            break;
+    }
+
+    if (start < 0) {
+        return false;
+    }
+
+    ts_from = static_cast<uint64_t>(start) * units_per_second_;
+    ts_to = static_cast<uint64_t>(end) * units_per_second_ - 1;
+    return true;
+}
+
+bool PartitionKey::overlaps_time_range(const std::string& partition_id, uint64_t ts_from, uint64_t ts_to) const {
+    uint64_t partition_from, partition_to;
+    if (!time_bounds(partition_id, partition_from, partition_to)) {
+        return true;
+    }
+    return !(partition_to < ts_from || partition_from > ts_to);
+}
+
+}  // namespace clickhouse
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace clickhouse {
+
+enum class PartitionGranularity {
+    None,
+    Hour,
+    Day,
+    Month
+};
+
+// Derives a partition id from a row timestamp, in the spirit of
+// PARTITION BY toYYYYMMDD(ts). Ids sort chronologically: "2024031513" for
+// hours, "20240315" for days, "202403" for months. With no granularity every
+// row belongs to the unnamed partition "" and parts live in the base directory.
+class PartitionKey {
+private:
+    PartitionGranularity granularity_;
+    uint64_t units_per_second_;
+
+public:
+    PartitionKey(PartitionGranularity granularity = PartitionGranularity::None,
+                 uint64_t timestamp_units_per_second = 1);
+
+    bool enabled() const { return granularity_ != PartitionGranularity::None; }
+
+    std::string partition_id(uint64_t timestamp) const;
+
+    // Inclusive timestamp range covered by a partition. Returns false for the
+    // unnamed partition or an id this key could not have produced.
+    bool time_bounds(const std::string& partition_id, uint64_t& ts_from, uint64_t& ts_to) const;
+
+    bool overlaps_time_range(const std::string& partition_id, uint64_t ts_from, uint64_t ts_to) const;
+};
+
+}  // namespace clickhouse
@@ -0,0 +1,459 @@
+#include "predicate.h"
+#include "hash.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace clickhouse {
+
+namespace {
+
+enum class NodeType {
+    Compare,
+    In,
+    Like,
+    Contains,
+    TimestampRange,
+    KeySample,
+    And,
+    Or,
+    Not
+};
+
+// A LIKE pattern split at '%' into segments; the first is anchored at the
+// start of the string and the last at its end. `wildcards` marks '_'.
+struct LikePattern {
+    std::vector<std::string> segments;
+    std::vector<std::vector<bool>> wildcards;
+    bool has_wildcards = false;
+};
+
+LikePattern parse_like(const std::string& pattern) {
+    LikePattern parsed;
+    parsed.segments.emplace_back();
+    parsed.wildcards.emplace_back();
+
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '%') {
+            parsed.segments.emplace_back();
+            parsed.wildcards.emplace_back();
+            continue;
+        }
+
+        bool wildcard = c == '_';
+        if (c == '\\' && i + 1 < pattern.size()) {
+            c = pattern[++i];
+        }
+        parsed.segments.back().push_back(c);
+        parsed.wildcards.back().push_back(wildcard);
+        parsed.has_wildcards = parsed.has_wildcards || wildcard;
+    }
+    return parsed;
+}
+
+bool segment_matches_at(std::string_view text, size_t pos, const std::string& segment,
+                        const std::vector<bool>& wildcards) {
+    if (pos + segment.size() > text.size()) {
+        return false;
+    }
+    for (size_t j = 0; j < segment.size(); ++j) {
+        if (!wildcards[j] && text[pos + j] != segment[j]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t find_segment(std::string_view text, size_t from, const LikePattern& pattern, size_t index) {
+    const std::string& segment = pattern.segments[index];
+    if (!pattern.has_wildcards) {
+        return text.find(segment, from);
+    }
+    for (size_t pos = from; pos + segment.size() <= text.size(); ++pos) {
+        if (segment_matches_at(text, pos, segment, pattern.wildcards[index])) {
+            return pos;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// Segments between '%' can match greedily at their leftmost position.
+bool like_matches(std::string_view text, const LikePattern& pattern) {
+    const auto& segments = pattern.segments;
+    size_t last = segments.size() - 1;
+
+    if (last == 0) {
+        return text.size() == segments[0].size() && segment_matches_at(text, 0, segments[0], pattern.wildcards[0]);
+    }
+    if (!segment_matches_at(text, 0, segments[0], pattern.wildcards[0])) {
+        return false;
+    }
+
+    size_t pos = segments[0].size();
+    for (size_t i = 1; i < last; ++i) {
+        pos = find_segment(text, pos, pattern, i);
+        if (pos == std::string_view::npos) {
+            return false;
+        }
+        pos += segments[i].size();
+    }
+
+    if (text.size() < pos + segments[last].size()) {
+        return false;
+    }
+    return segment_matches_at(text, text.size() - segments[last].size(), segments[last], pattern.wildcards[last]);
+}
+
+template <typename T>
+bool compare_values(const T& left, CompareOp op, const T& right) {
+    switch (op) {
+        case CompareOp::Equals:
+            return left == right;
+        case CompareOp::NotEquals:
+            return left != right;
+        case CompareOp::Less:
+            return left < right;
+        case CompareOp::LessOrEquals:
+            return left <= right;
+        case CompareOp::Greater:
+            return left > right;
+        case CompareOp::GreaterOrEquals:
+            return left >= right;
+    }
+    return false;
+}
+
+bool order_satisfies(int order, CompareOp op) {
+    return compare_values(order, op, 0);
+}
+
+bool any_selected(const std::vector<uint8_t>& selection) {
+    return std::find(selection.begin(), selection.end(), 1) != selection.end();
+}
+
+}  // namespace
+
+struct Predicate::Node {
+    NodeType type = NodeType::Compare;
+    PredicateColumn column = PredicateColumn::Value;
+    CompareOp op = CompareOp::Equals;
+    std::string operand;
+    uint64_t ts_from = 0;
+    uint64_t ts_to = 0;
+    // Largest key_sample_hash a KeySample node accepts.
+    uint64_t sample_bound = 0;
+    // Sorted, distinct IN operands.
+    std::vector<std::string> strings;
+    std::vector<uint64_t> timestamps;
+    LikePattern pattern;
+    std::vector<Predicate> children;
+
+    bool matches_string(std::string_view text) const {
+        switch (type) {
+            case NodeType::Compare:
+                return order_satisfies(compare_keys(text, operand), op);
+            case NodeType::In:
+                return std::binary_search(strings.begin(), strings.end(), text,
+                                          [](std::string_view a, std::string_view b) { return a < b; });
+            case NodeType::Like:
+                return like_matches(text, pattern);
+            case NodeType::Contains:
+                return text.find(operand) != std::string_view::npos;
+            case NodeType::KeySample:
+                return key_sample_hash(text.data(), text.size()) <= sample_bound;
+            default:
+                throw std::logic_error("Not a string predicate");
+        }
+    }
+
+    bool matches_timestamp(uint64_t timestamp) const {
+        switch (type) {
+            case NodeType::Compare:
+                return compare_values(timestamp, op, ts_from);
+            case NodeType::In:
+                return std::binary_search(timestamps.begin(), timestamps.end(), timestamp);
+            case NodeType::TimestampRange:
+                return timestamp >= ts_from && timestamp <= ts_to;
+            default:
+                throw std::logic_error("Not a timestamp predicate");
+        }
+    }
+};
+
+Predicate Predicate::compare(PredicateColumn column, CompareOp op, const std::string& operand) {
+    if (column == PredicateColumn::Timestamp) {
+        throw std::invalid_argument("Timestamps compare against numbers");
+    }
+    auto node = std::make_shared<Node>();
+    node->column = column;
+    node->op = op;
+    node->operand = operand;
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::compare(CompareOp op, uint64_t timestamp) {
+    auto node = std::make_shared<Node>();
+    node->column = PredicateColumn::Timestamp;
+    node->op = op;
+    node->ts_from = timestamp;
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::in(PredicateColumn column, std::vector<std::string> operands) {
+    if (column == PredicateColumn::Timestamp) {
+        throw std::invalid_argument("Timestamps compare against numbers");
+    }
+    auto node = std::make_shared<Node>();
+    node->type = NodeType::In;
+    node->column = column;
+    std::sort(operands.begin(), operands.end());
+    operands.erase(std::unique(operands.begin(), operands.end()), operands.end());
+    node->strings = std::move(operands);
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::in(std::vector<uint64_t> timestamps) {
+    auto node = std::make_shared<Node>();
+    node->type = NodeType::In;
+    node->column = PredicateColumn::Timestamp;
+    std::sort(timestamps.begin(), timestamps.end());
+    node->timestamps = std::move(timestamps);
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::like(PredicateColumn column, const std::string& pattern) {
+    if (column == PredicateColumn::Timestamp) {
+        throw std::invalid_argument("LIKE applies to key or value");
+    }
+    auto node = std::make_shared<Node>();
+    node->type = NodeType::Like;
+    node->column = column;
+    node->operand = pattern;
+    node->pattern = parse_like(pattern);
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::contains(PredicateColumn column, const std::string& substring) {
+    if (column == PredicateColumn::Timestamp) {
+        throw std::invalid_argument("Substring search applies to key or value");
+    }
+    auto node = std::make_shared<Node>();
+    node->type = NodeType::Contains;
+    node->column = column;
+    node->operand = substring;
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::timestamp_between(uint64_t ts_from, uint64_t ts_to) {
+    auto node = std::make_shared<Node>();
+    node->type = NodeType::TimestampRange;
+    node->column = PredicateColumn::Timestamp;
+    node->ts_from = ts_from;
+    node->ts_to = ts_to;
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::key_sample(double fraction) {
+    if (!(fraction > 0 && fraction <= 1)) {
+        throw std::invalid_argument("Sample fraction must be in (0, 1]");
+    }
+    auto node = std::make_shared<Node>();
+    node->type = NodeType::KeySample;
+    node->column = PredicateColumn::Key;
+    // fraction * 2^64, saturated: 1 keeps every key.
+    double scaled = std::ldexp(fraction, 64);
+    node->sample_bound = scaled >= std::ldexp(1.0, 64) ? UINT64_MAX : static_cast<uint64_t>(scaled);
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::all_of(std::vector<Predicate> predicates) {
+    auto node = std::make_shared<Node>();
+    node->type = NodeType::And;
+    node->children = std::move(predicates);
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::any_of(std::vector<Predicate> predicates) {
+    auto node = std::make_shared<Node>();
+    node->type = NodeType::Or;
+    node->children = std::move(predicates);
+    return Predicate(std::move(node));
+}
+
+Predicate Predicate::negate(const Predicate& predicate) {
+    auto node = std::make_shared<Node>();
+    node->type = NodeType::Not;
+    node->children.push_back(predicate);
+    return Predicate(std::move(node));
+}
+
+bool Predicate::matches(const Row& row) const {
+    const Node& node = *root_;
+    switch (node.type) {
+        case NodeType::And:
+            return std::all_of(node.children.begin(), node.children.end(),
+                               [&](const Predicate& child) { return child.matches(row); });
+        case NodeType::Or:
+            return std::any_of(node.children.begin(), node.children.end(),
+                               [&](const Predicate& child) { return child.matches(row); });
+        case NodeType::Not:
+            return !node.children[0].matches(row);
+        default:
+            break;
+    }
+
+    switch (node.column) {
+        case PredicateColumn::Key:
+            return node.matches_string(row.key);
+        case PredicateColumn::Value:
+            return node.matches_string(row.value);
+        case PredicateColumn::Timestamp:
+            return node.matches_timestamp(row.timestamp);
+    }
+    return false;
+}
+
+void Predicate::filter(PredicateColumns& columns, std::vector<uint8_t>& selection) const {
+    if (!any_selected(selection)) {
+        return;
+    }
+
+    const Node& node = *root_;
+    size_t rows = selection.size();
+
+    switch (node.type) {
+        case NodeType::And:
+            for (const auto& child : node.children) {
+                child.filter(columns, selection);
+            }
+            return;
+        case NodeType::Or: {
+            std::vector<uint8_t> result(rows, 0);
+            std::vector<uint8_t> undecided = selection;
+            for (const auto& child : node.children) {
+                std::vector<uint8_t> passed = undecided;
+                child.filter(columns, passed);
+                for (size_t i = 0; i < rows; ++i) {
+                    result[i] |= passed[i];
+                    undecided[i] &= static_cast<uint8_t>(!passed[i]);
+                }
+            }
+            selection = std::move(result);
+            return;
+        }
+        case NodeType::Not: {
+            std::vector<uint8_t> passed = selection;
+            node.children[0].filter(columns, passed);
+            for (size_t i = 0; i < rows; ++i) {
+                selection[i] &= static_cast<uint8_t>(!passed[i]);
+            }
+            return;
+        }
+        default:
+            break;
+    }
+
+    if (node.column == PredicateColumn::Timestamp) {
+        // Fixed-width column: evaluated for every row without branching.
+        const auto& timestamps = columns.timestamps();
+        if (node.type == NodeType::TimestampRange) {
+            for (size_t i = 0; i < rows; ++i) {
+                selection[i] &= static_cast<uint8_t>(timestamps[i] >= node.ts_from && timestamps[i] <= node.ts_to);
+            }
+        } else {
+            for (size_t i = 0; i < rows; ++i) {
+                selection[i] &= static_cast<uint8_t>(node.matches_timestamp(timestamps[i]));
+            }
+        }
+        return;
+    }
+
+    const auto& column = node.column == PredicateColumn::Key ? columns.keys() : columns.values();
+
+    if (node.type == NodeType::Compare) {
+        // Orders the whole batch by normalized prefix in one vector pass;
+        // only rows whose prefix ties with the operand compare whole strings.
+        const std::vector<uint64_t>* cached = node.column == PredicateColumn::Key ? columns.key_prefixes() : nullptr;
+        std::vector<uint64_t> prefixes;
+        if (!cached) {
+            prefixes.resize(rows);
+            for (size_t i = 0; i < rows; ++i) {
+                prefixes[i] = normalized_key_prefix(column[i]);
+            }
+            cached = &prefixes;
+        }
+
+        std::vector<int8_t> orders(rows);
+        compare_prefixes(cached->data(), rows, normalized_key_prefix(node.operand), orders.data());
+        for (size_t i = 0; i < rows; ++i) {
+            if (selection[i]) {
+                int order = orders[i] != 0 ? orders[i] : compare_keys(column[i], node.operand);
+                selection[i] = static_cast<uint8_t>(order_satisfies(order, node.op));
+            }
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < rows; ++i) {
+        if (selection[i]) {
+            selection[i] = static_cast<uint8_t>(node.matches_string(column[i]));
+        }
+    }
+}
+
+bool Predicate::may_match(const std::function<bool(const ValueCondition&)>& value_may_match,
+                          const std::function<bool(uint64_t)>& sample_may_match) const {
+    const Node& node = *root_;
+    switch (node.type) {
+        case NodeType::And:
+            return std::all_of(node.children.begin(), node.children.end(), [&](const Predicate& child) {
+                return child.may_match(value_may_match, sample_may_match);
+            });
+        case NodeType::Or:
+            return std::any_of(node.children.begin(), node.children.end(), [&](const Predicate& child) {
+                return child.may_match(value_may_match, sample_may_match);
+            });
+        case NodeType::KeySample:
+            return !sample_may_match || sample_may_match(node.sample_bound);
+        default:
+            break;
+    }
+
+    if (node.column != PredicateColumn::Value) {
+        return true;
+    }
+
+    switch (node.type) {
+        case NodeType::Compare:
+            return node.op != CompareOp::Equals || value_may_match(ValueCondition::equals(node.operand));
+        case NodeType::In:
+            return std::any_of(node.strings.begin(), node.strings.end(), [&](const std::string& operand) {
+                return value_may_match(ValueCondition::equals(operand));
+            });
+        case NodeType::Contains:
+            return value_may_match(ValueCondition::contains(node.operand));
+        case NodeType::Like: {
+            // Every literal run of the pattern must occur in the value.
+            const LikePattern& pattern = node.pattern;
+            for (size_t i = 0; i < pattern.segments.size(); ++i) {
+                std::string literal;
+                for (size_t j = 0; j <= pattern.segments[i].size(); ++j) {
+                    if (j < pattern.segments[i].size() && !pattern.wildcards[i][j]) {
+                        literal.push_back(pattern.segments[i][j]);
+                        continue;
+                    }
+                    if (!literal.empty() && !value_may_match(ValueCondition::contains(literal))) {
+                        return false;
+                    }
+                    literal.clear();
+                }
+            }
+            return true;
+        }
+        default:
+            return true;
+    }
+}
+
+}  // namespace clickhouse
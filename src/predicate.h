@@ -0,0 +1,104 @@
+#pragma once
+
+#include "row.h"
+#include "skip_index.h"
+#include "key_compare.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+namespace clickhouse {
+
+enum class PredicateColumn {
+    Key,
+    Value,
+    Timestamp
+};
+
+enum class CompareOp {
+    Equals,
+    NotEquals,
+    Less,
+    LessOrEquals,
+    Greater,
+    GreaterOrEquals
+};
+
+// One granule's columns as a predicate sees them, in stored order. Each
+// column is produced on first request, so a predicate reads only the
+// columns it refers to.
+class PredicateColumns {
+public:
+    virtual ~PredicateColumns() = default;
+
+    virtual size_t size() const = 0;
+
+    virtual const std::vector<std::string_view>& keys() = 0;
+
+    virtual const std::vector<std::string_view>& values() = 0;
+
+    virtual const std::vector<uint64_t>& timestamps() = 0;
+
+    // normalized_key_prefix of each key when already at hand (null otherwise).
+    virtual const std::vector<uint64_t>* key_prefixes() { return nullptr; }
+};
+
+// A filter over row columns (like PREWHERE): comparisons, IN, LIKE and
+// substring tests on key or value, timestamp comparisons and ranges,
+// combined with AND/OR/NOT. Strings compare bytewise. Copies share the
+// immutable expression tree.
+class Predicate {
+public:
+    struct Node;
+
+    static Predicate compare(PredicateColumn column, CompareOp op, const std::string& operand);
+
+    static Predicate compare(CompareOp op, uint64_t timestamp);
+
+    static Predicate in(PredicateColumn column, std::vector<std::string> operands);
+
+    static Predicate in(std::vector<uint64_t> timestamps);
+
+    // SQL LIKE: '%' matches any run of bytes, '_' any single byte and '\'
+    // escapes the next character.
+    static Predicate like(PredicateColumn column, const std::string& pattern);
+
+    static Predicate contains(PredicateColumn column, const std::string& substring);
+
+    static Predicate timestamp_between(uint64_t ts_from, uint64_t ts_to);
+
+    // SAMPLE: keys whose key_sample_hash falls in the first `fraction` of
+    // the hash space, so every row of a sampled key and the same keys on
+    // every query. `fraction` must be in (0, 1].
+    static Predicate key_sample(double fraction);
+
+    static Predicate all_of(std::vector<Predicate> predicates);
+
+    static Predicate any_of(std::vector<Predicate> predicates);
+
+    static Predicate negate(const Predicate& predicate);
+
+    bool matches(const Row& row) const;
+
+    // Clears selection[i] for each selected row i that fails the predicate,
+    // one column at a time; rows already cleared are not evaluated, so
+    // AND/OR only test later operands on rows still undecided.
+    void filter(PredicateColumns& columns, std::vector<uint8_t>& selection) const;
+
+    // False if the skip-index check `value_may_match` rules out every value
+    // the predicate accepts (only value equality, IN and substring tests
+    // are mapped to value conditions), or if `sample_may_match` (given a
+    // key_sample's largest accepted hash) rules out every sampled key.
+    bool may_match(const std::function<bool(const ValueCondition&)>& value_may_match,
+                   const std::function<bool(uint64_t)>& sample_may_match = nullptr) const;
+
+private:
+    std::shared_ptr<const Node> root_;
+
+    explicit Predicate(std::shared_ptr<const Node> root) : root_(std::move(root)) {}
+};
+
+}  // namespace clickhouse
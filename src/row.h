@@ -1,5 +1,6 @@
 #pragma once
 
+#include "key_compare.h"
 #include <string>
 #include <cstdint>
 #include <vector>
@@ -10,22 +11,27 @@ struct Row {
     std::string key;
     std::string value;
     uint64_t timestamp;
+    // +1 for a state row, -1 for a cancel row (Collapsing mode).
+    int8_t sign = 1;
 
     Row() = default;
-    Row(const std::string& k, const std::string& v, uint64_t ts)
-        : key(k), value(v), timestamp(ts) {}
+    Row(const std::string& k, const std::string& v, uint64_t ts, int8_t s = 1)
+        : key(k), value(v), timestamp(ts), sign(s) {}
 
     bool operator<(const Row& other) const {
-        if (key != other.key) return key < other.key;
-        return timestamp < other.timestamp;
+        int order = compare_keys(key, other.key);
+        if (order != 0) return order < 0;
+        if (timestamp != other.timestamp) return timestamp < other.timestamp;
+        return sign < other.sign;
     }
 
     bool operator==(const Row& other) const {
-        return key == other.key && value == other.value && timestamp == other.timestamp;
+        return key == other.key && value == other.value && timestamp == other.timestamp &&
+               sign == other.sign;
     }
 
     size_t size() const {
-        return sizeof(timestamp) + key.size() + value.size();
+        return sizeof(timestamp) + sizeof(sign) + key.size() + value.size();
     }
 };
 
@@ -0,0 +1,188 @@
+#include "row_mask.h"
+#include "serialization.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace clickhouse {
+
+namespace {
+
+constexpr uint64_t ARRAY_CONTAINER = 0;
+constexpr uint64_t BITMAP_CONTAINER = 1;
+
+}  // namespace
+
+bool RowMask::Container::contains(uint16_t low) const {
+    if (is_bitmap()) {
+        return (bitmap[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+bool RowMask::Container::add(uint16_t low) {
+    if (is_bitmap()) {
+        uint64_t bit = uint64_t(1) << (low & 63);
+        if (bitmap[low >> 6] & bit) {
+            return false;
+        }
+        bitmap[low >> 6] |= bit;
+        cardinality++;
+        return true;
+    }
+
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) {
+        return false;
+    }
+    array.insert(it, low);
+    cardinality++;
+
+    if (cardinality > ARRAY_LIMIT) {
+        convert_to_bitmap();
+    }
+    return true;
+}
+
+void RowMask::Container::convert_to_bitmap() {
+    bitmap.assign(BITMAP_WORDS, 0);
+    for (uint16_t low : array) {
+        bitmap[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+    array.clear();
+    array.shrink_to_fit();
+}
+
+RowMask::RowMask() : cardinality_(0) {}
+
+bool RowMask::add(uint32_t row) {
+    bool added = get_or_create_container(static_cast<uint16_t>(row >> 16)).add(static_cast<uint16_t>(row & 0xffff));
+    if (added) {
+        cardinality_++;
+    }
+    return added;
+}
+
+void RowMask::add_range(uint32_t begin, uint32_t end) {
+    for (uint32_t row = begin; row < end; ++row) {
+        add(row);
+    }
+}
+
+bool RowMask::contains(uint32_t row) const {
+    const Container* container = find_container(static_cast<uint16_t>(row >> 16));
+    return container && container->contains(static_cast<uint16_t>(row & 0xffff));
+}
+
+void RowMask::merge(const RowMask& other) {
+    for (const auto& container : other.containers_) {
+        uint32_t base = static_cast<uint32_t>(container.high) << 16;
+        if (container.is_bitmap()) {
+            for (uint32_t word = 0; word < BITMAP_WORDS; ++word) {
+                uint64_t bits = container.bitmap[word];
+                while (bits) {
+                    uint32_t bit = static_cast<uint32_t>(__builtin_ctzll(bits));
+                    add(base + word * 64 + bit);
+                    bits &= bits - 1;
+                }
+            }
+        } else {
+            for (uint16_t low : container.array) {
+                add(base + low);
+            }
+        }
+    }
+}
+
+void RowMask::clear() {
+    containers_.clear();
+    cardinality_ = 0;
+}
+
+void RowMask::save_to_file(const std::string& file_path) const {
+    std::ofstream ofs(file_path, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Cannot open file for writing: " + file_path);
+    }
+
+    Serialization::write_uint64(ofs, containers_.size());
+
+    for (const auto& container : containers_) {
+        Serialization::write_uint64(ofs, container.high);
+        Serialization::write_uint64(ofs, container.cardinality);
+        if (container.is_bitmap()) {
+            Serialization::write_uint64(ofs, BITMAP_CONTAINER);
+            ofs.write(reinterpret_cast<const char*>(container.bitmap.data()),
+                      container.bitmap.size() * sizeof(uint64_t));
+        } else {
+            Serialization::write_uint64(ofs, ARRAY_CONTAINER);
+            ofs.write(reinterpret_cast<const char*>(container.array.data()),
+                      container.array.size() * sizeof(uint16_t));
+        }
+    }
+}
+
+void RowMask::load_from_file(const std::string& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file for reading: " + file_path);
+    }
+
+    clear();
+
+    uint64_t count = Serialization::read_uint64(ifs);
+    containers_.resize(count);
+
+    for (auto& container : containers_) {
+        container.high = static_cast<uint16_t>(Serialization::read_uint64(ifs));
+        container.cardinality = static_cast<uint32_t>(Serialization::read_uint64(ifs));
+        uint64_t type = Serialization::read_uint64(ifs);
+
+        if (type == BITMAP_CONTAINER) {
+            container.bitmap.resize(BITMAP_WORDS);
+            ifs.read(reinterpret_cast<char*>(container.bitmap.data()), BITMAP_WORDS * sizeof(uint64_t));
+        } else {
+            container.array.resize(container.cardinality);
+            ifs.read(reinterpret_cast<char*>(container.array.data()),
+                     container.cardinality * sizeof(uint16_t));
+        }
+
+        cardinality_ += container.cardinality;
+    }
+
+    if (!ifs) {
+        throw std::runtime_error("Corrupted row mask: " + file_path);
+    }
+}
+
+size_t RowMask::memory_usage() const {
+    size_t total = sizeof(RowMask);
+    for (const auto& container : containers_) {
+        total += sizeof(Container) + container.array.capacity() * sizeof(uint16_t) +
+                 container.bitmap.capacity() * sizeof(uint64_t);
+    }
+    return total;
+}
+
+const RowMask::Container* RowMask::find_container(uint16_t high) const {
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), high,
+        [](const Container& container, uint16_t value) { return container.high < value; });
+    if (it != containers_.end() && it->high == high) {
+        return &*it;
+    }
+    return nullptr;
+}
+
+RowMask::Container& RowMask::get_or_create_container(uint16_t high) {
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), high,
+        [](const Container& container, uint16_t value) { return container.high < value; });
+    if (it != containers_.end() && it->high == high) {
+        return *it;
+    }
+
+    Container container;
+    container.high = high;
+    return *containers_.insert(it, std::move(container));
+}
+
+}  // namespace clickhouse
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace clickhouse {
+
+// Compressed set of row positions within a part (roaring-bitmap layout).
+// Positions are split into 2^16-row chunks; a chunk stores a sorted array
+// of low bits while sparse and switches to a 8 KB bitmap once it holds more
+// than 4096 rows.
+class RowMask {
+private:
+    static constexpr uint32_t ARRAY_LIMIT = 4096;
+    static constexpr uint32_t BITMAP_WORDS = 1024;
+
+    struct Container {
+        uint16_t high = 0;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bitmap;
+
+        bool is_bitmap() const { return !bitmap.empty(); }
+
+        bool contains(uint16_t low) const;
+
+        bool add(uint16_t low);
+
+        void convert_to_bitmap();
+    };
+
+    std::vector<Container> containers_;
+    uint64_t cardinality_;
+
+public:
+    RowMask();
+
+    // Returns whether the row was not already in the mask.
+    bool add(uint32_t row);
+
+    // Adds rows [begin, end).
+    void add_range(uint32_t begin, uint32_t end);
+
+    bool contains(uint32_t row) const;
+
+    uint64_t cardinality() const { return cardinality_; }
+
+    bool empty() const { return cardinality_ == 0; }
+
+    void merge(const RowMask& other);
+
+    void clear();
+
+    void save_to_file(const std::string& file_path) const;
+
+    void load_from_file(const std::string& file_path);
+
+    size_t memory_usage() const;
+
+private:
+    const Container* find_container(uint16_t high) const;
+
+    Container& get_or_create_container(uint16_t high);
+};
+
+}  // namespace clickhouse
@@ -1,7 +1,11 @@
 #include "serialization.h"
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace clickhouse {
 
@@ -10,15 +14,20 @@ void Serialization::write_granule(const std::string& base_path, const Granule& g
 
     std::vector<std::string> keys, values;
     std::vector<uint64_t> timestamps;
+    std::vector<int8_t> signs;
+    bool has_cancel_rows = false;
 
     keys.reserve(rows.size());
     values.reserve(rows.size());
     timestamps.reserve(rows.size());
+    signs.reserve(rows.size());
 
     for (const auto& row : rows) {
         keys.push_back(row.key);
         values.push_back(row.value);
         timestamps.push_back(row.timestamp);
+        signs.push_back(row.sign);
+        has_cancel_rows = has_cancel_rows || row.sign != 1;
     }
 
     std::string granule_prefix = base_path + "/granule_" + std::to_string(granule_index);
@@ -26,6 +35,11 @@ void Serialization::write_granule(const std::string& base_path, const Granule& g
     write_string_vector(granule_prefix + "_keys.bin", keys);
     write_string_vector(granule_prefix + "_values.bin", values);
     write_uint64_vector(granule_prefix + "_timestamps.bin", timestamps);
+
+    // The sign column is only materialized when it is not all +1.
+    if (has_cancel_rows) {
+        write_int8_vector(granule_prefix + "_signs.bin", signs);
+    }
 }
 
 Granule Serialization::read_granule(const std::string& base_path, size_t granule_index) {
@@ -35,19 +49,93 @@ Granule Serialization::read_granule(const std::string& base_path, size_t granule
     auto values = read_string_vector(granule_prefix + "_values.bin");
     auto timestamps = read_uint64_vector(granule_prefix + "_timestamps.bin");
 
-    if (keys.size() != values.size() || keys.size() != timestamps.size()) {
+    std::vector<int8_t> signs;
+    if (file_exists(granule_prefix + "_signs.bin")) {
+        signs = read_int8_vector(granule_prefix + "_signs.bin");
+    } else {
+        signs.assign(keys.size(), 1);
+    }
+
+    if (keys.size() != values.size() || keys.size() != timestamps.size() || keys.size() != signs.size()) {
         throw std::runtime_error("Inconsistent granule data sizes");
     }
 
     Granule granule;
     for (size_t i = 0; i < keys.size(); ++i) {
-        granule.add_row(Row(keys[i], values[i], timestamps[i]));
+        granule.add_row(Row(keys[i], values[i], timestamps[i], signs[i]));
     }
 
     granule.sort();
     return granule;
 }
 
+void Serialization::write_granule_values(const std::string& base_path, const Granule& granule, size_t granule_index) {
+    std::vector<std::string> values;
+    values.reserve(granule.size());
+    for (const auto& row : granule.rows()) {
+        values.push_back(row.value);
+    }
+    write_string_vector(granule_file(base_path, granule_index, "values"), values);
+}
+
+void Serialization::link_granule(const std::string& source_path, size_t source_index,
+                                 const std::string& target_path, size_t target_index, bool include_values) {
+    for (const char* column : {"keys", "values", "timestamps", "signs"}) {
+        if (!include_values && std::string(column) == "values") {
+            continue;
+        }
+
+        std::string source_file = granule_file(source_path, source_index, column);
+        if (!file_exists(source_file)) {
+            continue;
+        }
+
+        std::string target_file = granule_file(target_path, target_index, column);
+        std::error_code ec;
+        std::filesystem::create_hard_link(source_file, target_file, ec);
+        if (ec) {
+            std::filesystem::copy_file(source_file, target_file, std::filesystem::copy_options::overwrite_existing);
+        }
+    }
+}
+
+std::string Serialization::granule_file(const std::string& base_path, size_t granule_index, const std::string& column) {
+    return base_path + "/granule_" + std::to_string(granule_index) + "_" + column + ".bin";
+}
+
+std::vector<std::string> Serialization::read_granule_keys(const std::string& base_path, size_t granule_index) {
+    std::string granule_prefix = base_path + "/granule_" + std::to_string(granule_index);
+    return read_string_vector(granule_prefix + "_keys.bin");
+}
+
+RowVector Serialization::read_granule_sort_columns(const std::string& base_path, size_t granule_index) {
+    auto keys = read_string_vector(granule_file(base_path, granule_index, "keys"));
+    auto timestamps = read_uint64_vector(granule_file(base_path, granule_index, "timestamps"));
+
+    std::vector<int8_t> signs;
+    std::string signs_file = granule_file(base_path, granule_index, "signs");
+    if (file_exists(signs_file)) {
+        signs = read_int8_vector(signs_file);
+    } else {
+        signs.assign(keys.size(), 1);
+    }
+
+    if (keys.size() != timestamps.size() || keys.size() != signs.size()) {
+        throw std::runtime_error("Inconsistent granule data sizes");
+    }
+
+    RowVector rows;
+    rows.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        rows.emplace_back(std::move(keys[i]), std::string(), timestamps[i], signs[i]);
+    }
+    return rows;
+}
+
+std::vector<std::string> Serialization::read_granule_values(const std::string& base_path, size_t granule_index) {
+    return read_string_vector(granule_file(base_path, granule_index, "values"));
+}
+
 void Serialization::write_row_vector(const std::string& file_path, const RowVector& rows) {
     std::ofstream ofs(file_path, std::ios::binary);
     if (!ofs) {
@@ -113,6 +201,43 @@ std::vector<std::string> Serialization::read_string_vector(const std::string& fi
     return strings;
 }
 
+std::vector<std::string_view> Serialization::read_string_views(const std::string& file_path, std::string& buffer) {
+    std::ifstream ifs(file_path, std::ios::binary | std::ios::ate);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file for reading: " + file_path);
+    }
+
+    buffer.resize(static_cast<size_t>(ifs.tellg()));
+    ifs.seekg(0);
+    ifs.read(&buffer[0], buffer.size());
+
+    auto read_length = [&](size_t& pos) {
+        if (buffer.size() - pos < sizeof(uint64_t)) {
+            throw std::runtime_error("Truncated string column: " + file_path);
+        }
+        uint64_t value;
+        std::memcpy(&value, buffer.data() + pos, sizeof(value));
+        pos += sizeof(value);
+        return value;
+    };
+
+    size_t pos = 0;
+    uint64_t count = read_length(pos);
+    std::vector<std::string_view> strings;
+    strings.reserve(std::min<uint64_t>(count, buffer.size() / sizeof(uint64_t)));
+
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t length = read_length(pos);
+        if (buffer.size() - pos < length) {
+            throw std::runtime_error("Truncated string column: " + file_path);
+        }
+        strings.emplace_back(buffer.data() + pos, length);
+        pos += length;
+    }
+
+    return strings;
+}
+
 void Serialization::write_uint64_vector(const std::string& file_path, const std::vector<uint64_t>& values) {
     std::ofstream ofs(file_path, std::ios::binary);
     if (!ofs) {
@@ -143,6 +268,29 @@ std::vector<uint64_t> Serialization::read_uint64_vector(const std::string& file_
     return values;
 }
 
+void Serialization::write_int8_vector(const std::string& file_path, const std::vector<int8_t>& values) {
+    std::ofstream ofs(file_path, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Cannot open file for writing: " + file_path);
+    }
+
+    write_uint64(ofs, values.size());
+    ofs.write(reinterpret_cast<const char*>(values.data()), values.size());
+}
+
+std::vector<int8_t> Serialization::read_int8_vector(const std::string& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file for reading: " + file_path);
+    }
+
+    uint64_t count = read_uint64(ifs);
+    std::vector<int8_t> values(count);
+    ifs.read(reinterpret_cast<char*>(values.data()), count);
+
+    return values;
+}
+
 bool Serialization::file_exists(const std::string& file_path) {
     return std::filesystem::exists(file_path);
 }
@@ -154,6 +302,30 @@ size_t Serialization::file_size(const std::string& file_path) {
     return std::filesystem::file_size(file_path);
 }
 
+void Serialization::sync_file(const std::string& file_path) {
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file for sync: " + file_path);
+    }
+    int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw std::runtime_error("Cannot sync file: " + file_path);
+    }
+}
+
+void Serialization::sync_directory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open directory for sync: " + directory);
+    }
+    int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw std::runtime_error("Cannot sync directory: " + directory);
+    }
+}
+
 void Serialization::write_string(std::ofstream& ofs, const std::string& str) {
     uint64_t length = str.size();
     write_uint64(ofs, length);
@@ -4,6 +4,7 @@
 #include "granule.h"
 #include <string>
 #include <vector>
+#include <string_view>
 #include <fstream>
 
 namespace clickhouse {
@@ -14,6 +15,24 @@ public:
 
     static Granule read_granule(const std::string& base_path, size_t granule_index);
 
+    static void write_granule_values(const std::string& base_path, const Granule& granule, size_t granule_index);
+
+    // Hard-links the column files of a granule into another part directory
+    // (copying when linking is not possible), optionally leaving out values.
+    static void link_granule(const std::string& source_path, size_t source_index,
+                             const std::string& target_path, size_t target_index, bool include_values);
+
+    static std::string granule_file(const std::string& base_path, size_t granule_index, const std::string& column);
+
+    // Reads only the key column of a granule, in stored (sorted) order.
+    static std::vector<std::string> read_granule_keys(const std::string& base_path, size_t granule_index);
+
+    // Reads the key, timestamp and sign columns of a granule in stored
+    // (sorted) order, leaving values empty.
+    static RowVector read_granule_sort_columns(const std::string& base_path, size_t granule_index);
+
+    static std::vector<std::string> read_granule_values(const std::string& base_path, size_t granule_index);
+
     static void write_row_vector(const std::string& file_path, const RowVector& rows);
 
     static RowVector read_row_vector(const std::string& file_path);
@@ -22,14 +41,28 @@ public:
 
     static std::vector<std::string> read_string_vector(const std::string& file_path);
 
+    // Reads a file written by write_string_vector into `buffer` and returns
+    // views of its strings, without allocating each one.
+    static std::vector<std::string_view> read_string_views(const std::string& file_path, std::string& buffer);
+
     static void write_uint64_vector(const std::string& file_path, const std::vector<uint64_t>& values);
 
     static std::vector<uint64_t> read_uint64_vector(const std::string& file_path);
 
+    static void write_int8_vector(const std::string& file_path, const std::vector<int8_t>& values);
+
+    static std::vector<int8_t> read_int8_vector(const std::string& file_path);
+
     static bool file_exists(const std::string& file_path);
 
     static size_t file_size(const std::string& file_path);
 
+    // fsync a file, or a directory so entries created or renamed in it are
+    // durable.
+    static void sync_file(const std::string& file_path);
+
+    static void sync_directory(const std::string& directory);
+
     static void write_string(std::ofstream& ofs, const std::string& str);
 
     static std::string read_string(std::ifstream& ifs);
@@ -0,0 +1,513 @@
+#include "skip_index.h"
+#include "bloom_filter.h"
+#include "number.h"
+#include "serialization.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace clickhouse {
+
+namespace {
+
+bool is_token_char(char c) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    return (byte >= '0' && byte <= '9') || (byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z') ||
+           byte >= 0x80;
+}
+
+// Tokens of `value`; with `whole_only`, tokens touching either end of the
+// string are left out since they may continue beyond it.
+std::vector<std::string> tokenize(const std::string& value, bool whole_only = false) {
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < value.size()) {
+        if (!is_token_char(value[i])) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < value.size() && is_token_char(value[i])) {
+            ++i;
+        }
+        if (!whole_only || (start > 0 && i < value.size())) {
+            tokens.push_back(value.substr(start, i - start));
+        }
+    }
+    return tokens;
+}
+
+bool contains_token(std::string_view value, const std::string& token) {
+    if (token.empty()) {
+        return false;
+    }
+    for (size_t pos = value.find(token); pos != std::string_view::npos; pos = value.find(token, pos + 1)) {
+        bool starts = pos == 0 || !is_token_char(value[pos - 1]);
+        bool ends = pos + token.size() == value.size() || !is_token_char(value[pos + token.size()]);
+        if (starts && ends) {
+            return true;
+        }
+    }
+    return false;
+}
+
+class MinMaxSkipIndex : public SkipIndex {
+private:
+    struct Block {
+        std::string min;
+        std::string max;
+        // Set when some value parses as a number; Between never matches others.
+        bool has_numbers = false;
+        double min_number = 0;
+        double max_number = 0;
+    };
+
+    std::vector<Block> blocks_;
+
+public:
+    using SkipIndex::SkipIndex;
+
+    size_t block_count() const override { return blocks_.size(); }
+
+    size_t memory_usage() const override {
+        size_t total = sizeof(*this) + blocks_.capacity() * sizeof(Block);
+        for (const auto& block : blocks_) {
+            total += block.min.capacity() + block.max.capacity();
+        }
+        return total;
+    }
+
+protected:
+    void add_block(const std::vector<std::string>& values) override {
+        Block block;
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i == 0 || values[i] < block.min) {
+                block.min = values[i];
+            }
+            if (i == 0 || values[i] > block.max) {
+                block.max = values[i];
+            }
+
+            double number;
+            if (parse_number(values[i], number)) {
+                block.min_number = block.has_numbers ? std::min(block.min_number, number) : number;
+                block.max_number = block.has_numbers ? std::max(block.max_number, number) : number;
+                block.has_numbers = true;
+            }
+        }
+        blocks_.push_back(std::move(block));
+    }
+
+    bool block_may_match(size_t block_index, const ValueCondition& condition) const override {
+        const Block& block = blocks_[block_index];
+        switch (condition.type) {
+            case ValueConditionType::Equals:
+                return !(condition.value < block.min || condition.value > block.max);
+            case ValueConditionType::Between:
+                return block.has_numbers &&
+                       !(block.max_number < condition.min_value || block.min_number > condition.max_value);
+            default:
+                return true;
+        }
+    }
+
+    void append_blocks(SkipIndex& other) override {
+        auto& blocks = static_cast<MinMaxSkipIndex&>(other).blocks_;
+        blocks_.insert(blocks_.end(), std::make_move_iterator(blocks.begin()), std::make_move_iterator(blocks.end()));
+        blocks.clear();
+    }
+
+    void copy_block_from(const SkipIndex& other, size_t block) override {
+        blocks_.push_back(static_cast<const MinMaxSkipIndex&>(other).blocks_[block]);
+    }
+
+    void save_blocks(std::ofstream& ofs) const override {
+        for (const auto& block : blocks_) {
+            Serialization::write_string(ofs, block.min);
+            Serialization::write_string(ofs, block.max);
+            Serialization::write_uint64(ofs, block.has_numbers ? 1 : 0);
+            ofs.write(reinterpret_cast<const char*>(&block.min_number), sizeof(double));
+            ofs.write(reinterpret_cast<const char*>(&block.max_number), sizeof(double));
+        }
+    }
+
+    void load_blocks(std::ifstream& ifs, size_t count) override {
+        blocks_.resize(count);
+        for (auto& block : blocks_) {
+            block.min = Serialization::read_string(ifs);
+            block.max = Serialization::read_string(ifs);
+            block.has_numbers = Serialization::read_uint64(ifs) != 0;
+            ifs.read(reinterpret_cast<char*>(&block.min_number), sizeof(double));
+            ifs.read(reinterpret_cast<char*>(&block.max_number), sizeof(double));
+        }
+    }
+};
+
+class SetSkipIndex : public SkipIndex {
+private:
+    struct Block {
+        // Set when the block had more than max_set_size distinct values.
+        bool overflow = false;
+        std::vector<std::string> values;
+    };
+
+    std::vector<Block> blocks_;
+
+public:
+    using SkipIndex::SkipIndex;
+
+    size_t block_count() const override { return blocks_.size(); }
+
+    size_t memory_usage() const override {
+        size_t total = sizeof(*this) + blocks_.capacity() * sizeof(Block);
+        for (const auto& block : blocks_) {
+            total += block.values.capacity() * sizeof(std::string);
+            for (const auto& value : block.values) {
+                total += value.capacity();
+            }
+        }
+        return total;
+    }
+
+protected:
+    void add_block(const std::vector<std::string>& values) override {
+        Block block;
+        block.values = values;
+        std::sort(block.values.begin(), block.values.end());
+        block.values.erase(std::unique(block.values.begin(), block.values.end()), block.values.end());
+        if (block.values.size() > description_.max_set_size) {
+            block.overflow = true;
+            block.values.clear();
+        }
+        block.values.shrink_to_fit();
+        blocks_.push_back(std::move(block));
+    }
+
+    bool block_may_match(size_t block_index, const ValueCondition& condition) const override {
+        const Block& block = blocks_[block_index];
+        if (block.overflow) {
+            return true;
+        }
+        if (condition.type == ValueConditionType::Equals) {
+            return std::binary_search(block.values.begin(), block.values.end(), condition.value);
+        }
+        return std::any_of(block.values.begin(), block.values.end(),
+                           [&](const std::string& value) { return condition.matches(value); });
+    }
+
+    void append_blocks(SkipIndex& other) override {
+        auto& blocks = static_cast<SetSkipIndex&>(other).blocks_;
+        blocks_.insert(blocks_.end(), std::make_move_iterator(blocks.begin()), std::make_move_iterator(blocks.end()));
+        blocks.clear();
+    }
+
+    void copy_block_from(const SkipIndex& other, size_t block) override {
+        blocks_.push_back(static_cast<const SetSkipIndex&>(other).blocks_[block]);
+    }
+
+    void save_blocks(std::ofstream& ofs) const override {
+        for (const auto& block : blocks_) {
+            Serialization::write_uint64(ofs, block.overflow ? 1 : 0);
+            Serialization::write_uint64(ofs, block.values.size());
+            for (const auto& value : block.values) {
+                Serialization::write_string(ofs, value);
+            }
+        }
+    }
+
+    void load_blocks(std::ifstream& ifs, size_t count) override {
+        blocks_.resize(count);
+        for (auto& block : blocks_) {
+            block.overflow = Serialization::read_uint64(ifs) != 0;
+            block.values.resize(Serialization::read_uint64(ifs));
+            for (auto& value : block.values) {
+                value = Serialization::read_string(ifs);
+            }
+        }
+    }
+};
+
+// Shared by the ngram and token indexes: one bloom filter per block over
+// the terms extract_terms() yields for its values.
+class BloomSkipIndex : public SkipIndex {
+private:
+    std::vector<BloomFilter> blocks_;
+
+public:
+    using SkipIndex::SkipIndex;
+
+    size_t block_count() const override { return blocks_.size(); }
+
+    size_t memory_usage() const override {
+        size_t total = sizeof(*this);
+        for (const auto& block : blocks_) {
+            total += block.memory_usage();
+        }
+        return total;
+    }
+
+protected:
+    // Terms every matching value must contain; `complete` is cleared when
+    // the condition cannot be reduced to terms (the block then matches).
+    virtual std::vector<std::string> condition_terms(const ValueCondition& condition, bool& complete) const = 0;
+
+    virtual void extract_terms(const std::string& value, std::unordered_set<std::string>& terms) const = 0;
+
+    void add_block(const std::vector<std::string>& values) override {
+        std::unordered_set<std::string> terms;
+        for (const auto& value : values) {
+            extract_terms(value, terms);
+        }
+
+        BloomFilter bloom(terms.size(), description_.bloom_bits_per_key);
+        for (const auto& term : terms) {
+            bloom.add(term);
+        }
+        blocks_.push_back(std::move(bloom));
+    }
+
+    bool block_may_match(size_t block_index, const ValueCondition& condition) const override {
+        bool complete = true;
+        auto terms = condition_terms(condition, complete);
+        if (!complete) {
+            return true;
+        }
+        return std::all_of(terms.begin(), terms.end(),
+                           [&](const std::string& term) { return blocks_[block_index].may_contain(term); });
+    }
+
+    void append_blocks(SkipIndex& other) override {
+        auto& blocks = static_cast<BloomSkipIndex&>(other).blocks_;
+        blocks_.insert(blocks_.end(), std::make_move_iterator(blocks.begin()), std::make_move_iterator(blocks.end()));
+        blocks.clear();
+    }
+
+    void copy_block_from(const SkipIndex& other, size_t block) override {
+        blocks_.push_back(static_cast<const BloomSkipIndex&>(other).blocks_[block]);
+    }
+
+    void save_blocks(std::ofstream& ofs) const override {
+        for (const auto& block : blocks_) {
+            block.serialize(ofs);
+        }
+    }
+
+    void load_blocks(std::ifstream& ifs, size_t count) override {
+        blocks_.resize(count);
+        for (auto& block : blocks_) {
+            block.deserialize(ifs);
+        }
+    }
+};
+
+class NgramBloomSkipIndex : public BloomSkipIndex {
+public:
+    using BloomSkipIndex::BloomSkipIndex;
+
+protected:
+    void extract_terms(const std::string& value, std::unordered_set<std::string>& terms) const override {
+        size_t n = description_.ngram_size;
+        for (size_t i = 0; i + n <= value.size(); ++i) {
+            terms.insert(value.substr(i, n));
+        }
+    }
+
+    std::vector<std::string> condition_terms(const ValueCondition& condition, bool& complete) const override {
+        std::unordered_set<std::string> terms;
+        if (condition.type == ValueConditionType::Between || condition.value.size() < description_.ngram_size) {
+            complete = false;
+        } else {
+            extract_terms(condition.value, terms);
+        }
+        return std::vector<std::string>(terms.begin(), terms.end());
+    }
+};
+
+class TokenBloomSkipIndex : public BloomSkipIndex {
+public:
+    using BloomSkipIndex::BloomSkipIndex;
+
+protected:
+    void extract_terms(const std::string& value, std::unordered_set<std::string>& terms) const override {
+        for (auto& token : tokenize(value)) {
+            terms.insert(std::move(token));
+        }
+    }
+
+    std::vector<std::string> condition_terms(const ValueCondition& condition, bool& complete) const override {
+        std::vector<std::string> terms;
+        switch (condition.type) {
+            case ValueConditionType::Equals:
+            case ValueConditionType::HasToken:
+                terms = tokenize(condition.value);
+                break;
+            case ValueConditionType::Contains:
+                // Only tokens bounded by separators inside the pattern are whole.
+                terms = tokenize(condition.value, true);
+                break;
+            case ValueConditionType::Between:
+                break;
+        }
+        complete = !terms.empty();
+        return terms;
+    }
+};
+
+constexpr uint64_t SKIP_INDEX_FORMAT_VERSION = 1;
+
+}  // namespace
+
+ValueCondition ValueCondition::equals(const std::string& value) {
+    ValueCondition condition;
+    condition.type = ValueConditionType::Equals;
+    condition.value = value;
+    return condition;
+}
+
+ValueCondition ValueCondition::contains(const std::string& substring) {
+    ValueCondition condition;
+    condition.type = ValueConditionType::Contains;
+    condition.value = substring;
+    return condition;
+}
+
+ValueCondition ValueCondition::has_token(const std::string& token) {
+    ValueCondition condition;
+    condition.type = ValueConditionType::HasToken;
+    condition.value = token;
+    return condition;
+}
+
+ValueCondition ValueCondition::between(double min_value, double max_value) {
+    ValueCondition condition;
+    condition.type = ValueConditionType::Between;
+    condition.min_value = min_value;
+    condition.max_value = max_value;
+    return condition;
+}
+
+bool ValueCondition::matches(std::string_view row_value) const {
+    switch (type) {
+        case ValueConditionType::Equals:
+            return row_value == value;
+        case ValueConditionType::Contains:
+            return row_value.find(value) != std::string_view::npos;
+        case ValueConditionType::HasToken:
+            return contains_token(row_value, value);
+        case ValueConditionType::Between: {
+            double number;
+            return parse_number(row_value, number) && number >= min_value && number <= max_value;
+        }
+    }
+    return false;
+}
+
+bool SkipIndexDescription::same_blocks(const SkipIndexDescription& other) const {
+    return type == other.type && granularity == other.granularity && max_set_size == other.max_set_size &&
+           ngram_size == other.ngram_size && bloom_bits_per_key == other.bloom_bits_per_key;
+}
+
+void SkipIndex::add_granule(const std::vector<std::string>& values) {
+    pending_values_.insert(pending_values_.end(), values.begin(), values.end());
+    if (++pending_granules_ == description_.granularity) {
+        finish();
+    }
+}
+
+void SkipIndex::finish() {
+    if (pending_granules_ == 0) {
+        return;
+    }
+    add_block(pending_values_);
+    pending_values_.clear();
+    pending_granules_ = 0;
+}
+
+void SkipIndex::append(SkipIndex& other) {
+    if (pending_granules_ != 0 || other.pending_granules_ != 0 || other.description_.type != description_.type ||
+        other.description_.granularity != description_.granularity) {
+        throw std::logic_error("Cannot append skip index " + other.description_.name + " to " + description_.name);
+    }
+    append_blocks(other);
+}
+
+void SkipIndex::copy_block(const SkipIndex& other, size_t block) {
+    if (pending_granules_ != 0 || !other.description_.same_blocks(description_) || block >= other.block_count()) {
+        throw std::logic_error("Cannot copy a block of skip index " + other.description_.name + " to " +
+                               description_.name);
+    }
+    copy_block_from(other, block);
+}
+
+bool SkipIndex::may_match(size_t granule_index, const ValueCondition& condition) const {
+    size_t block = granule_index / description_.granularity;
+    return block >= block_count() || block_may_match(block, condition);
+}
+
+void SkipIndex::save_to_file(const std::string& file_path) const {
+    std::ofstream ofs(file_path, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Cannot open file for writing: " + file_path);
+    }
+
+    Serialization::write_uint64(ofs, SKIP_INDEX_FORMAT_VERSION);
+    Serialization::write_string(ofs, description_.name);
+    Serialization::write_uint64(ofs, static_cast<uint64_t>(description_.type));
+    Serialization::write_uint64(ofs, description_.granularity);
+    Serialization::write_uint64(ofs, description_.max_set_size);
+    Serialization::write_uint64(ofs, description_.ngram_size);
+    Serialization::write_uint64(ofs, description_.bloom_bits_per_key);
+    Serialization::write_uint64(ofs, block_count());
+    save_blocks(ofs);
+}
+
+std::unique_ptr<SkipIndex> create_skip_index(const SkipIndexDescription& description) {
+    if (description.name.empty() || description.granularity == 0) {
+        throw std::invalid_argument("Skip index needs a name and a granularity of at least 1");
+    }
+
+    switch (description.type) {
+        case SkipIndexType::MinMax:
+            return std::make_unique<MinMaxSkipIndex>(description);
+        case SkipIndexType::Set:
+            return std::make_unique<SetSkipIndex>(description);
+        case SkipIndexType::NgramBloom:
+            if (description.ngram_size == 0) {
+                throw std::invalid_argument("Ngram skip index needs ngram_size of at least 1");
+            }
+            return std::make_unique<NgramBloomSkipIndex>(description);
+        case SkipIndexType::TokenBloom:
+            return std::make_unique<TokenBloomSkipIndex>(description);
+    }
+    throw std::invalid_argument("Unknown skip index type");
+}
+
+std::unique_ptr<SkipIndex> load_skip_index(const std::string& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file for reading: " + file_path);
+    }
+
+    if (Serialization::read_uint64(ifs) != SKIP_INDEX_FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported skip index format: " + file_path);
+    }
+
+    SkipIndexDescription description;
+    description.name = Serialization::read_string(ifs);
+    description.type = static_cast<SkipIndexType>(Serialization::read_uint64(ifs));
+    description.granularity = Serialization::read_uint64(ifs);
+    description.max_set_size = Serialization::read_uint64(ifs);
+    description.ngram_size = Serialization::read_uint64(ifs);
+    description.bloom_bits_per_key = Serialization::read_uint64(ifs);
+    size_t count = Serialization::read_uint64(ifs);
+
+    auto index = create_skip_index(description);
+    index->load_blocks(ifs, count);
+    if (!ifs) {
+        throw std::runtime_error("Truncated skip index: " + file_path);
+    }
+    return index;
+}
+
+}  // namespace clickhouse
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+
+namespace clickhouse {
+
+enum class ValueConditionType {
+    Equals,
+    // Value contains `value` as a substring.
+    Contains,
+    // Value contains `value` as a whole token: a maximal run of ASCII
+    // letters, digits and bytes >= 0x80, so UTF-8 words are never split.
+    HasToken,
+    // Value is a number within [min_value, max_value].
+    Between
+};
+
+// Filter on Row::value applied by queries; skip indexes use it to rule out
+// granules before reading them.
+struct ValueCondition {
+    ValueConditionType type = ValueConditionType::Equals;
+    std::string value;
+    double min_value = 0;
+    double max_value = 0;
+
+    static ValueCondition equals(const std::string& value);
+
+    static ValueCondition contains(const std::string& substring);
+
+    static ValueCondition has_token(const std::string& token);
+
+    static ValueCondition between(double min_value, double max_value);
+
+    bool matches(std::string_view row_value) const;
+};
+
+// Granules a filtered read consulted skip indexes for, and how many of
+// them it skipped without reading.
+struct SkipIndexStats {
+    size_t granules_checked = 0;
+    size_t granules_skipped = 0;
+};
+
+enum class SkipIndexType {
+    // Lexicographic min/max of the values, and numeric min/max of those
+    // that parse as numbers.
+    MinMax,
+    // Distinct values, up to max_set_size (larger blocks match everything).
+    Set,
+    // Bloom filter over the ngram_size-byte substrings of the values.
+    NgramBloom,
+    // Bloom filter over the tokens of the values.
+    TokenBloom
+};
+
+// A data-skipping index on the value column, declared per table. It keeps
+// one summary per `granularity` granules, stored in skp_idx_<name>.idx.
+struct SkipIndexDescription {
+    std::string name;
+    SkipIndexType type = SkipIndexType::MinMax;
+    size_t granularity = 1;
+    size_t max_set_size = 100;
+    size_t ngram_size = 3;
+    size_t bloom_bits_per_key = 8;
+
+    SkipIndexDescription() = default;
+    SkipIndexDescription(const std::string& index_name, SkipIndexType index_type, size_t index_granularity = 1)
+        : name(index_name), type(index_type), granularity(index_granularity) {}
+
+    // Whether indexes of both descriptions summarize granules into the same
+    // blocks, so one's blocks can stand in for the other's.
+    bool same_blocks(const SkipIndexDescription& other) const;
+};
+
+class SkipIndex {
+protected:
+    SkipIndexDescription description_;
+    std::vector<std::string> pending_values_;
+    size_t pending_granules_ = 0;
+
+public:
+    explicit SkipIndex(const SkipIndexDescription& description) : description_(description) {}
+
+    virtual ~SkipIndex() = default;
+
+    const SkipIndexDescription& description() const { return description_; }
+
+    // Adds the next granule's values; blocks are summarized as they fill.
+    void add_granule(const std::vector<std::string>& values);
+
+    // Summarizes a trailing partial block.
+    void finish();
+
+    // Appends the blocks of an index of the same description built over the
+    // granules that follow this one's; this index must end on a block
+    // boundary. Used to join slices of a part written in parallel.
+    void append(SkipIndex& other);
+
+    // Appends a copy of `block` of an index with the same blocks, built over
+    // the same granules this one gets next; no granule may be pending.
+    void copy_block(const SkipIndex& other, size_t block);
+
+    // False if no value in the granule's block can satisfy the condition.
+    bool may_match(size_t granule_index, const ValueCondition& condition) const;
+
+    virtual size_t block_count() const = 0;
+
+    void save_to_file(const std::string& file_path) const;
+
+    static std::string file_name(const std::string& index_name) { return "skp_idx_" + index_name + ".idx"; }
+
+    virtual size_t memory_usage() const = 0;
+
+protected:
+    virtual void add_block(const std::vector<std::string>& values) = 0;
+
+    virtual bool block_may_match(size_t block, const ValueCondition& condition) const = 0;
+
+    // Moves `other`'s blocks after this index's; `other` has the same type.
+    virtual void append_blocks(SkipIndex& other) = 0;
+
+    // Appends a copy of `other`'s block; `other` has the same type.
+    virtual void copy_block_from(const SkipIndex& other, size_t block) = 0;
+
+    virtual void save_blocks(std::ofstream& ofs) const = 0;
+
+    virtual void load_blocks(std::ifstream& ifs, size_t count) = 0;
+
+    friend std::unique_ptr<SkipIndex> load_skip_index(const std::string& file_path);
+};
+
+std::unique_ptr<SkipIndex> create_skip_index(const SkipIndexDescription& description);
+
+// Reads an index written by SkipIndex::save_to_file (the file records its
+// own description).
+std::unique_ptr<SkipIndex> load_skip_index(const std::string& file_path);
+
+}  // namespace clickhouse
@@ -1,45 +1,292 @@
 #include "sparse_index.h"
 #include "serialization.h"
+#include "key_compare.h"
 #include <algorithm>
 #include <fstream>
+#include <stdexcept>
+#include <string_view>
 
 namespace clickhouse {
 
+namespace {
+
+// Marks the front-coded primary.idx format; files written before it start
+// with the entry count instead.
+constexpr uint64_t FRONT_CODED_INDEX_MAGIC = 0x31584449544e4f52ULL;
+
+void write_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+uint64_t read_varint(const std::string& data, size_t& pos) {
+    uint8_t first = static_cast<uint8_t>(data[pos]);
+    if (first < 0x80) {
+        ++pos;
+        return first;
+    }
+
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(data[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+// Decodes the key at `pos` into `key`, given the previous key in `previous`.
+void read_key(const std::string& data, size_t& pos, const std::string& previous, std::string& key) {
+    size_t shared = read_varint(data, pos);
+    size_t length = read_varint(data, pos);
+    key.assign(previous.data(), shared);
+    key.append(data.data() + pos, length);
+    pos += length;
+}
+
+}  // namespace
+
 void SparseIndex::add_entry(const std::string& min_key, const std::string& max_key,
-                           size_t granule_index, size_t row_count) {
-    entries_.emplace_back(min_key, max_key, granule_index, row_count);
+                           size_t granule_index, size_t row_count,
+                           uint64_t min_timestamp, uint64_t max_timestamp) {
+    if (!infos_.empty() && min_key < last_key_) {
+        ordered_ = false;
+    }
+
+    if (infos_.size() % RESTART_INTERVAL == 0) {
+        restarts_.push_back(static_cast<uint32_t>(key_data_.size()));
+        last_key_.clear();
+    }
+
+    append_key(min_key);
+    append_key(max_key);
+    search_tree_.clear();
+    infos_.push_back({static_cast<uint32_t>(granule_index), static_cast<uint32_t>(row_count),
+                      min_timestamp, max_timestamp});
 }
 
 void SparseIndex::add_entry(const IndexEntry& entry) {
-    entries_.push_back(entry);
+    add_entry(entry.min_key, entry.max_key, entry.granule_index, entry.row_count,
+              entry.min_timestamp, entry.max_timestamp);
 }
 
-std::vector<size_t> SparseIndex::find_granules(const std::string& start_key, const std::string& end_key) const {
-    std::vector<size_t> result;
+void SparseIndex::append_key(const std::string& key) {
+    size_t shared = 0;
+    size_t limit = std::min(key.size(), last_key_.size());
+    while (shared < limit && key[shared] == last_key_[shared]) {
+        ++shared;
+    }
+
+    write_varint(key_data_, shared);
+    write_varint(key_data_, key.size() - shared);
+    key_data_.append(key, shared, std::string::npos);
+    last_key_ = key;
+}
+
+template <typename Visitor>
+void SparseIndex::scan(size_t first, Visitor&& visit) const {
+    if (first >= infos_.size()) {
+        return;
+    }
+
+    size_t block = first / RESTART_INTERVAL;
+    size_t pos = restarts_[block];
+    std::string min_key;
+    std::string max_key;
+
+    for (size_t i = block * RESTART_INTERVAL; i < infos_.size(); ++i) {
+        if (i % RESTART_INTERVAL == 0) {
+            max_key.clear();
+        }
+        read_key(key_data_, pos, max_key, min_key);
+        read_key(key_data_, pos, min_key, max_key);
+
+        if (i >= first && !visit(i, min_key, max_key)) {
+            return;
+        }
+    }
+}
+
+std::string_view SparseIndex::restart_key(size_t block) const {
+    size_t pos = restarts_[block];
+    read_varint(key_data_, pos);
+    size_t length = read_varint(key_data_, pos);
+    return std::string_view(key_data_.data() + pos, length);
+}
 
-    for (const auto& entry : entries_) {
-        if (entry.overlaps_range(start_key, end_key)) {
-            result.push_back(entry.granule_index);
+size_t SparseIndex::lookup_start(const std::string& start_key) const {
+    if (!ordered_) {
+        return 0;
+    }
+
+    // Restart points hold their min key in full. Granules before the last
+    // block starting below start_key end at or before that block's first
+    // min key, so they cannot reach start_key. `low` counts the blocks
+    // starting below start_key.
+    size_t low = 0;
+
+    if (!search_tree_.empty()) {
+        // Prefixes decide most comparisons; only equal prefixes need the key.
+        size_t n = search_tree_.size() - 2;
+        std::string_view key(start_key);
+        int shared = key.substr(0, search_prefix_.size()).compare(search_prefix_);
+        if (shared != 0) {
+            return shared < 0 ? 0 : (n - 1) * RESTART_INTERVAL;
+        }
+
+        key.remove_prefix(search_prefix_.size());
+        uint64_t prefix = normalized_key_prefix(key);
+        size_t k = 1;
+        while (k <= n) {
+            __builtin_prefetch(search_tree_.data() + std::min(n, k * 4));
+            const SearchNode& node = search_tree_[k];
+            bool below;
+            if (node.prefix != prefix) {
+                below = node.prefix < prefix;
+            } else {
+                uint32_t length = search_tree_[k + 1].key_offset - node.key_offset;
+                below = std::string_view(search_keys_.data() + node.key_offset, length) < key;
+            }
+            k = 2 * k + (below ? 1 : 0);
+        }
+        // Undo the trailing right turns (and the last left one) to reach the
+        // first node not below start_key; 0 when there is none.
+        k >>= __builtin_ctzll(~static_cast<unsigned long long>(k)) + 1;
+        low = k == 0 ? n : search_tree_[k].block;
+    } else {
+        size_t high = restarts_.size();
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (restart_key(mid) < start_key) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
         }
     }
 
+    return low == 0 ? 0 : (low - 1) * RESTART_INTERVAL;
+}
+
+void SparseIndex::build_search_tree() {
+    search_tree_.clear();
+    search_keys_.clear();
+    search_prefix_.clear();
+    if (restarts_.empty()) {
+        return;
+    }
+
+    // Restart keys are sorted, so the first and last share what all share.
+    std::string_view first = restart_key(0);
+    std::string_view last = restart_key(restarts_.size() - 1);
+    size_t shared = 0;
+    while (shared < first.size() && shared < last.size() && first[shared] == last[shared]) {
+        ++shared;
+    }
+    search_prefix_.assign(first.substr(0, shared));
+
+    size_t n = restarts_.size();
+    search_tree_.assign(n + 2, SearchNode{0, 0, 0});
+    build_search_tree(0, 1);
+
+    for (size_t k = 1; k <= n; ++k) {
+        search_tree_[k].key_offset = static_cast<uint32_t>(search_keys_.size());
+        search_keys_.append(restart_key(search_tree_[k].block).substr(shared));
+    }
+    search_tree_[n + 1].key_offset = static_cast<uint32_t>(search_keys_.size());
+}
+
+size_t SparseIndex::build_search_tree(size_t next_block, size_t node) {
+    // In-order traversal of the implicit tree visits blocks in key order.
+    if (node < search_tree_.size() - 1) {
+        next_block = build_search_tree(next_block, 2 * node);
+        std::string_view key = restart_key(next_block).substr(search_prefix_.size());
+        search_tree_[node] = SearchNode{normalized_key_prefix(key), static_cast<uint32_t>(next_block), 0};
+        next_block = build_search_tree(next_block + 1, 2 * node + 1);
+    }
+    return next_block;
+}
+
+std::vector<size_t> SparseIndex::find_granules_impl(const std::string& start_key, const std::string& end_key,
+                                                   uint64_t ts_from, uint64_t ts_to) const {
+    std::vector<size_t> result;
+
+    scan(lookup_start(start_key), [&](size_t i, const std::string& min_key, const std::string& max_key) {
+        if (min_key > end_key) {
+            return !ordered_;
+        }
+        const EntryInfo& info = infos_[i];
+        if (!(max_key < start_key) && !(info.max_timestamp < ts_from || info.min_timestamp > ts_to)) {
+            result.push_back(info.granule_index);
+        }
+        return true;
+    });
+
     return result;
 }
 
+std::vector<size_t> SparseIndex::find_granules(const std::string& start_key, const std::string& end_key) const {
+    return find_granules_impl(start_key, end_key, 0, UINT64_MAX);
+}
+
+std::vector<size_t> SparseIndex::find_granules(const std::string& start_key, const std::string& end_key,
+                                              uint64_t ts_from, uint64_t ts_to) const {
+    return find_granules_impl(start_key, end_key, ts_from, ts_to);
+}
+
 std::vector<size_t> SparseIndex::find_granules_for_key(const std::string& key) const {
     return find_granules(key, key);
 }
 
 void SparseIndex::clear() {
-    entries_.clear();
+    key_data_.clear();
+    restarts_.clear();
+    infos_.clear();
+    search_tree_.clear();
+    search_keys_.clear();
+    search_prefix_.clear();
+    last_key_.clear();
+    ordered_ = true;
 }
 
 bool SparseIndex::empty() const {
-    return entries_.empty();
+    return infos_.empty();
 }
 
 size_t SparseIndex::size() const {
-    return entries_.size();
+    return infos_.size();
+}
+
+IndexEntry SparseIndex::entry(size_t i) const {
+    if (i >= infos_.size()) {
+        throw std::out_of_range("Index entry out of range");
+    }
+
+    IndexEntry result;
+    scan(i, [&](size_t index, const std::string& min_key, const std::string& max_key) {
+        const EntryInfo& info = infos_[index];
+        result = IndexEntry(min_key, max_key, info.granule_index, info.row_count,
+                            info.min_timestamp, info.max_timestamp);
+        return false;
+    });
+    return result;
+}
+
+std::vector<IndexEntry> SparseIndex::entries() const {
+    std::vector<IndexEntry> result;
+    result.reserve(infos_.size());
+
+    scan(0, [&](size_t index, const std::string& min_key, const std::string& max_key) {
+        const EntryInfo& info = infos_[index];
+        result.emplace_back(min_key, max_key, info.granule_index, info.row_count,
+                            info.min_timestamp, info.max_timestamp);
+        return true;
+    });
+    return result;
 }
 
 void SparseIndex::save_to_file(const std::string& file_path) const {
@@ -48,13 +295,18 @@ void SparseIndex::save_to_file(const std::string& file_path) const {
         throw std::runtime_error("Cannot open file for writing: " + file_path);
     }
 
-    Serialization::write_uint64(ofs, entries_.size());
+    Serialization::write_uint64(ofs, FRONT_CODED_INDEX_MAGIC);
+    Serialization::write_uint64(ofs, infos_.size());
+    Serialization::write_uint64(ofs, ordered_ ? 1 : 0);
+    Serialization::write_string(ofs, key_data_);
 
-    for (const auto& entry : entries_) {
-        Serialization::write_string(ofs, entry.min_key);
-        Serialization::write_string(ofs, entry.max_key);
-        Serialization::write_uint64(ofs, entry.granule_index);
-        Serialization::write_uint64(ofs, entry.row_count);
+    for (uint32_t restart : restarts_) {
+        Serialization::write_uint64(ofs, restart);
+    }
+
+    for (const auto& info : infos_) {
+        Serialization::write_uint64(ofs, info.granule_index);
+        Serialization::write_uint64(ofs, info.row_count);
     }
 }
 
@@ -64,45 +316,106 @@ void SparseIndex::load_from_file(const std::string& file_path) {
         throw std::runtime_error("Cannot open file for reading: " + file_path);
     }
 
-    entries_.clear();
+    clear();
+
+    uint64_t header = Serialization::read_uint64(ifs);
+    if (header != FRONT_CODED_INDEX_MAGIC) {
+        // Full keys per entry; re-encoded on load.
+        for (uint64_t i = 0; i < header; ++i) {
+            std::string min_key = Serialization::read_string(ifs);
+            std::string max_key = Serialization::read_string(ifs);
+            uint64_t granule_index = Serialization::read_uint64(ifs);
+            uint64_t row_count = Serialization::read_uint64(ifs);
+
+            add_entry(min_key, max_key, granule_index, row_count);
+        }
+        build_search_tree();
+        return;
+    }
 
     uint64_t count = Serialization::read_uint64(ifs);
-    entries_.reserve(count);
+    ordered_ = Serialization::read_uint64(ifs) != 0;
+    key_data_ = Serialization::read_string(ifs);
 
-    for (uint64_t i = 0; i < count; ++i) {
-        std::string min_key = Serialization::read_string(ifs);
-        std::string max_key = Serialization::read_string(ifs);
-        uint64_t granule_index = Serialization::read_uint64(ifs);
-        uint64_t row_count = Serialization::read_uint64(ifs);
+    restarts_.resize((count + RESTART_INTERVAL - 1) / RESTART_INTERVAL);
+    for (auto& restart : restarts_) {
+        restart = static_cast<uint32_t>(Serialization::read_uint64(ifs));
+    }
 
-        entries_.emplace_back(min_key, max_key, granule_index, row_count);
+    infos_.resize(count);
+    for (auto& info : infos_) {
+        info.granule_index = static_cast<uint32_t>(Serialization::read_uint64(ifs));
+        info.row_count = static_cast<uint32_t>(Serialization::read_uint64(ifs));
+        info.min_timestamp = 0;
+        info.max_timestamp = UINT64_MAX;
     }
+
+    if (!ifs) {
+        throw std::runtime_error("Truncated index file: " + file_path);
+    }
+
+    if (count > 0) {
+        last_key_ = entry(count - 1).max_key;
+    }
+    build_search_tree();
 }
 
-void SparseIndex::merge_with(const SparseIndex& other, size_t granule_offset) {
-    for (const auto& entry : other.entries_) {
-        IndexEntry new_entry = entry;
-        new_entry.granule_index += granule_offset;
-        entries_.push_back(new_entry);
+void SparseIndex::save_timestamp_index(const std::string& file_path) const {
+    std::ofstream ofs(file_path, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Cannot open file for writing: " + file_path);
     }
 
-    sort_entries();
+    Serialization::write_uint64(ofs, infos_.size());
+
+    for (const auto& info : infos_) {
+        Serialization::write_uint64(ofs, info.min_timestamp);
+        Serialization::write_uint64(ofs, info.max_timestamp);
+    }
 }
 
-size_t SparseIndex::memory_usage() const {
-    size_t total = sizeof(SparseIndex);
-    for (const auto& entry : entries_) {
-        total += sizeof(IndexEntry) + entry.min_key.size() + entry.max_key.size();
+void SparseIndex::load_timestamp_index(const std::string& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file for reading: " + file_path);
+    }
+
+    uint64_t count = Serialization::read_uint64(ifs);
+    if (count != infos_.size()) {
+        throw std::runtime_error("Timestamp index does not match primary index: " + file_path);
+    }
+
+    for (auto& info : infos_) {
+        info.min_timestamp = Serialization::read_uint64(ifs);
+        info.max_timestamp = Serialization::read_uint64(ifs);
     }
-    return total;
 }
 
-void SparseIndex::sort_entries() {
-    std::sort(entries_.begin(), entries_.end(),
+void SparseIndex::merge_with(const SparseIndex& other, size_t granule_offset) {
+    std::vector<IndexEntry> merged = entries();
+    for (auto entry : other.entries()) {
+        entry.granule_index += granule_offset;
+        merged.push_back(std::move(entry));
+    }
+
+    std::sort(merged.begin(), merged.end(),
         [](const IndexEntry& a, const IndexEntry& b) {
             if (a.min_key != b.min_key) return a.min_key < b.min_key;
             return a.granule_index < b.granule_index;
         });
+
+    clear();
+    for (const auto& entry : merged) {
+        add_entry(entry);
+    }
+    build_search_tree();
+}
+
+size_t SparseIndex::memory_usage() const {
+    return sizeof(SparseIndex) + key_data_.capacity() + last_key_.capacity() +
+           restarts_.capacity() * sizeof(uint32_t) + infos_.capacity() * sizeof(EntryInfo) +
+           search_tree_.capacity() * sizeof(SearchNode) + search_keys_.capacity() +
+           search_prefix_.capacity();
 }
 
 }  // namespace clickhouse
\ No newline at end of file
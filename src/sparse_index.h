@@ -3,6 +3,8 @@
 #include "row.h"
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
 
 namespace clickhouse {
 
@@ -11,30 +13,84 @@ struct IndexEntry {
     std::string max_key;
     size_t granule_index;
     size_t row_count;
+    uint64_t min_timestamp = 0;
+    uint64_t max_timestamp = UINT64_MAX;
 
     IndexEntry() = default;
-    IndexEntry(const std::string& min_k, const std::string& max_k, size_t idx, size_t count)
-        : min_key(min_k), max_key(max_k), granule_index(idx), row_count(count) {}
+    IndexEntry(const std::string& min_k, const std::string& max_k, size_t idx, size_t count,
+               uint64_t min_ts = 0, uint64_t max_ts = UINT64_MAX)
+        : min_key(min_k), max_key(max_k), granule_index(idx), row_count(count),
+          min_timestamp(min_ts), max_timestamp(max_ts) {}
 
     bool overlaps_range(const std::string& start_key, const std::string& end_key) const {
         return !(max_key < start_key || min_key > end_key);
     }
+
+    bool overlaps_time_range(uint64_t ts_from, uint64_t ts_to) const {
+        return !(max_timestamp < ts_from || min_timestamp > ts_to);
+    }
 };
 
+// Per-granule key ranges of a part. Keys are front-coded in one buffer
+// (min, max, min, max, ...): each key stores the length of the prefix it
+// shares with the previous key plus the remaining suffix. Every
+// RESTART_INTERVAL entries a restart point stores its min key in full, so
+// lookups binary-search restart points and decode at most one block before
+// scanning forward. The same encoding is used in primary.idx.
 class SparseIndex {
+public:
+    static constexpr size_t RESTART_INTERVAL = 16;
+
 private:
-    std::vector<IndexEntry> entries_;
+    // Restart point in the search tree: 8 bytes of its min key following
+    // the prefix all restart keys share, big-endian so integer order matches
+    // string order. The rest of the key is at key_offset in search_keys_
+    // and only read when prefixes tie.
+    struct SearchNode {
+        uint64_t prefix;
+        uint32_t block;
+        uint32_t key_offset;
+    };
+
+    struct EntryInfo {
+        uint32_t granule_index;
+        uint32_t row_count;
+        uint64_t min_timestamp;
+        uint64_t max_timestamp;
+    };
+
+    std::string key_data_;
+    std::vector<uint32_t> restarts_;
+    std::vector<EntryInfo> infos_;
+    // Last key appended, the base for front-coding the next one.
+    std::string last_key_;
+    // Whether each granule's min key is >= the previous granule's max key
+    // (true for every part this engine writes); lookups scan everything
+    // otherwise.
+    bool ordered_ = true;
+    // Restart points in Eytzinger (BFS) order, 1-based; node k's children
+    // are 2k and 2k+1, so the first levels share cache lines. The last node
+    // only ends the key buffer. Key suffixes are stored in the same order so
+    // the levels every lookup visits stay cached too. Built once the index
+    // is complete; lookups binary-search restart keys until then.
+    std::vector<SearchNode> search_tree_;
+    std::string search_keys_;
+    std::string search_prefix_;
 
 public:
     SparseIndex() = default;
 
     void add_entry(const std::string& min_key, const std::string& max_key,
-                   size_t granule_index, size_t row_count);
+                   size_t granule_index, size_t row_count,
+                   uint64_t min_timestamp = 0, uint64_t max_timestamp = UINT64_MAX);
 
     void add_entry(const IndexEntry& entry);
 
     std::vector<size_t> find_granules(const std::string& start_key, const std::string& end_key) const;
 
+    std::vector<size_t> find_granules(const std::string& start_key, const std::string& end_key,
+                                      uint64_t ts_from, uint64_t ts_to) const;
+
     std::vector<size_t> find_granules_for_key(const std::string& key) const;
 
     void clear();
@@ -43,18 +99,50 @@ public:
 
     size_t size() const;
 
-    const std::vector<IndexEntry>& entries() const { return entries_; }
+    // Decodes entry `i` (at most one block of keys).
+    IndexEntry entry(size_t i) const;
+
+    // Decodes every entry; for merges and rewrites, not lookups.
+    std::vector<IndexEntry> entries() const;
 
     void save_to_file(const std::string& file_path) const;
 
+    // Reads the front-coded format, or the older one with full keys.
     void load_from_file(const std::string& file_path);
 
+    // Per-granule timestamp min/max skip index, kept in its own file so parts
+    // written before it existed still load (their granules are never pruned).
+    void save_timestamp_index(const std::string& file_path) const;
+
+    void load_timestamp_index(const std::string& file_path);
+
     void merge_with(const SparseIndex& other, size_t granule_offset);
 
+    // First entry a lookup for keys >= start_key has to decode: the start of
+    // the block before the first restart point not below start_key.
+    size_t lookup_start(const std::string& start_key) const;
+
+    // Builds the search tree over restart points; adding an entry drops it.
+    void build_search_tree();
+
+    bool has_search_tree() const { return !search_tree_.empty(); }
+
     size_t memory_usage() const;
 
 private:
-    void sort_entries();
+    void append_key(const std::string& key);
+
+    std::string_view restart_key(size_t block) const;
+
+    size_t build_search_tree(size_t next_block, size_t node);
+
+    // Calls visit(index, min_key, max_key) for entries from `first` on until
+    // it returns false.
+    template <typename Visitor>
+    void scan(size_t first, Visitor&& visit) const;
+
+    std::vector<size_t> find_granules_impl(const std::string& start_key, const std::string& end_key,
+                                           uint64_t ts_from, uint64_t ts_to) const;
 };
 
-}  // namespace clickhouse
\ No newline at end of file
+}  // namespace clickhouse
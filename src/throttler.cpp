@@ -0,0 +1,46 @@
+#include "throttler.h"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+namespace clickhouse {
+
+Throttler::Throttler(uint64_t bytes_per_second, uint64_t burst_bytes)
+    : bytes_per_second_(bytes_per_second),
+      burst_bytes_(burst_bytes > 0 ? burst_bytes : bytes_per_second),
+      tokens_(static_cast<double>(burst_bytes_)),
+      last_refill_(std::chrono::steady_clock::now()),
+      total_bytes_(0), throttled_us_(0) {
+    if (bytes_per_second == 0) {
+        throw std::invalid_argument("Throttler rate must be positive");
+    }
+}
+
+void Throttler::add(uint64_t bytes) {
+    total_bytes_ += bytes;
+
+    double sleep_seconds = 0.0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_refill_).count();
+        last_refill_ = now;
+
+        tokens_ = std::min(static_cast<double>(burst_bytes_), tokens_ + elapsed * bytes_per_second_);
+        tokens_ -= static_cast<double>(bytes);
+
+        // The debt is paid by sleeping; concurrent callers queue up behind it.
+        if (tokens_ < 0) {
+            sleep_seconds = -tokens_ / bytes_per_second_;
+        }
+    }
+
+    if (sleep_seconds > 0) {
+        auto duration = std::chrono::microseconds(static_cast<uint64_t>(sleep_seconds * 1e6));
+        std::this_thread::sleep_for(duration);
+        throttled_us_ += duration.count();
+    }
+}
+
+}  // namespace clickhouse
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+namespace clickhouse {
+
+// Token bucket limiting a byte rate, shared by every merge. Callers report
+// I/O after doing it and are put to sleep once they run ahead of the rate;
+// up to burst_bytes of unused budget is kept while idle.
+class Throttler {
+private:
+    uint64_t bytes_per_second_;
+    uint64_t burst_bytes_;
+
+    std::mutex mutex_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_refill_;
+
+    std::atomic<uint64_t> total_bytes_;
+    std::atomic<uint64_t> throttled_us_;
+
+public:
+    // burst_bytes = 0 allows one second worth of bytes.
+    explicit Throttler(uint64_t bytes_per_second, uint64_t burst_bytes = 0);
+
+    void add(uint64_t bytes);
+
+    uint64_t total_bytes() const { return total_bytes_; }
+
+    uint64_t throttled_microseconds() const { return throttled_us_; }
+};
+
+}  // namespace clickhouse